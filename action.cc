@@ -67,7 +67,8 @@ ActionChange::ActionChange(int index) : m_index(index)
 
 void ActionChange::doAction(Cell *cell, double deltaT) 
 {
-  cell->setTypeIndex(m_index);
+  // Cells applies the change once it's done updating this cell 
+  cell->setNextTypeIndex(m_index);
   m_tap->update(m_id);
 }
 
@@ -49,6 +49,12 @@ class Array3D {
     void setAll(const T &value)
     { for (int i=0; i<m_n; i++) m_data[i] = value; }
 
+    // exchange contents with another array of the same size - cheap, 
+    // just swaps data pointers
+    void swap(Array3D &other)
+    { assert(m_i==other.m_i && m_j==other.m_j && m_k==other.m_k);
+      T *temp = m_data; m_data = other.m_data; other.m_data = temp; }
+
     //--------------------------- ACCESSORS --------------------------------
     // get sizes 
     int xsize() const {return m_i;};
@@ -33,18 +33,22 @@
 #include <iostream>
 #include <fstream>
 #include <cassert>
+#include <climits>
+#include <atomic>
 #include "simPoint.h"		// need header for SimPoint objects
+#include "lattice.h"
 using namespace std;
 
 class Cell {	
   public:
     //--------------------------- CREATORS --------------------------------- 
     Cell(int index, const SimPoint& position) :
-	m_typeIndex(index), m_pos(position), m_velocity(SimPoint(0,0,0)), 
-        m_direction(SimPoint(0,0,0)), m_alive(true) 
+	m_typeIndex(index), m_nextType(-1), m_pos(position), 
+	m_velocity(SimPoint(0,0,0)), m_direction(SimPoint(0,0,0)), 
+	m_alive(true), m_claim(NO_CLAIM)
 	{assert(index >= 0);};	
     Cell(ifstream &infile, int index, int numAttr) :
-	m_typeIndex(index), m_alive(true)
+	m_typeIndex(index), m_nextType(-1), m_alive(true), m_claim(NO_CLAIM)
       { assert(index >= 0);
   	infile >> m_pos >> m_velocity >> m_direction;
         setNumAttributes(numAttr);
@@ -61,6 +65,9 @@ class Cell {
     // internal values
     void setTypeIndex(int index) {assert(index>=0); m_typeIndex = index;};
     void setPosition(const SimPoint& p) {m_pos = p;};
+    // fixed-point copy of position; only kept up to date by Cells when
+    // using lattice positions
+    void setLatticePosition(const LatticePoint& c) {m_lpos = c;};
     void setVelocity(const SimPoint& v) {m_velocity = v;};
     void setDirection(const SimPoint& v) {m_direction = v;};
     void setNumAttributes(int num) {m_internals.assign(num, 0);};
@@ -69,27 +76,48 @@ class Cell {
 	 m_internals[index]=value;};		
     void die() {m_alive = false;};
 
+    // type change requested by an Action; held until Cells applies it, 
+    // so that other cells updated in the same step see the old type
+    void setNextTypeIndex(int index) {assert(index>=0); m_nextType = index;};
+    void applyNextTypeIndex() 
+	{if (m_nextType >= 0) {m_typeIndex = m_nextType; m_nextType = -1;}};
+
+    // claim on this cell by another (e.g. phagocyte) in synchronous 
+    // update mode; lowest rank wins (claimants may be on different threads)
+    void claim(int rank) {
+	int cur = m_claim.load();
+	while (rank < cur && !m_claim.compare_exchange_weak(cur, rank)) ;
+    };
+    void clearClaim() {m_claim = NO_CLAIM;};
+
     //--------------------------- ACCESSORS --------------------------------
     int getTypeIndex() const {return m_typeIndex;};
     bool isType(int i) const {return (m_typeIndex==i);};
     const SimPoint& getPosition() const {return m_pos;};
+    const LatticePoint& getLatticePosition() const {return m_lpos;};
     const SimPoint& getVelocity() const {return m_velocity;};
     const SimPoint& getDirection() const {return m_direction;};
     bool isAlive() const {return m_alive;};
+    int getClaim() const {return m_claim;};
     double getValue(int index) const 
 	{assert(index>=0); assert(index<int(m_internals.size())); 
 	 return m_internals[index];};
     const vector<double>& getInternals() const {return m_internals;};
 
+    enum { NO_CLAIM = INT_MAX };
+
   private:
     int m_typeIndex;		// identifies which type of cell this is
+    int m_nextType;		// pending type change; -1 if none
     SimPoint m_pos;		// 3D location within space, in microns
+    LatticePoint m_lpos;	// same, fixed-point (lattice mode only)
     SimPoint m_velocity;	// velocity vector; microns/sec in each dir.
     SimPoint m_direction;	// cell's chosen heading; different from 
 				// normalized velocity if other forces act
     bool m_alive;		// is this cell alive?
 				// for efficient list management, may need to 
 				// leave cell in list even when dead
+    atomic<int> m_claim;	// rank of winning claimant, or NO_CLAIM
 
     vector<double> m_internals;		// cell attributes 
 
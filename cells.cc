@@ -37,10 +37,18 @@
 #include "cell.h"
 #include "simPoint.h"
 #include "random.h"
+#include "scheduler.h"
+#include "molecule.h"
 #include "util.h"
 
 using namespace std;
 
+#define MOVE_GRAIN 64	// #cells per Scheduler chunk when moving cells
+#define UPDATE_GRAIN 256	// #cells per chunk in synchronous update; 
+			// fixed, so results don't depend on #threads
+#define FORCE_SLACK 1.000001	// neighbors further than this times the 
+			// touching distance in x or y can't touch
+
 /************************************************************************ 
  * Cells()                                  				*
  *   Constructor - sets up empty cell lists                             *
@@ -49,7 +57,9 @@ using namespace std;
  *									*
  * Returns - nothing               					*
  ************************************************************************/
-Cells::Cells() : m_xrange(0), m_yrange(0), m_zrange(0)
+Cells::Cells() : m_xrange(0), m_yrange(0), m_zrange(0), m_sync(false),
+	m_useLattice(false), m_neighborLists(&Cells::neighborLists<0>),
+	m_neighborForces(&Cells::neighborForces<0>)
 {
 }
 
@@ -75,7 +85,8 @@ Cells::~Cells()
 /************************************************************************
  * setGeometry()                                                        *
  *   Changes geometry definition; in particular, creates lists of Cell  *
- *   pointers by grid cell location.                                    *
+ *   pointers by grid cell location, and picks the neighbor search to   *
+ *   go with them - planar if there's a single layer of patches.        *
  *                                                                      *
  * Parameters                                                           *
  *   int xrange, yrange, zrange:   size of sim space in microns         *
@@ -89,6 +100,7 @@ void Cells::setGeometry(int xrange, int yrange, int zrange, int gridsize)
 
   m_xrange = xrange; m_yrange = yrange; m_zrange = zrange;
   m_gridsize = gridsize;
+  m_lattice.setGeometry(xrange, yrange, zrange);
 
   if (!m_gridsize)		// pretend system 'well-mixed' - no real space
   {
@@ -120,6 +132,23 @@ void Cells::setGeometry(int xrange, int yrange, int zrange, int gridsize)
       abort();
     }
   }
+
+  // decide once, rather than for every cell
+  if ( (m_xsize <= 3) && (m_ysize <= 3) && (m_zsize <= 3) )
+  {
+    m_neighborLists = &Cells::neighborLists<0>;
+    m_neighborForces = &Cells::neighborForces<0>;
+  }
+  else if (m_zsize == 1)
+  {
+    m_neighborLists = &Cells::neighborLists<2>;
+    m_neighborForces = &Cells::neighborForces<2>;
+  }
+  else
+  {
+    m_neighborLists = &Cells::neighborLists<3>;
+    m_neighborForces = &Cells::neighborForces<3>;
+  }
 }
 
 /************************************************************************ 
@@ -252,8 +281,10 @@ void Cells::addCell(int index, SimPoint pos,
     pct->randomizeCell(c);
 
   // add to temporary list; this list will be merged with cell_list
-  // for the class later
-  try { new_cell_list.push_back(c); }
+  // for the class later (via chunk's buffer during synchronous update)
+  StepBuffer *pb = StepBuffer::getCurrent();
+  vector<Cell*> &rlist = pb ? pb->births : new_cell_list;
+  try { rlist.push_back(c); }
   catch(std::bad_alloc&) {
     cerr << "not enough memory to add new cell to list" << endl;
     abort();
@@ -272,6 +303,12 @@ void Cells::addCell(int index, SimPoint pos,
  ************************************************************************/
 void Cells::mergeNew()
 {
+  // cells from init file haven't been through wrapBC; births have, but 
+  // still need lattice copy of position
+  if (m_useLattice)
+    for (unsigned int i=0; i<new_cell_list.size(); i++)
+      snapToLattice(new_cell_list[i]);
+
   // move cells to 'real' list
   cell_list.insert(cell_list.end(), 
 		   new_cell_list.begin(), new_cell_list.end());
@@ -695,99 +732,163 @@ void Cells::addRandomly2D(const string type_name, int number, double z)
 }
 		
 /************************************************************************ 
- * getTarget                                  				*
- *   Returns pointer to a single cell within a specified distance of    *
- *   the cell passed in by first getting the list of all cells in   	*
- *   27 surrounding patches, then repeatedly choosing a cell at random  *
- *   from the list until it finds one that is less than the specified   *
- *   distance.  The point of the random selection is to avoid biasing   *
- *   the search by the order in which getNeighbors checks neighboring   *
- *   patches.                                                           *
- *   Returns null if no such cell found within a reasonable #tries.	*
+ * findCell                                   				*
+ *   Looks for a cell of a given type (or any type) within a specified  *
+ *   distance of the cell passed in, going once through the cells in    *
+ *   the 27 surrounding patches without copying them into a list.       *
+ *   SELECT_ANY stops at the first match; SELECT_RANDOM keeps one match *
+ *   by reservoir sampling, so each is equally likely whatever order    *
+ *   the patches are checked in; SELECT_CLOSEST keeps the nearest.      *
  *									*
  * Parameters          			 				*
  *   Cell *pc:      		defines patch to search        		*
  *   double d;			max dist to target cell           	*
+ *   int typeID:		index of desired cell type, or ANY_TYPE *
+ *   Selection how:		which match to return                   *
  *									*
- * Returns - nothing               					*
+ * Returns - pointer to cell found, or null if there is none		*
  ************************************************************************/
-Cell * Cells::getTarget(Cell *pc, double d)
+Cell * Cells::findCell(Cell *pc, double d, int typeID, Selection how)
 {
   if (d > m_gridsize)
-    cout << "Cells::getTarget warning - search radius larger than gridsize" 
+    cout << "Cells::findCell warning - search radius larger than gridsize" 
 	    << endl;
 
-  vector<Cell*> clist;
-  getNeighbors(pc, clist);
+  const vector<Cell*> *lists[27];
+  int nlists = getNeighborLists(pc, lists);
 
-  int index = 0;			// actual index into list
-  unsigned int i = 0; 		// track #times through loop
-  bool found = false;
-  while ( !found && i<clist.size() )
+  Cell *found = 0;
+  int nfound = 0;			// #matches seen (SELECT_RANDOM)
+  double best = d;			// closest so far (SELECT_CLOSEST)
+  for (int l=0; l<nlists; l++)
   {
-    // pick a random index, test that cell 
-    index = int( RandK::randk()*clist.size() );
-    if ( clist[index]->isAlive() && (clist[index] != pc) )
+    const vector<Cell*> &rcl = *lists[l];
+    for (unsigned int i=0; i<rcl.size(); i++)
     {
+      Cell *pt = rcl[i];
+      if ( (pt == pc) || !isCandidate(pt) || 
+	   ((typeID != ANY_TYPE) && (pt->getTypeIndex() != typeID)) )
+	continue;
+
       // test distance 
-      SimPoint dv = getDistVector(clist[index], pc);
+      SimPoint dv = getDistVector(pt, pc);
       double mag = dv.dist(SimPoint(0,0,0));
-      if (mag <= d)
-        found = true;
+      if (mag > d)
+	continue;
+
+      switch (how)
+      {
+	case SELECT_ANY:
+	  return pt;
+	case SELECT_RANDOM:		// keep k'th match with probability 1/k
+	  nfound++;
+	  if ( (nfound == 1) || (RandK::randk()*nfound < 1) )
+	    found = pt;
+	  break;
+	case SELECT_CLOSEST:
+	  if (!found || (mag < best))
+	  {
+	    found = pt;
+	    best = mag;
+	  }
+	  break;
+      }
     }
-    i++;
   }
 
-  if (!found)
-    return NULL;
-  else
-  {
-    return clist[index];
-  }
+  return found;
 }
 
 /************************************************************************ 
- * checkNeighbors                             				*
- *   Returns a boolean value indicating whether there is a cell of the  *
- *   specified type within a specified distance of the cell passed in.  *
- *   Similar to getTarget in that it uses getNeighbors to get a list of *
- *   all cells in the 27 surrounding patches.  But since this routine   *
- *   is not selecting one of those cells, it just searches the list     *
- *   sequentially.
+ * neighborPatches<DIMS>                       				*
+ *   Identifies the 27 grid cells that surround a location (9 if there  *
+ *   is only one layer, DIMS 2).  Not for DIMS 0, when there are no     *
+ *   more than 3 grid cells in each direction - see neighborLists.      *
+ *   This routines assumes periodic boundary conditions.		*
+ *   Assumes sim volume at least 3x3x1 -checked in SetGeometry		*
  *									*
  * Parameters          			 				*
- *   Cell *pc:      		defines patch to search        		*
- *   double d;			max dist to target cell           	*
- *   int typeID:		index of desired cell type       	*
+ *   const SimPoint &pos:	location in microns                     *
+ *   int patches[27]:		filled in with indices into m_patches   *
  *									*
- * Returns - boolean; was appropriate cell found?			*
+ * Returns - number of patches             				*
  ************************************************************************/
-bool Cells::checkNeighbors(Cell *pc, double d, int typeID)
+template<int DIMS>
+int Cells::neighborPatches(const SimPoint &pos, int patches[27])
 {
-  if (d > m_gridsize)
-    cout << "Cells::checkNeighbors warning - search radius > gridsize" 
-	    << endl;
-
-  vector<Cell*> clist;
-  getNeighbors(pc, clist);
-
-  unsigned int i = 0; 			// index to cell in list    
-  bool found = false;
-  while ( !found && i<clist.size() )
+  // identify patch pos is in
+  int xindex = getIndex(pos.getX());
+  int yindex = getIndex(pos.getY());
+  int ii, jj, kk;			// indices of neighboring patches
+  int n = 0;
+
+  // go through all the neighboring patches, allowing for wraparound
+  for (int i=xindex-1; i<xindex+2; i++)
   {
-    Cell *pt = clist[i];
-    if ( pt->isAlive() && (pt != pc) && (pt->getTypeIndex() == typeID) )
+    ii = i;
+    if (ii<0) ii=m_xsize-1;
+    else if (ii>=m_xsize) ii=0; 
+    for (int j=yindex-1; j<yindex+2; j++)
     {
-      // test distance 
-      SimPoint dv = getDistVector(clist[i], pc);
-      double mag = dv.dist(SimPoint(0,0,0));
-      if (mag <= d)
-        found = true;
+      jj = j;
+      if (jj<0) jj=m_ysize-1;
+      else if (jj>=m_ysize) jj=0; 
+      int column = (ii*m_ysize + jj)*m_zsize;
+
+      // now check z-dimension - most likely to be single or double layer
+      if (DIMS == 2)
+        patches[n++] = column;
+      else if (m_zsize <= 3)
+        // just check the number of layers that exist
+        for (int k=0; k<m_zsize; k++)
+          patches[n++] = column + k;
+      else
+      {
+        // just check neighboring layers
+        int zindex = getIndex(pos.getZ());
+        for (int k=zindex-1; k<zindex+2; k++)
+        {
+          kk = k;
+          if (kk<0) kk=m_zsize-1;
+          else if (kk>=m_zsize) kk=0; 
+          patches[n++] = column + kk;
+        }
+      }
     }
-    i++;
   }
 
-  return found;
+  return n;
+}
+
+/************************************************************************ 
+ * neighborLists<DIMS>                         				*
+ *   Identifies the lists of cells within the grid cells that surround  *
+ *   the location of the cell passed in (see neighborPatches), or the   *
+ *   whole cell list if there are no more than 3 grid cells in each     *
+ *   direction (DIMS 0).                                                *
+ *									*
+ * Parameters          			 				*
+ *   Cell *pc;                                               		*
+ *   const vector<Cell*> *lists[27]:	filled in with lists to search  *
+ *									*
+ * Returns - number of lists               				*
+ ************************************************************************/
+template<int DIMS>
+int Cells::neighborLists(Cell *pc, const vector<Cell*> *lists[27])
+{
+  // if there are fewer than 3 grid cells in each direction, all cells
+  // are neighbors
+  if (DIMS == 0)
+  {
+    lists[0] = &cell_list;
+    return 1;
+  }
+
+  int patches[27];
+  int n = neighborPatches<DIMS>(pc->getPosition(), patches);
+  for (int l=0; l<n; l++)
+    lists[l] = &m_patches[patches[l]];
+  return n;
 }
 
 /************************************************************************ 
@@ -795,11 +896,8 @@ bool Cells::checkNeighbors(Cell *pc, double d, int typeID)
  *   Assembles a list of cells within the 27 grid cells that surround   *
  *   the location of the cell passed in.  Calling routine must create   *
  *   and empty the vector before calling.				*
- *   This routines assumes periodic boundary conditions.		*
  *   It also assumes that there are currently no 'dead' cells in lists  *
  *   (called by moveCells, which is preceded by removeDead).            *
- *   									*
- *   Assumes sim volume at least 3x3x1 -checked in SetGeometry		*
  *									*
  * Parameters          			 				*
  *   Cell *pc;                                               		*
@@ -809,53 +907,10 @@ bool Cells::checkNeighbors(Cell *pc, double d, int typeID)
  ************************************************************************/
 void Cells::getNeighbors(Cell *pc, vector<Cell *>& clist)
 {
-  // if there are fewer than 3 grid cells in each direction, all cells
-  // are neighbors
-  if ( (m_xsize <= 3) && (m_ysize <= 3) && (m_zsize <= 3) )
-    clist.insert(clist.end(), cell_list.begin(), cell_list.end());
-  
-  else
-  {
-    // identify patch pc is in
-    SimPoint pos = pc->getPosition();
-    int xindex = getIndex(pos.getX());
-    int yindex = getIndex(pos.getY());
-    int zindex = getIndex(pos.getZ());
-    int ii, jj, kk;			// indices of neighboring patches
-  
-    // go through all the neighboring patches, allowing for wraparound
-    for (int i=xindex-1; i<xindex+2; i++)
-    {
-      ii = i;
-      if (ii<0) ii=m_xsize-1;
-      else if (ii>=m_xsize) ii=0; 
-      for (int j=yindex-1; j<yindex+2; j++)
-      {
-        jj = j;
-        if (jj<0) jj=m_ysize-1;
-        else if (jj>=m_ysize) jj=0; 
-
-        // now check z-dimension - most likely to be single or double layer
-        if (m_zsize <= 3)
-          // just check the number of layers that exist
-          for (int k=0; k<m_zsize; k++)
-          {
-            vector<Cell*>& rcl = m_patches.at(ii, jj, k);
-            clist.insert(clist.end(), rcl.begin(), rcl.end());
-          }	// end for k
-        else
-          // just check neighboring layers
-          for (int k=zindex-1; k<zindex+2; k++)
-          {
-	    kk = k;
-            if (kk<0) kk=m_zsize-1;
-            else if (kk>=m_zsize) kk=0; 
-            vector<Cell*>& rcl = m_patches.at(ii, jj, kk);
-	    clist.insert(clist.end(), rcl.begin(), rcl.end());
-          }	// end for kk
-      }	// end for jj
-    }	// end for ii
-  }	// end if we actually have enough patches to check
+  const vector<Cell*> *lists[27];
+  int nlists = getNeighborLists(pc, lists);
+  for (int l=0; l<nlists; l++)
+    clist.insert(clist.end(), lists[l]->begin(), lists[l]->end());
 
   // now remove the original cell passed in
   vector<Cell*>::iterator p = find(clist.begin(), clist.end(), pc);
@@ -940,6 +995,13 @@ void Cells::bounceBC(SimPoint& pos, SimPoint& vel)
  ************************************************************************/
 void Cells::wrapBC(SimPoint& pos)
 {
+  // lattice conversion wraps by itself
+  if (m_useLattice)
+  {
+    pos = m_lattice.toSimPoint(m_lattice.toLattice(pos));
+    return;
+  }
+
   // unlikely - but cells may wrap more than once!
   while (pos.getX() < 0)
     pos.setX(m_xrange+pos.getX());
@@ -955,6 +1017,57 @@ void Cells::wrapBC(SimPoint& pos)
     pos.setZ(pos.getZ() - m_zrange);
 }
 
+/************************************************************************ 
+ * snapToLattice                               				*
+ *   Moves cell to the lattice point at or just below its position      *
+ *   (wrapped into the sim space if necessary) and records the lattice  *
+ *   coordinates.  Does not update patch lists.                         *
+ *									*
+ * Parameters          			 				*
+ *   Cell *pc:			cell to move                            *
+ *									*
+ * Returns - nothing               					*
+ ************************************************************************/
+void Cells::snapToLattice(Cell *pc)
+{
+  LatticePoint c = m_lattice.toLattice(pc->getPosition());
+  pc->setLatticePosition(c);
+  pc->setPosition(m_lattice.toSimPoint(c));
+}
+
+/************************************************************************ 
+ * setLatticePositions                         				*
+ *   Turns lattice positions on or off.  Turning them on snaps all      *
+ *   existing cells (which may move them into a neighbouring patch, so  *
+ *   patch lists are rebuilt).                                          *
+ *									*
+ * Parameters          			 				*
+ *   bool flag:			true to use lattice positions           *
+ *									*
+ * Returns - nothing               					*
+ ************************************************************************/
+void Cells::setLatticePositions(bool flag)
+{
+  m_useLattice = flag;
+  if (!m_useLattice)
+    return;
+
+  for (unsigned int i=0; i<cell_list.size(); i++)
+    snapToLattice(cell_list[i]);
+
+  if (m_gridsize)
+  {
+    for (int i=0; i<m_patches.size(); i++)
+      m_patches[i].clear();
+    for (unsigned int i=0; i<cell_list.size(); i++)
+    {
+      SimPoint pos = cell_list[i]->getPosition();
+      m_patches.at(getIndex(pos.getX()), getIndex(pos.getY()), 
+		   getIndex(pos.getZ())).push_back(cell_list[i]);
+    }
+  }
+}
+
 /************************************************************************ 
  * getDistVector()                            				*
  *   Calculates distance - as a vector - between centers of two cells.  *
@@ -970,30 +1083,61 @@ SimPoint Cells::getDistVector(Cell *from, Cell *to)
   if (from == to)
     return SimPoint(0,0,0);
 
+  // minimum image comes free with lattice positions
+  if (m_useLattice)
+    return m_lattice.diff(from->getLatticePosition(), 
+			  to->getLatticePosition());
+
   double xdist, ydist, zdist;
   SimPoint frompos = from->getPosition();
   SimPoint topos = to->getPosition();
 
-  xdist = topos.getX() - frompos.getX();
-  if ( fabs(fabs(xdist) - m_xrange) < fabs(xdist) )
-    if (xdist<0) xdist += m_xrange;
-    else xdist -=m_xrange;
-  ydist = topos.getY() - frompos.getY();
-  if ( fabs(fabs(ydist) - m_yrange) < fabs(ydist) )
-    if (ydist<0) ydist += m_yrange;
-    else ydist -= m_yrange;
-  zdist = topos.getZ() - frompos.getZ();
-  if ( fabs(fabs(zdist) - m_zrange) < fabs(zdist) )
-    if (zdist<0) zdist += m_zrange;
-    else zdist -= m_zrange;
+  xdist = wrapDist(topos.getX() - frompos.getX(), m_xrange);
+  ydist = wrapDist(topos.getY() - frompos.getY(), m_yrange);
+  zdist = wrapDist(topos.getZ() - frompos.getZ(), m_zrange);
 
   return SimPoint(xdist, ydist, zdist);
 }
 
 /************************************************************************ 
- * sumNeighContr()                            				*
+ * addRepulsion                               				*
+ *   Adds the velocity contribution from one neighbor, if it overlaps   *
+ *   the cell - see neighborForces                                      *
+ *									*
+ * Parameters          			 				*
+ *   SimPoint &Vnet:		velocity to add to                      *
+ *   const SimPoint &d:		distance vector from neighbor to cell   *
+ *   double touch:		sum of the two radii                    *
+ *									*
+ * Returns - nothing               					*
+ ************************************************************************/
+static inline void addRepulsion(SimPoint &Vnet, const SimPoint &d, 
+				double touch)
+{
+  double mag = d.dist(SimPoint(0,0,0));
+  if (mag!=0)	// shouldn't be 0, but could happen
+  {
+    // normalize direction vector; get ratio of distance to cell sizes
+    SimPoint dir = d * (1.0/mag);
+    double r = mag / touch;
+
+    // if cells are overlapping, add repulsive contribution - form was chosen 
+    // heuristically to cancel the velocity of a cell moving directly at the 
+    // neighbor at 2 microns/min (.03/sec) just when the cells touch, and to 
+    // push it away more strongly as they overlap more
+    if (r<1)
+      Vnet += (dir * 0.03 *(2-r));
+  }
+}
+
+/************************************************************************ 
+ * neighborForces<DIMS>                        				*
  *   Sums the forces of each neighbor on the cell passed in; returns    *
- *   the total velocity contribution.					*
+ *   the total velocity contribution.  Neighbors in surrounding patches *
+ *   (see neighborPatches) come from the packed copy (see packCells).   *
+ *   Most are too far away to touch, which the separation in x or y     *
+ *   alone shows, so those are skipped before working out the full      *
+ *   distance.								*
  *									*
  * Parameters          			 				*
  *   Cell *pc;			affected cell				*
@@ -1001,33 +1145,53 @@ SimPoint Cells::getDistVector(Cell *from, Cell *to)
  *									*
  * Returns - net velocity contribution		*
  ************************************************************************/
-SimPoint Cells::sumNeighContr(Cell *pc, double radius)
+template<int DIMS>
+SimPoint Cells::neighborForces(Cell *pc, double radius)
 {
   SimPoint Vnet;
 
-  // get all potential neighbors
-  vector<Cell *> clist;
-  getNeighbors(pc, clist);
+  // space too small to divide - every other cell is a neighbor
+  if (DIMS == 0)
+  {
+    for (unsigned int j=0; j<cell_list.size(); j++)
+      if (cell_list[j] != pc)
+      {
+        CellType *pct2 = cell_type_list[cell_list[j]->getTypeIndex()];
+        addRepulsion(Vnet, getDistVector(cell_list[j], pc), 
+		     radius + pct2->getRadius());
+      }
+    return Vnet;
+  }
 
   // calculate force on pc from each neighbor
-  for (unsigned int j=0; j<clist.size(); j++)
+  SimPoint pos = pc->getPosition();
+  int patches[27];
+  int npatches = neighborPatches<DIMS>(pos, patches);
+  for (int l=0; l<npatches; l++)
   {
-    // start with distance between cell centers d
-    SimPoint d = getDistVector(clist[j], pc);
-    double mag = d.dist(SimPoint(0,0,0));
-    if (mag!=0)	// shouldn't be 0, but could happen
+    int end = m_packStart[patches[l]+1];
+    for (int m=m_packStart[patches[l]]; m<end; m++)
     {
-      // normalize direction vector; get ratio of distance to cell sizes
-      SimPoint dir = d * (1.0/mag);
-      CellType *pct2 = cell_type_list[clist[j]->getTypeIndex()];
-      double r = mag / (radius + pct2->getRadius());
-
-      // if cells are overlapping, add repulsive contribution - form was chosen 
-      // heuristically to cancel the velocity of a cell moving directly at the 
-      // neighbor at 2 microns/min (.03/sec) just when the cells touch, and to 
-      // push it away more strongly as they overlap more
-      if (r<1)
-        Vnet += (dir * 0.03 *(2-r));
+      const PackedCell &nb = m_packed[m];
+      if (nb.pc == pc)
+        continue;
+      double touch = radius + nb.radius;
+      if (m_useLattice)
+      {
+        addRepulsion(Vnet, getDistVector(nb.pc, pc), touch);
+        continue;
+      }
+
+      // distance is at least the x or y separation (FORCE_SLACK allows
+      // for rounding)
+      double xdist = wrapDist(pos.getX() - nb.x, m_xrange);
+      if (fabs(xdist) > touch*FORCE_SLACK)
+        continue;
+      double ydist = wrapDist(pos.getY() - nb.y, m_yrange);
+      if (fabs(ydist) > touch*FORCE_SLACK)
+        continue;
+      double zdist = wrapDist(pos.getZ() - nb.z, m_zrange);
+      addRepulsion(Vnet, SimPoint(xdist, ydist, zdist), touch);
     }
   }	// end for each neighboring grid cell
 
@@ -1035,16 +1199,68 @@ SimPoint Cells::sumNeighContr(Cell *pc, double radius)
 }
 
 /************************************************************************ 
- * moveCells(deltaT)                          				*
+ * packCells                                  				*
+ *   Copies positions and radii of the cells in each patch, in patch    *
+ *   order, to m_packed - see neighborForces.  Cells don't move until   *
+ *   all velocities are set, so one copy does for the whole step.       *
+ *									*
+ * Parameters - none   			 				*
+ *									*
+ * Returns - nothing               					*
+ ************************************************************************/
+void Cells::packCells()
+{
+  m_packed.resize(cell_list.size());
+  m_packStart.resize(m_patches.size()+1);
+
+  int m = 0;
+  for (int n=0; n<m_patches.size(); n++)
+  {
+    m_packStart[n] = m;
+    const vector<Cell*> &rcl = m_patches[n];
+    for (unsigned int j=0; j<rcl.size(); j++, m++)
+    {
+      const SimPoint &pos = rcl[j]->getPosition();
+      PackedCell &pk = m_packed[m];
+      pk.x = pos.getX(); pk.y = pos.getY(); pk.z = pos.getZ();
+      pk.radius = cell_type_list[rcl[j]->getTypeIndex()]->getRadius();
+      pk.pc = rcl[j];
+    }
+  }
+  m_packStart[m_patches.size()] = m;
+  assert(m == (int)cell_list.size());
+}
+
+/************************************************************************ 
+ * class Cells::MoveTask                        			*
+ *   Scheduler task for the first phase of moveCells.  Each cell's      *
+ *   velocity depends only on current positions, so chunks of the cell *
+ *   list can be handled by different threads.                          *
+ ************************************************************************/
+class Cells::MoveTask : public Task {
+  public:
+    explicit MoveTask(Cells *pcs) : m_pcs(pcs) {};
+    void run(int begin, int end, int chunk, int thread)
+	{ m_pcs->setVelocities(begin, end); };
+
+  private:
+    Cells *m_pcs;
+};
+
+/************************************************************************ 
+ * setVelocities()                          				*
+ *   Calculates velocity for each mobile cell in part of cell_list;     *
+ *   positions are not changed, so this may run concurrently on         *
+ *   different parts of the list.                                       *
  *									*
  * Parameters          			 				*
- *   double deltaT: 		size of timestep in seconds             *
+ *   int begin, end: 		range of cell_list indices to handle    *
  *									*
  * Returns - nothing               					*
  ************************************************************************/
-void Cells::moveCells(double deltaT)
+void Cells::setVelocities(int begin, int end)
 {
-  for (unsigned int i=0; i<cell_list.size(); i++)
+  for (int i=begin; i<end; i++)
   {
     Cell *pc = cell_list[i];                               
     CellType *pct = cell_type_list[pc->getTypeIndex()];
@@ -1060,7 +1276,24 @@ void Cells::moveCells(double deltaT)
 
       pc->setVelocity(Vnet);	
     }	// end if cell is moving
-  }	// end of outer cell loop through all cells
+  }	// end of loop through cells
+}
+
+/************************************************************************ 
+ * moveCells(deltaT)                          				*
+ *   Velocities are calculated by the Scheduler's threads; actual moves *
+ *   (which change patch lists) are done afterwards, serially.          *
+ *									*
+ * Parameters          			 				*
+ *   double deltaT: 		size of timestep in seconds             *
+ *									*
+ * Returns - nothing               					*
+ ************************************************************************/
+void Cells::moveCells(double deltaT)
+{
+  packCells();
+  MoveTask task(this);
+  Scheduler::getInstance()->run(task, cell_list.size(), MOVE_GRAIN);
 
   int oldxi, newxi, oldyi, newyi, oldzi, newzi;
   SimPoint oldpos, pos;
@@ -1074,7 +1307,18 @@ void Cells::moveCells(double deltaT)
     if (pct->getSpeed()) 	// is this a mobile cell?            
     {
       oldpos = pc->getPosition();
-      pos = oldpos + pc->getVelocity()*deltaT;
+      if (m_useLattice)
+      {
+	LatticePoint c = m_lattice.move(pc->getLatticePosition(), 
+					pc->getVelocity()*deltaT);
+	pc->setLatticePosition(c);
+	pos = m_lattice.toSimPoint(c);
+      }
+      else
+      {
+        pos = oldpos + pc->getVelocity()*deltaT;
+        wrapBC(pos);		// periodic - wrap around
+      }
 
       // open boundaries; cells just disappear
 //    if (testOpenBC(pos)) removeCell(c1); 
@@ -1086,8 +1330,6 @@ void Cells::moveCells(double deltaT)
 //    pc->setPosition(pos);
 //    pc->setVelocity(vel);
 
-      // periodic - wrap around
-      wrapBC(pos);
       pc->setPosition(pos);	
 
       // update grid pointers to cell if new position not in same grid
@@ -1111,6 +1353,47 @@ void Cells::moveCells(double deltaT)
 }
 
 
+/************************************************************************ 
+ * class Cells::UpdateTask                        			*
+ *   Scheduler task for a synchronous update step.  Cells only read     *
+ *   shared state; their effects on it go to the chunk's StepBuffer.    *
+ *   Each chunk draws random numbers from its own stream, seeded from   *
+ *   the step seed and chunk index, so results are the same however     *
+ *   chunks are divided among threads.                                  *
+ ************************************************************************/
+class Cells::UpdateTask : public Task {
+  public:
+    UpdateTask(Cells *pcs, double deltaT, long seed) : 
+	m_pcs(pcs), m_deltaT(deltaT), m_seed(seed) {};
+    void run(int begin, int end, int chunk, int thread);
+
+  private:
+    Cells *m_pcs;
+    double m_deltaT;
+    long m_seed;
+};
+
+void Cells::UpdateTask::run(int begin, int end, int chunk, int thread)
+{
+  StepBuffer &rb = m_pcs->m_buffers[chunk];
+  StepBuffer::setCurrent(&rb);
+
+  // switch to chunk's own stream; keeps main thread's sequence intact
+  RandK::State saved;
+  RandK::getState(saved);
+  RandK::seedStream(m_seed, chunk);
+
+  for (int i=begin; i<end; i++)
+  {
+    Cell *pc = m_pcs->cell_list[i];
+    rb.rank = i;
+    m_pcs->cell_type_list[pc->getTypeIndex()]->update(pc, m_deltaT);
+  }
+
+  RandK::setState(saved);
+  StepBuffer::setCurrent(0);
+}
+
 /************************************************************************ 
  * update()                                 				*
  *   Handles internal processing and actions by each cell during one    *
@@ -1118,6 +1401,9 @@ void Cells::moveCells(double deltaT)
  *   governed by molecular binding, is handled at a higher level, and   *
  *   is assumed to have already been done by the time this function is  *
  *   called.								*
+ *   In synchronous mode the cell list is not shuffled; cells are       *
+ *   updated in chunks by the Scheduler, and effects one cell has on    *
+ *   others are held back and applied by reconcile().                   *
  *									*
  * Parameters          			 				*
  *   double deltaT: 		size of timestep in seconds             *
@@ -1126,21 +1412,36 @@ void Cells::moveCells(double deltaT)
  ************************************************************************/
 void Cells::update(double deltaT)
 {
-  // randomize cell list order to minimize order effects                  
-  if (cell_list.size() > 1)
-    shuffle(cell_list);
-
-  // do sensing and processing for all cells, one at a time
+  // do sensing and processing for all cells
   // Sensing updates internal variables in response to
   // current conditions.  Processing checks for cell death, division, 
   // secretion, etc.; internal velocity parameters may be affected, but cell 
   // doesn't move until later.
-  for (unsigned int i=0; i<cell_list.size(); i++)	
+  if (m_sync)
   {
-    Cell *pc = cell_list[i];                                
+    int n = cell_list.size();
+    m_buffers.resize(Scheduler::getNumChunks(n, UPDATE_GRAIN));
 
-    CellType *pct = cell_type_list[pc->getTypeIndex()];
-    pct->update(pc, deltaT);
+    // one draw from the main sequence seeds all chunk streams this step
+    UpdateTask task(this, deltaT, long(RandK::randk()*1e9));
+    Scheduler::getInstance()->run(task, n, UPDATE_GRAIN);
+
+    reconcile();
+  }
+  else
+  {
+    // randomize cell list order to minimize order effects
+    if (cell_list.size() > 1)
+      shuffle(cell_list);
+
+    // one at a time; each cell sees changes made by the ones before it
+    for (unsigned int i=0; i<cell_list.size(); i++)	
+    {
+      Cell *pc = cell_list[i];                                
+      CellType *pct = cell_type_list[pc->getTypeIndex()];
+      pct->update(pc, deltaT);
+      pc->applyNextTypeIndex();
+    }
   }
 
   // remove dead cells 
@@ -1155,6 +1456,84 @@ void Cells::update(double deltaT)
   mergeNew();
 }
 
+/************************************************************************ 
+ * engulf()                                 				*
+ *   One cell takes (phagocytoses) another.  Asynchronous mode:  target *
+ *   dies immediately.  Synchronous mode:  a claim is recorded; the     *
+ *   claimant earliest in the cell list wins it in reconcile().         *
+ *									*
+ * Parameters          			 				*
+ *   Cell *eater:		cell doing the taking                   *
+ *   Cell *target:		cell taken                              *
+ *   int attr:			eater attribute counting targets taken  *
+ *									*
+ * Returns - nothing               					*
+ ************************************************************************/
+void Cells::engulf(Cell *eater, Cell *target, int attr)
+{
+  if (m_sync)
+  {
+    StepBuffer *pb = StepBuffer::getCurrent();
+    assert(pb);
+    target->claim(pb->rank);
+    pb->claims.push_back(StepBuffer::Claim(eater, target, attr, pb->rank));
+  }
+  else
+  {
+    target->die();
+    eater->setValue(attr, eater->getValue(attr)+1);
+  }
+}
+
+/************************************************************************ 
+ * reconcile()                                 				*
+ *   End of a synchronous update step:  goes through the chunk buffers  *
+ *   in order, adding births to new_cell_list, resolving claims (each   *
+ *   target goes to its lowest-ranked claimant, once) and passing       *
+ *   molecule changes on; then applies type changes, so the next step   *
+ *   starts from a consistent state.                                    *
+ *									*
+ * Parameters - none   			 				*
+ *									*
+ * Returns - nothing               					*
+ ************************************************************************/
+void Cells::reconcile()
+{
+  for (unsigned int b=0; b<m_buffers.size(); b++)
+  {
+    StepBuffer &rb = m_buffers[b];
+
+    new_cell_list.insert(new_cell_list.end(), 
+			 rb.births.begin(), rb.births.end());
+
+    for (unsigned int i=0; i<rb.claims.size(); i++)
+    {
+      StepBuffer::Claim &rc = rb.claims[i];
+      if (rc.target->getClaim() == rc.rank)
+      {
+	rc.target->die();
+	rc.target->clearClaim();	// so winner can't be credited twice
+	rc.eater->setValue(rc.attr, rc.eater->getValue(rc.attr)+1);
+      }
+    }
+
+    // no current buffer here, so these are recorded by the molecule
+    for (unsigned int i=0; i<rb.deposits.size(); i++)
+    {
+      StepBuffer::Deposit &rd = rb.deposits[i];
+      rd.field->changeConc(rd.amount, rd.pos);
+    }
+
+    rb.clear();
+  }
+
+  for (unsigned int i=0; i<cell_list.size(); i++)
+  {
+    cell_list[i]->clearClaim();
+    cell_list[i]->applyNextTypeIndex();
+  }
+}
+
 /************************************************************************ 
  * writeDefinition()                       				*
  *   writes parameters for each cell type to already-open file          *
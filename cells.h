@@ -35,6 +35,8 @@
 #include "cell.h"		// for access to getTypeIndex
 #include "array3D.h"
 #include "simPoint.h"
+#include "stepBuffer.h"
+#include "lattice.h"
 
 class CellType;
 
@@ -84,8 +86,26 @@ class Cells {
     // final cleanup before running simulations
     void initialize() { mergeNew(); };
 
+    // synchronous update:  every cell sees the state at the start of the
+    // step; deaths caused by other cells and type changes are applied 
+    // after all cells have been updated (default is asynchronous - each
+    // cell sees the effects of cells updated earlier in the same step).
+    // Synchronous updates are spread over the Scheduler's threads.
+    void setSyncUpdate(bool flag) {m_sync = flag;};
+
+    // lattice positions:  cell positions are snapped to a fixed-point 
+    // lattice (2^32 steps across each dimension), so wrapping and 
+    // distances between cells are done in integer arithmetic and are 
+    // exactly reproducible.  Existing cells are snapped when turned on.
+    void setLatticePositions(bool flag);
+
     // running simulation
     void update(double deltaT);
+
+    // cell 'eater' takes 'target' - kills target and increments eater's
+    // attribute attr; in synchronous mode, only the first claimant in 
+    // cell list order gets the target, and only at the end of the step
+    void engulf(Cell *eater, Cell *target, int attr);
     //--------------------------- ACCESSORS --------------------------------
     int getNumCellTypes() const {return cell_type_list.size();};
     int getNumCells() const {return cell_list.size();};
@@ -94,11 +114,22 @@ class Cells {
     const CellType *getCellType(int i) const {return cell_type_list[i];};
     int getCellTypeIndex(const string& type_name) const;
 
+    // find one cell of type typeID (or any type, if ANY_TYPE) within 
+    // distance d of pc, in a single pass over the surrounding patches:
+    // the first one found, one chosen uniformly at random, or the closest
+    enum Selection { SELECT_ANY, SELECT_RANDOM, SELECT_CLOSEST };
+    enum { ANY_TYPE = -1 };
+    Cell * findCell(Cell *pc, double d, int typeID, Selection how);
+
     // find and return one cell within distance d of pc    
-    Cell * getTarget(Cell *pc, double d);
+    Cell * getTarget(Cell *pc, double d)
+	{ return findCell(pc, d, ANY_TYPE, SELECT_RANDOM); };
 
     // determine whether there is a cell of tupe typeID within distance d of pc
-    bool checkNeighbors(Cell *pc, double d, int typeID);
+    bool checkNeighbors(Cell *pc, double d, int typeID)
+	{ return findCell(pc, d, typeID, SELECT_ANY) != 0; };
+    bool isSyncUpdate() const {return m_sync;};
+    bool isLatticePositions() const {return m_useLattice;};
 
     // find all cells in patches surrounding pc, return in clist
     void getNeighbors(Cell *pc, vector<Cell*>& clist);
@@ -122,6 +153,15 @@ class Cells {
 
     Array3D< vector<Cell*> > m_patches;		// list of cells by grid
 
+    bool m_sync;				// synchronous update mode?
+
+    bool m_useLattice;				// lattice positions?
+    Lattice m_lattice;
+
+    // births, claims and molecule changes from each chunk of cell_list
+    // in a synchronous update; applied in order by reconcile
+    vector<StepBuffer> m_buffers;
+
     // private member functions used to clean up cell lists
     void mergeNew();	// to be used when safe after new cells added
 			// currently called by tissue's update 
@@ -129,14 +169,51 @@ class Cells {
 			// removes specified cell from patch given by indices
     void removeDead();  // removes dead cells from cell_list            
 
+    // gets lists to search for pc's neighbors - patches surrounding pc, or
+    // the whole cell list if the space is too small to be worth dividing;
+    // returns the number of lists.  Specialized at compile time for the
+    // geometry (see setGeometry):  DIMS 3 searches 27 patches, DIMS 2 the 
+    // 9 of a single layer, DIMS 0 takes the whole list
+    template<int DIMS> int neighborPatches(const SimPoint &pos, 
+					   int patches[27]);
+    template<int DIMS> 
+    int neighborLists(Cell *pc, const vector<Cell*> *lists[27]);
+    int (Cells::*m_neighborLists)(Cell *pc, const vector<Cell*> *lists[27]);
+    int getNeighborLists(Cell *pc, const vector<Cell*> *lists[27])
+	{ return (this->*m_neighborLists)(pc, lists); };
+    void reconcile();	// applies effects held back in synchronous mode
+    bool isCandidate(Cell *pc) const	// may pc be sensed by other cells?
+	{ return m_sync || pc->isAlive(); };
+
     // move cells according to velocities calculated during update -
     int testOpenBC(SimPoint &pos);
     void bounceBC(SimPoint &pos, SimPoint& vel);
     void wrapBC(SimPoint &pos);
+    void snapToLattice(Cell *pc);	// set pc's position to lattice point
     SimPoint getDistVector(Cell *from, Cell *to);
-    SimPoint sumNeighContr(Cell *pc, double radius);
+    static double wrapDist(double d, double range)	// minimum image
+	{ return (fabs(fabs(d) - range) < fabs(d)) ? 
+		 ((d<0) ? d+range : d-range) : d; };
+    SimPoint sumNeighContr(Cell *pc, double radius)
+	{ return (this->*m_neighborForces)(pc, radius); };
+    template<int DIMS> SimPoint neighborForces(Cell *pc, double radius);
+    SimPoint (Cells::*m_neighborForces)(Cell *pc, double radius);
+
+    // positions and radii of the cells in each patch, packed together in
+    // patch order (patch n's are m_packed[m_packStart[n]] up to 
+    // m_packed[m_packStart[n+1]]), so neighborForces doesn't have to 
+    // visit every neighbor's Cell; rebuilt by packCells before moving
+    struct PackedCell { double x, y, z, radius; Cell *pc; };
+    vector<PackedCell> m_packed;
+    vector<int> m_packStart;
+    void packCells();
+    void setVelocities(int begin, int end);	// for cell_list[begin,end)
     void moveCells(double deltaT);
 
+    // Scheduler tasks that run on chunks of cell_list
+    class MoveTask;		// setVelocities
+    class UpdateTask;		// CellType::update, synchronous mode only
+
     // figure out largest cell size for determining grid size
     int getLargestRadius();
 
@@ -0,0 +1,327 @@
+
+/************************************************************************
+ * 									*
+ * Copyright (C) 2004  Christina Warrender				*
+ * 									*
+ * This file is part of CyCells.					*
+ *									*
+ * CyCells is free software; you can redistribute it and/or modify it 	*
+ * under the terms of the GNU General Public License as published by	*
+ * the Free Software Foundation; either version 2 of the License, or	*
+ * (at your option) any later version.					*
+ *									*
+ * CyCells is distributed in the hope that it will be useful,		*
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of	*
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the	*
+ * GNU General Public License for more details.				*
+ *									*
+ * You should have received a copy of the GNU General Public License	*
+ * along with CyCells; if not, write to the Free Software Foundation, 	*
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA	*
+ *									*
+ ************************************************************************/
+/************************************************************************
+ * file fft.cc                                                          *
+ * Routines for FFT class                                               *
+ ************************************************************************/
+
+#include "fft.h"
+#include <cmath>
+#include <cassert>
+
+using namespace std;
+
+// complex product without the inf/nan checks of operator* (which, 
+// unless compiled with -ffast-math, is a library call)
+static inline FFT::Complex mul(const FFT::Complex &a, const FFT::Complex &b)
+{
+  return FFT::Complex(a.real()*b.real() - a.imag()*b.imag(),
+  		      a.real()*b.imag() + a.imag()*b.real());
+}
+
+/************************************************************************ 
+ * ~FFT()                                                               *
+ *   Destructor - the plan and scratch vectors free themselves.  Kept   *
+ *   out of the header, where it was too big to inline                  *
+ *                                                                      *
+ * Parameters                                                           *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+FFT::~FFT()
+{
+}
+
+/************************************************************************ 
+ * setSize()                                                            *
+ *   Sets the transform length and precalculates factors and twiddles   *
+ *   (and for lengths with a large prime factor, Bluestein's chirp and  *
+ *   the transform of the convolution kernel).                          *
+ *   Does nothing if the length hasn't changed.                         *
+ *                                                                      *
+ * Parameters                                                           *
+ *   int n:			transform length                        *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void FFT::setSize(int n)
+{
+  assert(n>0);
+  if (n == m_n)
+    return;
+
+  m_n = n;
+  m_line.resize(n);
+
+  makePlan(m_plan, n);
+  m_bluestein = false;
+  for (unsigned int i=0; i<m_plan.factors.size(); i++)
+    if (m_plan.factors[i] > FFT_MAX_RADIX)
+      m_bluestein = true;
+
+  if (!m_bluestein)
+  {
+    m_chirp.clear(); m_kernel.clear();
+    m_out.resize(n);
+    return;
+  }
+
+  // Bluestein - transform length is a power of 2 at least 2n-1
+  int m = 1;
+  while (m < 2*n-1)
+    m *= 2;
+  makePlan(m_plan, m);
+  m_in.resize(m); m_out.resize(m);
+
+  // exp(-pi i k^2/n) - k^2 taken mod 2n first, so the angle stays small
+  m_chirp.resize(n);
+  for (int k=0; k<n; k++)
+  {
+    long long k2 = (long long)k*k % (2*n);
+    m_chirp[k] = polar(1.0, -M_PI*k2/n);
+  }
+
+  m_in.assign(m, Complex(0, 0));
+  m_in[0] = conj(m_chirp[0]);
+  for (int k=1; k<n; k++)
+    m_in[k] = m_in[m-k] = conj(m_chirp[k]);
+  m_kernel.resize(m);
+  transform(m_plan, &m_in[0], &m_kernel[0], m, 1, 0);
+}
+
+/************************************************************************ 
+ * forward()                                                            *
+ *   Discrete Fourier transform, in place:                              *
+ *   X[k] = sum over j of x[j] exp(-2 pi i jk/n)                        *
+ *                                                                      *
+ * Parameters                                                           *
+ *   Complex *x:		n values; replaced by transform         *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void FFT::forward(Complex *x)
+{
+  assert(m_n>0);
+  if (m_n == 1)
+    return;
+  if (!m_bluestein)
+  {
+    transform(m_plan, x, &m_out[0], m_n, 1, 0);
+    for (int k=0; k<m_n; k++)
+      x[k] = m_out[k];
+    return;
+  }
+
+  // Bluestein:  jk = (j^2 + k^2 - (k-j)^2)/2, so the transform is a
+  // convolution of x*chirp with conj(chirp), followed by *chirp;
+  // the convolution's inverse transform is done by conjugating
+  const int m = m_plan.n;
+  for (int k=0; k<m_n; k++)
+    m_in[k] = mul(x[k], m_chirp[k]);
+  for (int k=m_n; k<m; k++)
+    m_in[k] = 0;
+  transform(m_plan, &m_in[0], &m_out[0], m, 1, 0);
+  for (int k=0; k<m; k++)
+    m_out[k] = conj(mul(m_out[k], m_kernel[k]));
+  transform(m_plan, &m_out[0], &m_in[0], m, 1, 0);
+  double scale = 1.0/m;
+  for (int k=0; k<m_n; k++)
+    x[k] = mul(conj(m_in[k]), m_chirp[k])*scale;
+}
+
+/************************************************************************ 
+ * inverse()                                                            *
+ *   Inverse discrete Fourier transform, in place, including the 1/n    *
+ *                                                                      *
+ * Parameters                                                           *
+ *   Complex *x:		n values; replaced by inverse transform *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void FFT::inverse(Complex *x)
+{
+  for (int k=0; k<m_n; k++)
+    x[k] = conj(x[k]);
+  forward(x);
+  double scale = 1.0/m_n;
+  for (int k=0; k<m_n; k++)
+    x[k] = conj(x[k])*scale;
+}
+
+/************************************************************************ 
+ * filter()                                                             *
+ *   Multiplies the spectrum of one or two real lines by a real,        *
+ *   symmetric factor.  Line a goes in the real part, line b in the     *
+ *   imaginary part; since the filter keeps real lines real, they come  *
+ *   back out separately.                                               *
+ *                                                                      *
+ * Parameters                                                           *
+ *   double *a, *b:		first values of lines (b may be 0);     *
+ *				replaced by filtered values             *
+ *   int stride:		distance between values in a line       *
+ *   const double *factor:	n factors, one per frequency            *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void FFT::filter(double *a, double *b, int stride, const double *factor)
+{
+  assert(m_n>0);
+  const int n = m_n;
+  Complex *x = &m_line[0];
+
+  for (int i=0; i<n; i++)
+    x[i] = Complex(a[i*stride], b ? b[i*stride] : 0);
+  forward(x);
+  for (int i=0; i<n; i++)
+    x[i] *= factor[i];
+  inverse(x);
+
+  for (int i=0; i<n; i++)
+  {
+    double value = x[i].real();
+    a[i*stride] = (value < 0) ? 0 : value;
+  }
+  if (b)
+    for (int i=0; i<n; i++)
+    {
+      double value = x[i].imag();
+      b[i*stride] = (value < 0) ? 0 : value;
+    }
+}
+
+/************************************************************************ 
+ * makePlan()                                                           *
+ *   Factors n (4s first, then 2s, then odd primes) and fills in the    *
+ *   twiddle factors                                                    *
+ *                                                                      *
+ * Parameters                                                           *
+ *   Plan &plan:		plan to fill in                         *
+ *   int n:			transform length                        *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void FFT::makePlan(Plan &plan, int n)
+{
+  plan.n = n;
+  plan.factors.clear();
+  int rest = n;
+  while (rest % 4 == 0)
+  {
+    plan.factors.push_back(4);
+    rest /= 4;
+  }
+  while (rest % 2 == 0)
+  {
+    plan.factors.push_back(2);
+    rest /= 2;
+  }
+  for (int p=3; p<=rest; p+=2)
+    while (rest % p == 0)
+    {
+      plan.factors.push_back(p);
+      rest /= p;
+    }
+
+  plan.twiddle.resize(n);
+  for (int k=0; k<n; k++)
+    plan.twiddle[k] = polar(1.0, -2*M_PI*k/n);
+}
+
+/************************************************************************ 
+ * transform()                                                          *
+ *   Recursive decimation-in-time transform (out of place, unscaled).   *
+ *   For radix p = factors[level], the p subsequences in[q + p*j] are   *
+ *   transformed into consecutive blocks of out, then combined with     *
+ *   p-point butterflies.  n must be more than 1.                       *
+ *                                                                      *
+ * Parameters                                                           *
+ *   const Plan &plan:		factors and twiddles                    *
+ *   const Complex *in:		first input value                       *
+ *   Complex *out:		n output values                         *
+ *   int n:			length of this (sub)transform           *
+ *   int stride:		distance between input values           *
+ *   int level:			index of radix to use                   *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void FFT::transform(const Plan &plan, const Complex *in, Complex *out,
+		    int n, int stride, int level)
+{
+  const int p = plan.factors[level];
+  const int m = n/p;
+  if (m == 1)			// last radix - subsequences are 1 long
+    for (int q=0; q<p; q++)
+      out[q] = in[q*stride];
+  else
+    for (int q=0; q<p; q++)
+      transform(plan, in+q*stride, out+q*m, m, stride*p, level+1);
+
+  const Complex *tw = &plan.twiddle[0];
+  const int tstep = plan.n/n;		// twiddles are for the full length
+  if (p == 2)
+    for (int k=0; k<m; k++)
+    {
+      Complex t = mul(out[k+m], tw[k*tstep]);
+      out[k+m] = out[k] - t;
+      out[k] += t;
+    }
+  else if (p == 4)
+    for (int k=0; k<m; k++)
+    {
+      Complex a0 = out[k];
+      Complex a1 = mul(out[k+m], tw[k*tstep]);
+      Complex a2 = mul(out[k+2*m], tw[2*k*tstep]);
+      Complex a3 = mul(out[k+3*m], tw[3*k*tstep]);
+      Complex b0 = a0 + a2, b1 = a0 - a2;
+      Complex b2 = a1 + a3, b3 = a1 - a3;
+      b3 = Complex(b3.imag(), -b3.real());	// times -i
+      out[k] = b0 + b2;
+      out[k+m] = b1 + b3;
+      out[k+2*m] = b0 - b2;
+      out[k+3*m] = b1 - b3;
+    }
+  else				// general p-point DFT
+  {
+    assert(p <= FFT_MAX_RADIX);
+    Complex temp[FFT_MAX_RADIX], root[FFT_MAX_RADIX];
+    for (int q=0; q<p; q++)
+      root[q] = tw[q*m*tstep];		// exp(-2 pi i q/p)
+    for (int k=0; k<m; k++)
+    {
+      for (int q=0; q<p; q++)
+        temp[q] = mul(out[k+q*m], tw[q*k*tstep]);
+      for (int s=0; s<p; s++)
+      {
+        Complex sum = temp[0];
+        for (int q=1, qs=s; q<p; q++, qs+=s)
+        {
+          if (qs >= p)
+            qs -= p;
+          sum += mul(temp[q], root[qs]);
+        }
+        out[k+s*m] = sum;
+      }
+    }
+  }
+}
+
@@ -0,0 +1,90 @@
+
+/************************************************************************
+ * 									*
+ * Copyright (C) 2004  Christina Warrender				*
+ * 									*
+ * This file is part of CyCells.					*
+ *									*
+ * CyCells is free software; you can redistribute it and/or modify it 	*
+ * under the terms of the GNU General Public License as published by	*
+ * the Free Software Foundation; either version 2 of the License, or	*
+ * (at your option) any later version.					*
+ *									*
+ * CyCells is distributed in the hope that it will be useful,		*
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of	*
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the	*
+ * GNU General Public License for more details.				*
+ *									*
+ * You should have received a copy of the GNU General Public License	*
+ * along with CyCells; if not, write to the Free Software Foundation, 	*
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA	*
+ *									*
+ ************************************************************************/
+/************************************************************************
+ * file fft.h                                                           *
+ * Declarations for FFT class                                           *
+ * Fast Fourier transform of any length, for spectral diffusion         *
+ ***********************************************************************/
+
+#ifndef FFT_H
+#define FFT_H
+
+#include <complex>
+#include <vector>
+
+using namespace std;
+
+// largest prime factor handled directly; bigger ones use Bluestein
+#define FFT_MAX_RADIX 13
+
+// Mixed-radix Cooley-Tukey transform for lengths whose prime factors 
+// are all small (grid sizes like 8, 10, 50, 100); other lengths use 
+// Bluestein's algorithm (a convolution done with a larger power-of-2 
+// transform), so any grid size works in O(n log n).
+class FFT {
+  public:
+    typedef complex<double> Complex;
+
+    //--------------------------- CREATORS --------------------------------- 
+    FFT() : m_n(0) {};
+    // use default copy constructor
+    ~FFT();
+
+    //------------------------- MANIPULATORS -------------------------------
+    // set transform length; does nothing if unchanged
+    void setSize(int n);
+
+    // in-place transforms of n values; inverse includes the 1/n
+    void forward(Complex *x);
+    void inverse(Complex *x);
+
+    // multiply the spectrum of a real line of n values (stride apart) by 
+    // factor[0..n-1], in place; factor must be real and symmetric 
+    // (factor[i] == factor[n-i]), so the result is real.  Two lines are
+    // done with one complex transform; b may be 0.  Results are clamped
+    // at 0.
+    void filter(double *a, double *b, int stride, const double *factor);
+
+  private:
+    // factors and twiddles for one transform length
+    struct Plan {
+      int n;
+      vector<int> factors;	// radices, in the order used
+      vector<Complex> twiddle;	// exp(-2 pi i k/n), k < n
+    };
+
+    int m_n;			// transform length
+    Plan m_plan;		// for length n, or for Bluestein's length
+    bool m_bluestein;		// n has a large prime factor?
+    vector<Complex> m_chirp;	// Bluestein:  exp(-pi i k^2/n)
+    vector<Complex> m_kernel;	// Bluestein:  transform of conj(chirp)
+    vector<Complex> m_in, m_out;	// scratch for out-of-place transforms
+    vector<Complex> m_line;	// filter:  packed lines
+
+    static void makePlan(Plan &plan, int n);
+    static void transform(const Plan &plan, const Complex *in, Complex *out,
+    			  int n, int stride, int level);
+};
+
+#endif
+
@@ -27,6 +27,7 @@
 
 #include "fileDef.h"							
 #include <iostream>
+#include <cstring>			// for strcmp
 #include "tissue.h"
 #include "molecule.h"
 #include "cellType.h"
@@ -181,6 +182,69 @@ cout << "molecule type name:  " << buff << endl;
       infile >> rate;
       pm->setDecayRate(rate);
     }
+
+    else if (strcmp(buff, "solver") == 0)
+    {
+      infile >> buff;
+      if (strcmp(buff, "explicit") == 0)
+        pm->setSolver(Molecule::EXPLICIT);
+      else if (strcmp(buff, "adi") == 0)
+        pm->setSolver(Molecule::ADI);
+      else if (strcmp(buff, "spectral") == 0)
+        pm->setSolver(Molecule::SPECTRAL);
+      else if (strcmp(buff, "rkc") == 0)
+        pm->setSolver(Molecule::RKC);
+      else if (strcmp(buff, "steady") == 0)
+        pm->setSolver(Molecule::STEADY);
+      else
+        error("FileDef molecule type definition:  unknown solver ", buff);
+    }
+
+    else if (strcmp(buff, "active_threshold") == 0)
+    {
+      infile >> rate;
+      if (rate < 0)
+        error("FileDef molecule type definition:  negative active_threshold");
+      pm->setActiveThreshold(rate);
+    }
+
+    else if (strcmp(buff, "refine") == 0)
+    {
+      int ratio;
+      infile >> ratio;
+      if (ratio < 1)
+        error("FileDef molecule type definition:  refine ratio must be >= 1");
+      pm->setRefinement(ratio);
+    }
+
+    else if (strcmp(buff, "resolution") == 0)
+    {
+      int res;
+      infile >> res;
+      if (res < 0)
+        error("FileDef molecule type definition:  negative resolution");
+      pm->setResolution(res);
+    }
+
+    else if (strcmp(buff, "update_interval") == 0)
+    {
+      int steps;
+      infile >> steps;
+      if (steps < 1)
+        error("FileDef molecule type definition:  update interval < 1");
+      pm->setUpdateInterval(steps);
+    }
+
+    else if (strcmp(buff, "gradient") == 0)
+    {
+      infile >> buff;
+      if (strcmp(buff, "cached") == 0)
+        pm->setCachedGradient(true);
+      else if (strcmp(buff, "exact") == 0)
+        pm->setCachedGradient(false);
+      else
+        error("FileDef molecule type definition:  unknown gradient ", buff);
+    }
  
     else
       error("FileDef molecule type definition:  unknown keyword ", buff); 
@@ -369,8 +433,17 @@ cout << "sense type:  " << buff << endl;
 
   // determine type of action and read parameters accordingly
   Sense *ps;
-  if (strcmp(buff, "phag") == 0)
+  if ( (strcmp(buff, "phag") == 0) || (strcmp(buff, "phag_random") == 0) ||
+       (strcmp(buff, "phag_closest") == 0) )
   {
+    // phag tries a random neighbor, which may not be a target; others 
+    // only consider targets
+    SensePhag::Choice choice = SensePhag::ANY_NEIGHBOR;
+    if (strcmp(buff, "phag_random") == 0)
+      choice = SensePhag::RANDOM_TARGET;
+    else if (strcmp(buff, "phag_closest") == 0)
+      choice = SensePhag::CLOSEST_TARGET;
+
     // expect cell_type_name dist receptor_attribute receptor_threshold
     int tindex = readCellName(pt, infile);
     Cells *cells = pt->getCellsPtr();
@@ -379,7 +452,7 @@ cout << "sense type:  " << buff << endl;
     infile >> buff;
     int Rattr = pct->getAttributeIndex(buff);
     infile >> thr;
-    ps = new SensePhag(index, tindex, dist, Rattr, thr, cells);
+    ps = new SensePhag(index, tindex, dist, Rattr, thr, cells, choice);
     pct->addSense(ps);
   }
   else if (strcmp(buff, "cognate") == 0)
@@ -27,6 +27,7 @@
 
 #include "fileInit.h"						
 #include <iostream>
+#include <cstring>			// for strcmp
 #include "tissue.h"
 #include "random.h"
 #include "util.h"
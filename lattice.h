@@ -0,0 +1,103 @@
+
+/************************************************************************
+ * 									*
+ * Copyright (C) 2004  Christina Warrender				*
+ * 									*
+ * This file is part of CyCells.					*
+ *									*
+ * CyCells is free software; you can redistribute it and/or modify it 	*
+ * under the terms of the GNU General Public License as published by	*
+ * the Free Software Foundation; either version 2 of the License, or	*
+ * (at your option) any later version.					*
+ *									*
+ * CyCells is distributed in the hope that it will be useful,		*
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of	*
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the	*
+ * GNU General Public License for more details.				*
+ *									*
+ * You should have received a copy of the GNU General Public License	*
+ * along with CyCells; if not, write to the Free Software Foundation, 	*
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA	*
+ *									*
+ ************************************************************************/
+/************************************************************************
+ * file lattice.h                                                       *
+ * Declarations for Lattice class and LatticePoint                      *
+ * Fixed-point positions on the periodic simulation space               *
+ ***********************************************************************/
+
+#ifndef LATTICE_H
+#define LATTICE_H
+
+#include <cmath>
+#include <cassert>
+#include "simPoint.h"
+
+// position as unsigned 32-bit fractions of the sim space in each 
+// dimension:  0 is the origin, 2^32 would be the far side.  Wrapping 
+// around the periodic boundaries is just integer overflow, and the 
+// minimum-image difference between two points is signed subtraction.
+struct LatticePoint {
+  unsigned int x, y, z;
+};
+
+class Lattice {
+  public:
+    //--------------------------- CREATORS --------------------------------- 
+    Lattice() : m_xunit(0), m_yunit(0), m_zunit(0) {};
+    // use default copy constructor, destructor
+
+    //------------------------- MANIPULATORS -------------------------------
+    // sim space size in microns
+    void setGeometry(int xrange, int yrange, int zrange)
+    {
+      assert(xrange>0); assert(yrange>0); assert(zrange>0);
+      m_xunit = ldexp(double(xrange), -32);	// exact - range is an int
+      m_yunit = ldexp(double(yrange), -32);
+      m_zunit = ldexp(double(zrange), -32);
+    };
+
+    //--------------------------- ACCESSORS --------------------------------
+    // nearest lattice point at or below p, after wrapping p into the space
+    LatticePoint toLattice(const SimPoint &p) const
+    {
+      LatticePoint c;
+      c.x = toCoord(p.getX(), m_xunit);
+      c.y = toCoord(p.getY(), m_yunit);
+      c.z = toCoord(p.getZ(), m_zunit);
+      return c;
+    };
+
+    // position in microns; exact, and toLattice gives c back again
+    SimPoint toSimPoint(const LatticePoint &c) const
+	{ return SimPoint(c.x*m_xunit, c.y*m_yunit, c.z*m_zunit); };
+
+    // c displaced by delta (microns), wrapping around boundaries
+    LatticePoint move(const LatticePoint &c, const SimPoint &delta) const
+    {
+      LatticePoint n;
+      n.x = c.x + toStep(delta.getX(), m_xunit);
+      n.y = c.y + toStep(delta.getY(), m_yunit);
+      n.z = c.z + toStep(delta.getZ(), m_zunit);
+      return n;
+    };
+
+    // shortest vector (microns) from 'from' to 'to' in periodic space
+    SimPoint diff(const LatticePoint &from, const LatticePoint &to) const
+	{ return SimPoint( int(to.x - from.x) * m_xunit,
+			   int(to.y - from.y) * m_yunit,
+			   int(to.z - from.z) * m_zunit ); };
+
+  private:
+    double m_xunit, m_yunit, m_zunit;	// microns per lattice step
+
+    // divide rather than multiply by inverse, so lattice positions
+    // convert back exactly; conversion via 64 bits wraps modulo 2^32
+    static unsigned int toCoord(double v, double unit)
+	{ return (unsigned int)(long long)floor(v/unit); };
+    static unsigned int toStep(double v, double unit)
+	{ return (unsigned int)llround(v/unit); };
+};
+
+#endif
+
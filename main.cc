@@ -25,6 +25,7 @@
  ************************************************************************/
 									
 #include <cstdio>			// for sprintf
+#include <cstring>			// for strcmp
 #include <getopt.h>			// for command-line options
 #include <iostream>			// for cout
 #include "tissue.h"
@@ -32,6 +33,7 @@
 #include "fileDef.h"
 #include "fileInit.h"
 #include "tallyActions.h"
+#include "scheduler.h"
 #include "util.h"
 
 using namespace std;
@@ -52,6 +54,12 @@ int main(int argc, char *argv[])
   long seed = 0;
   double duration=10, deltaT=1, deltaW=1, deltaV=0;
   double maxCells = 10000000;
+  int numThreads = 1;
+  bool syncUpdate = false;
+  bool latticePos = false;
+  bool bufferChanges = false;
+  bool bundleMolecules = false;
+  bool printStats = false;
 
   // bookkeeping
   double lastsample=-1, lastdetail=-1;
@@ -59,10 +67,13 @@ int main(int argc, char *argv[])
   // command line interface:
   // -d def-file -i init_file -o output_file -s seed -t duration -e stepsize
   // -f detail-file -w history-stepsize -v detail-stepsize -c max-cells
+  // -n threads -u update-mode (async or sync) -l (lattice positions)
+  // -b (buffer molecule changes by cells) -m (interleave molecule types)
+  // -p (print diffusion solver statistics)
 
   // process all command line options; each of these just overwrites
   // defaults set above - the values are actually used below
-  while ((c = getopt(argc, argv, "hd:i:o:a:s:t:e:c:f:w:v:")) != EOF)
+  while ((c = getopt(argc, argv, "hd:i:o:a:s:t:e:c:f:w:v:n:u:lbmp")) != EOF)
   {
     switch (c)
     {
@@ -99,11 +110,36 @@ int main(int argc, char *argv[])
       case 'v':		// detailed output step size
 	deltaV = strtod(optarg, NULL);
 	break;
+      case 'n':		// number of threads
+	numThreads = strtol(optarg, NULL, 10);
+	if (numThreads < 1)
+	  error("Error:  number of threads must be at least 1");
+	break;
+      case 'u':		// cell update mode
+	if (strcmp(optarg, "sync") == 0)
+	  syncUpdate = true;
+	else if (strcmp(optarg, "async") == 0)
+	  syncUpdate = false;
+	else
+	  error("Error:  update mode should be sync or async", optarg);
+	break;
+      case 'l':		// fixed-point cell positions
+	latticePos = true;
+	break;
+      case 'b':		// accumulate secretion/uptake each step
+	bufferChanges = true;
+	break;
+      case 'm':		// diffuse molecule types together
+	bundleMolecules = true;
+	break;
+      case 'p':		// report solver timing
+	printStats = true;
+	break;
       case 'h':		// help         
 	cout << "usage:  textsim [-h] [-d def_file] [-i init_file] "
 	     << "[-o output_file] [-s seed] [-t duration] [-e timestep] " 
 	     << "[-f detail_file] [-w history_interval] [-v detail_interval] "
-	     << endl;
+	     << "[-n threads] [-u async|sync] [-l] [-b] [-m] [-p] " << endl;
 	exit(0);
     }
   }
@@ -114,10 +150,19 @@ int main(int argc, char *argv[])
   // will override the other seed specifications
   if (seed) tissue.setSeed(seed);	
 
+  Scheduler *sched = Scheduler::getInstance();
+  sched->setNumThreads(numThreads);
+
   FileDef defParser;
   defParser.defineFromFile(&tissue, def_file);	
   FileInit initParser;
   initParser.initFromFile(&tissue, init_file);	
+  tissue.setSyncUpdate(syncUpdate);
+  if (bufferChanges)
+    tissue.setBufferChanges(true);
+  tissue.setLatticePositions(latticePos);
+  if (bundleMolecules)
+    tissue.setBundleMolecules(true);
 
 
   // if sim volume 'gridded-up'; make sure timestep not too big for gridsize
@@ -193,5 +238,31 @@ int main(int argc, char *argv[])
     error("Error:  could not open action file", actname);
   actfile << *tap;
   actfile.close();
+
+  // write per-thread utilization, to check load balance
+  if (numThreads > 1)
+  {
+    char thrname[200];
+    sprintf(thrname, "%s.threads", history_file);
+    ofstream thrfile(thrname);
+    if (!thrfile)
+      error("Error:  could not open thread file", thrname);
+    thrfile << *sched;
+    thrfile.close();
+  }
+
+  // report diffusion speed, to see whether it's memory bound
+  if (printStats)
+    Molecule::printStats(cout);
+
+  // and what updating molecules less often may have cost
+  for (int i=0; i<tissue.getNumMolTypes(); i++)
+  {
+    const Molecule &m = tissue.getMolecule(i);
+    if (m.getUpdateInterval() > 1)
+      cout << m.getName() << " updated every " << m.getUpdateInterval() 
+	   << " steps:  lag bound (heuristic) " << m.getLagBound() 
+	   << " (largest " << m.getMaxLagBound() << ")" << endl;
+  }
 }
 
@@ -29,24 +29,140 @@
 #include "molecule.h"
 #include <iostream>
 #include <string>
+#include <cmath>
+#include <algorithm>		// for copy
 #include "simPoint.h"
 #include "random.h"
 #include "array3D.h"
+#include "stepBuffer.h"
+#include "scheduler.h"
+#include "stencil.h"
+#include "util.h"
+#include <chrono>
 
 using namespace std;
 
-// static geometry info - accessed many times; quicker to set/calculate once
-int Molecule::sm_xsize;
-int Molecule::sm_ysize;
-int Molecule::sm_zsize;
-int Molecule::sm_gridsize;
-int Molecule::sm_size;
-int Molecule::sm_gridsq;
-double Molecule::sm_invNavVol;
+static double now()
+{
+  return chrono::duration<double>(
+	chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Chebyshev polynomial T_s(x), and its derivative (s >= 1)
+static double chebyshev(int s, double x, double &deriv)
+{
+  double t0 = 1, t1 = x, d0 = 0, d1 = 1;
+  for (int j=2; j<=s; j++)
+  {
+    double t = 2*x*t1 - t0, d = 2*t1 + 2*x*d1 - d0;
+    t0 = t1; t1 = t; d0 = d1; d1 = d;
+  }
+  deriv = d1;
+  return t1;
+}
+
+// row flags - see molecule.h
+#define ROW_ACTIVE 1
+#define ROW_CHANGED 2
+
+// explicit diffusion performance, all molecules
+long Molecule::sm_numSweeps = 0;
+double Molecule::sm_sweepPoints = 0;
+double Molecule::sm_sweepSeconds = 0;
+long Molecule::sm_numSolves = 0;
+long Molecule::sm_numCycles = 0;
+double Molecule::sm_solveSeconds = 0;
+
+/************************************************************************ 
+ * class Molecule::SweepTask                       			*
+ *   Scheduler task for one explicit diffusion step:  each chunk is a   *
+ *   slab of x planes.  Every point's new value depends only on old     *
+ *   values, so results don't depend on how slabs are divided up.       *
+ ************************************************************************/
+class Molecule::SweepTask : public Task {
+  public:
+    SweepTask(Molecule *pm, double decay_factor, double diff_factor) :
+	m_pm(pm), m_decay(decay_factor), m_diff(diff_factor) {};
+    void run(int begin, int end, int chunk, int thread)
+	{ m_pm->sweepSlab(begin, end, m_decay, m_diff); };
+
+  private:
+    Molecule *m_pm;
+    double m_decay, m_diff;
+};
+
+/************************************************************************ 
+ * class Molecule::BlockTask                       			*
+ *   Scheduler task for several explicit steps at once:  each chunk is  *
+ *   a slab of x planes, which recomputes what it needs from its        *
+ *   neighbors' planes itself, so chunks are still independent          *
+ ************************************************************************/
+class Molecule::BlockTask : public Task {
+  public:
+    BlockTask(Molecule *pm, int depth, double decay_factor, 
+	      double diff_factor) : m_pm(pm), m_depth(depth), 
+	m_decay(decay_factor), m_diff(diff_factor) {};
+    void run(int begin, int end, int chunk, int thread)
+	{ m_pm->blockedSlab(begin, end, m_depth, m_decay, m_diff); };
+
+  private:
+    Molecule *m_pm;
+    int m_depth;
+    double m_decay, m_diff;
+};
+
+/************************************************************************ 
+ * class Molecule::GradientTask                    			*
+ *   Scheduler task for updateGradient:  each chunk is a slab of x      *
+ *   planes                                                             *
+ ************************************************************************/
+class Molecule::GradientTask : public Task {
+  public:
+    GradientTask(Molecule *pm) : m_pm(pm) {};
+    void run(int begin, int end, int chunk, int thread)
+	{ m_pm->gradientSlab(begin, end); };
+
+  private:
+    Molecule *m_pm;
+};
+
+/************************************************************************ 
+ * struct Molecule::RkcStage                       			*
+ *   One stage of an RKC super step (see rkcDecayDiff):                 *
+ *     out = mu*prev1 + nu*prev2 + mu_t*tau*L(prev1)                    *
+ *   where L is decay and diffusion.  out may be prev2, which is only    *
+ *   read at the point being written.                                  *
+ ************************************************************************/
+struct Molecule::RkcStage {
+  const Molecule::Conc *prev1, *prev2;
+  Molecule::Conc *out;
+  double mu, nu, mu_t;
+  double decay, diff;			// decay rate * tau, and diffusion 
+  					// rate * tau / gridsize^2
+  bool last;				// clamp values to >= 0?
+};
+
+/************************************************************************ 
+ * class Molecule::RkcTask                         			*
+ *   Scheduler task for one RKC stage:  each chunk is a slab of x       *
+ *   planes; like SweepTask, new values depend only on old ones         *
+ ************************************************************************/
+class Molecule::RkcTask : public Task {
+  public:
+    RkcTask(Molecule *pm, const RkcStage &st) : m_pm(pm), m_st(st) {};
+    void run(int begin, int end, int chunk, int thread)
+	{ m_pm->rkcSlab(begin, end, m_st); };
+
+  private:
+    Molecule *m_pm;
+    const RkcStage &m_st;
+};
 
 /************************************************************************ 
  * setGeometry()                                                        *
- *   Static routine to set geometry info mentioned above                *
+ *   Sets geometry info mentioned above.  A range smaller than the grid *
+ *   size gets one grid cell (e.g. z in 2D models), and then planar     *
+ *   interpolation is used.                                             *
  *                                                                      *
  * Parameters                                                           *
  *   int xrange, yrange, zrange:  size in microns in each dimension	*
@@ -59,37 +175,45 @@ void Molecule::setGeometry(int xrange, int yrange, int zrange, int gridsize)
 {
   assert(xrange>0); assert(yrange>0); assert(zrange>0); assert(gridsize>=0);
 
-  sm_gridsize = gridsize; 
+  m_gridsize = gridsize; 
 
   if (gridsize)		// could still be single grid cell
   {
-    sm_xsize = xrange/gridsize; 
-    sm_ysize = yrange/gridsize; 
-    sm_zsize = zrange/gridsize;
-    sm_size = sm_xsize*sm_ysize*sm_zsize;
-    sm_gridsq = gridsize*gridsize;
+    m_xsize = (xrange < gridsize) ? 1 : xrange/gridsize; 
+    m_ysize = (yrange < gridsize) ? 1 : yrange/gridsize; 
+    m_zsize = (zrange < gridsize) ? 1 : zrange/gridsize;
+    m_size = m_xsize*m_ysize*m_zsize;
+    m_gridsq = gridsize*gridsize;
 
     // precalculate 1 / (Nav*gridVol) for changeConc:
     // gridsize specified in microns - volume of one grid cell in ml is
     //	m_gridsize^3 * 1E-12 
-    double temp = 6.022E11 * sm_gridsize*sm_gridsize*sm_gridsize;
-    sm_invNavVol = 1 / temp;
-    assert(sm_invNavVol>0);
+    double temp = 6.022E11 * m_gridsize*m_gridsize*m_gridsize;
+    m_invNavVol = 1 / temp;
+    assert(m_invNavVol>0);
   }
   else		// molecular concentration homeogeneous
   {
-    sm_xsize = sm_ysize = sm_zsize = sm_size = 1;
+    m_xsize = m_ysize = m_zsize = m_size = 1;
 
     // still need 1 / (Nav*gridVol) for changeConc:
     // volume of sim space in ml is
     // xrange*yrange*zrange* 1E-12 
     double temp = 6.022E11 * xrange * yrange * zrange;
-    sm_invNavVol = 1 / temp;
-    assert(sm_invNavVol>0);
+    m_invNavVol = 1 / temp;
+    assert(m_invNavVol>0);
   }
 
-  cout << "set Molecule geometry:  " << sm_xsize << "x" << sm_ysize
-       << "x" << sm_zsize << "=" << sm_size << endl; 
+  if (m_zsize == 1)
+  {
+    m_interpConc = &Molecule::interpConc<2>;
+    m_cachedGradient = &Molecule::cachedGradient<2>;
+  }
+  else
+  {
+    m_interpConc = &Molecule::interpConc<3>;
+    m_cachedGradient = &Molecule::cachedGradient<3>;
+  }
 }
 
 /************************************************************************ 
@@ -101,9 +225,16 @@ void Molecule::setGeometry(int xrange, int yrange, int zrange, int gridsize)
  *                                                                      *
  * Returns - nothing                                                    *
  ************************************************************************/
-Molecule::Molecule(const string& title) : m_name(title), 
-	m_diffusionRate(0), m_decayRate(0) 
+Molecule::Molecule(const string& title) : m_resolution(-1), m_name(title), 
+	m_diffusionRate(0), m_decayRate(0), m_solver(EXPLICIT), 
+	m_updateInterval(1), m_lagSum(0), m_lagMax(0), m_lagCount(0), 
+	m_deltaConc(0), m_pool(0), m_field(0), m_stride(1), m_bundled(false),
+	m_scale(1), m_activeThreshold(0), 
+	m_refineRatio(1), m_refined(0), m_regridCount(0), m_total(0), 
+	m_totalCount(0), m_cacheGradient(false), m_gradientValid(false), 
+	m_defer(false), m_pending(false)
 {
+  setGeometry(DEFAULT_RANGE, DEFAULT_RANGE, DEFAULT_RANGE, 0);
   initialize();
 }
 
@@ -119,19 +250,43 @@ Molecule::Molecule(const string& title) : m_name(title),
  * Returns - nothing                                                    *
  ************************************************************************/
 Molecule::Molecule(const string& title, double diff, double decay) 
-	: m_name(title), m_diffusionRate(diff), m_decayRate(decay) 
+	: m_resolution(-1), m_name(title), m_diffusionRate(diff), 
+	  m_decayRate(decay), 
+	  m_solver(EXPLICIT), m_updateInterval(1), m_lagSum(0), m_lagMax(0),
+	  m_lagCount(0), m_deltaConc(0), m_pool(0), m_field(0), 
+	  m_stride(1), m_bundled(false), 
+	  m_scale(1), m_activeThreshold(0), m_refineRatio(1), m_refined(0), 
+	  m_regridCount(0), m_total(0), m_totalCount(0), 
+	  m_cacheGradient(false), m_gradientValid(false), m_defer(false), 
+	  m_pending(false)
 {
   assert(diff>=0);
+  setGeometry(DEFAULT_RANGE, DEFAULT_RANGE, DEFAULT_RANGE, 0);
   initialize();
 }
 
+/************************************************************************ 
+ * ~Molecule()                                                          *
+ *   Destructor; deletes refined grid, if any, and forgets any grid     *
+ *   borrowed from the scratch pool                                     *
+ *                                                                      *
+ * Parameters - none                                                    *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+Molecule::~Molecule()
+{
+  delete m_refined;
+  if (m_pool)
+    m_pool->release(this);
+}
+
 /************************************************************************ 
  * initialize()                                                         *
  *   Allocates memory for concentration arrays and assigns all values   *
  *   to 0.  Use setUniformConc to set all values to some non-zero       *
  *   concentration.                                                     *
- *   Allocates enough memory for sim volume + one layer of guard grid   *
- *   cells for each edge                                                *
+ *   No guard layers - periodic neighbors are found by wrapping indices *
  *                                                                      *
  * Parameters                                                           *
  *                                                                      *
@@ -139,11 +294,16 @@ Molecule::Molecule(const string& title, double diff, double decay)
  ************************************************************************/
 void Molecule::initialize()
 {
-  assert(sm_size);
+  assert(m_size);
+  assert(!m_bundled);		// MoleculeBundle would be left pointing 
+				// at the old geometry
 
   try {
-    m_concentration.resize(sm_xsize+2, sm_ysize+2, sm_zsize+2);
-    m_deltaConc.resize(sm_xsize+2, sm_ysize+2, sm_zsize+2);   // for updates
+    m_concentration.resize(m_xsize, m_ysize, m_zsize);
+    if (!m_pool)
+      m_ownDelta.resize(m_xsize, m_ysize, m_zsize);   // for updates
+    m_rowFlags.assign(getNumRows(), 0);		// all 0 - nothing active
+    m_nextRowFlags.assign(getNumRows(), 0);
   }
   catch(std::bad_alloc&) {
     cerr << "not enough memory to set up molecular concentration data" 
@@ -152,7 +312,37 @@ void Molecule::initialize()
   }
 
   m_concentration.setAll(0);
-  m_deltaConc.setAll(0);
+  if (m_pool)
+    m_pool->release(this);	// what it had is out of date
+  else
+    m_ownDelta.setAll(0);
+  m_deltaConc = 0;		// see borrowScratch
+  m_field = &m_concentration[0];
+  m_stride = 1;
+  m_scale = 1;
+  m_total = 0;
+  m_totalCount = 0;
+  m_gradient.clear();		// sized when first used
+  m_gradientValid = false;
+
+  m_steadyRestart = true;
+  m_rkcRough = true;
+  if (m_solver == STEADY && m_decayRate <= 0)
+    error("Molecule::initialize:  steady state needs a decay rate for", 
+	  m_name);
+  if (m_solver == STEADY && m_refineRatio > 1)
+    error("Molecule::initialize:  steady state can't be refined for", 
+	  m_name);
+
+  delete m_refined;
+  m_refined = 0;
+  if (m_refineRatio > 1 && m_size > 1)
+    m_refined = new RefinedField(m_xsize, m_ysize, m_zsize, m_gridsize,
+		    		 m_refineRatio);
+  m_regridCount = 0;
+
+  if (m_defer)
+    setDeferChanges(true);	// deposit grid must match new geometry
 }
 
 /************************************************************************ 
@@ -173,21 +363,30 @@ void Molecule::setUniformConc(Conc amount, double stddev /* = 0 */)
 
   if (stddev)
   {
-    for (int i=1; i<=sm_xsize; i++)
-      for (int j=1; j<=sm_ysize; j++)
-        for (int k=1; k<=sm_zsize; k++)
+    for (int i=0; i<m_xsize; i++)
+      for (int j=0; j<m_ysize; j++)
+        for (int k=0; k<m_zsize; k++)
 	{
 	  while ( (c = sampleGaussian(amount,stddev)) < 0 )
 	    cout << "Molecule::setUniformConc warning:  " 
 		 << "sample gave negative concentration" << endl;
-	  m_concentration.at(i,j,k) = c;
+	  value(index(i,j,k)) = c;
 	}
-    // set all guard layers
-    setGuards();
-    setGuardCorners();
   }
-  else	// setAll automatically sets guard layers as well as 'real' values
-    m_concentration.setAll(amount);
+  else
+    for (int n=0; n<m_size; n++)
+      value(n) = amount;
+
+  m_scale = 1;
+  resumTotal();
+  resetRowFlags();
+  m_steadyRestart = true;
+  m_rkcRough = true;
+  if (m_refined)		// start over from the new values
+  {
+    m_refined->clear();
+    m_regridCount = 0;
+  }
 }
 
 /************************************************************************ 
@@ -201,14 +400,21 @@ void Molecule::setUniformConc(Conc amount, double stddev /* = 0 */)
  ************************************************************************/
 void Molecule::initFromFile(ifstream &infile)
 {
-  for (int i=1; i<=sm_xsize; i++)
-    for (int j=1; j<=sm_ysize; j++)
-      for (int k=1; k<=sm_zsize; k++)
-	infile >> m_concentration.at(i,j,k);
-
-  // set all guard layers
-  setGuards();
-  setGuardCorners();
+  for (int i=0; i<m_xsize; i++)
+    for (int j=0; j<m_ysize; j++)
+      for (int k=0; k<m_zsize; k++)
+	infile >> value(index(i,j,k));
+
+  m_scale = 1;
+  resumTotal();
+  resetRowFlags();
+  m_steadyRestart = true;
+  m_rkcRough = true;
+  if (m_refined)
+  {
+    m_refined->clear();
+    m_regridCount = 0;
+  }
 }
 
 /************************************************************************ 
@@ -225,115 +431,130 @@ void Molecule::initFromFile(ifstream &infile)
  ************************************************************************/
 void Molecule::changeConc(double amount, const SimPoint &p)
 {
+  // during a parallel update, hold change in the chunk's buffer; Cells
+  // passes it back here, in chunk order, once all chunks are done
+  if (m_defer)
+    if (StepBuffer *pb = StepBuffer::getCurrent())
+    {
+      pb->deposits.push_back(StepBuffer::Deposit(this, p, amount));
+      return;
+    }
+
   // find indices of grid cell to change - nearest grid point to p
-  int xi=1, yi=1, zi=1;		// default - only one grid cell
-  if (sm_gridsize)
+  int xi=0, yi=0, zi=0;		// default - only one grid cell
+  if (m_gridsize)
   {
-    assert(p.getX()>=0); assert(p.getX()<sm_gridsize*sm_xsize);
-    assert(p.getY()>=0); assert(p.getY()<sm_gridsize*sm_ysize);
-    assert(p.getZ()>=0); assert(p.getZ()<sm_gridsize*sm_zsize);
-    xi = int(p.getX()/sm_gridsize+1);
-    yi = int(p.getY()/sm_gridsize+1);
-    zi = int(p.getZ()/sm_gridsize+1);
+    assert(p.getX()>=0); assert(p.getX()<m_gridsize*m_xsize);
+    assert(p.getY()>=0); assert(p.getY()<m_gridsize*m_ysize);
+    assert(p.getZ()>=0); assert(p.getZ()<m_gridsize*m_zsize);
+    xi = int(p.getX()/m_gridsize);
+    yi = int(p.getY()/m_gridsize);
+    zi = int(p.getZ()/m_gridsize);
   }
 
   // amount passed in should be #molecules:
   // convert to moles/ml based on volume of grid cell and add to conc
   // want amount/(N_AV*volume) - denominator precalculated in setGeometry
   // and inverted
-  Conc change = amount * sm_invNavVol;
-  m_concentration.at(xi, yi, zi) += change;
-  assert(m_concentration.at(xi, yi, zi) >= 0);
-
-  // fix guard layers
-  if (sm_gridsize)
-    setSpecificGuards(xi, yi, zi);
-
-// the interpolation tried below causes problems if we're subtracting
-// molecules rather than adding them - stick to simpler scheme for now
-//  if (sm_size == 1)	// no interpolation necessary 
-//  {
-//    m_concentration.at(1,1,1) += change;
-//    assert(m_concentration.at(1,1,1) >= 0);
-//  }
-//  else
-//  {
-    // distribute change among 8 nearest neighbor grid points
-    // find 'fractional indices' that interpolation routine uses
-//    double fix = p.getX()/sm_gridsize + 0.5;
-//    double fiy = p.getY()/sm_gridsize + 0.5;
-//    double fiz = p.getZ()/sm_gridsize + 0.5;
-
-    // indices for lower-bound stored value
-//    int xi = int(fix); int yi = int(fiy); int zi = int(fiz);
-  
-    // interpolation parameters in each dimension
-//    double fx = fix - xi; double fy = fiy - yi; double fz = fiz - zi;
-  
-    // Calculate the change to each of the neighboring grid cells  
-//    if (sm_zsize == 1)		// need only 2D interpolation
-//    {
-//      addConc(xi, yi, zi, (1-fx)*(1-fy)*change);
-//      addConc(xi+1, yi, zi, fx*(1-fy)*change);
-//      addConc(xi+1, yi+1, zi, fx*fy*change);
-//      addConc(xi, yi+1, zi, (1-fx)*fy*change);
-//    }
-//    else
-//    {
-//      addConc(xi, yi, zi, (1-fx)*(1-fy)*(1-fz)*change);
-//      addConc(xi+1, yi, zi, fx*(1-fy)*(1-fz)*change);
-//      addConc(xi+1, yi+1, zi, fx*fy*(1-fz)*change);
-//      addConc(xi, yi+1, zi, (1-fx)*fy*(1-fz)*change);
-//      addConc(xi, yi, zi+1, (1-fx)*(1-fy)*fz*change);
-//      addConc(xi+1, yi, zi+1, fx*(1-fy)*fz*change);
-//      addConc(xi+1, yi+1, zi+1, fx*fy*fz*change);
-//      addConc(xi, yi+1, zi+1, (1-fx)*fy*fz*change);
-//    }
-//  }	// end else need to interpolate
-}
-
-/************************************************************************ 
- * addConc                                                              *
- *    checks whether (i,j,k) is a guard cell, changes corresponding     *
- * 'real' cell if so							*
- *  Then updates all relevant guard cells                               *
- *                                                                      *
- * Parameters                                                           *
- *   int i, j, k: 	location of grid cell to change              	*
- *                                                                      *
- * Returns - nothing                                                    *
- ************************************************************************/
-void Molecule::addConc(int i, int j, int k, Conc change)
-{
-  // get current amount, add change (which may be negative), 
-  // verify that result is >=0
-  Conc c = m_concentration.at(i,j,k) + change;
-  assert(c >= 0);
-
-  // check whether this is a guard layer, and update corresponding
-  // center grid cell
-  int ti, tj, tk;		// target cell to change
-  if (i == 0) ti = sm_xsize;
-  else if (i == sm_xsize+1) ti = 1;
-  else ti = i;
-  if (j == 0) tj = sm_ysize;
-  else if (j == sm_ysize+1) tj = 1;
-  else tj = j;
-  if (k == 0) tk = sm_zsize;
-  else if (k == sm_zsize+1) tk = 1;
-  else tk = k;
-
-  m_concentration.at(ti, tj, tk) = c;
- 
-  // now set guard layers to reflect change
-  setSpecificGuards(ti, tj, tk);
+  Conc change = amount * m_invNavVol;
+  m_rkcRough = true;
+  if (m_refined)
+    m_refined->markSource(p);
+  if (m_defer)
+  {
+    m_deposit.at(xi, yi, zi) += change;
+    m_pending = true;
+    if (m_refined)
+      m_refined->deposit(change, p);
+    return;
+  }
+  Conc &rc = value(index(xi, yi, zi));
+  Conc old = rc;
+  rc += change/m_scale;
+  if (m_refined && m_refined->changeConc(change, p) && rc < 0)
+    rc = 0;		// fine cell had enough; rounding - see RefinedField
+  assert(rc >= 0);
+  m_total += (rc - old)*m_scale;
+  m_rowFlags[(m_zsize == 1) ? xi : xi*m_ysize + yi] = 
+	ROW_ACTIVE | ROW_CHANGED;
+}
+
+/************************************************************************ 
+ * setDeferChanges()                                                    *
+ *   Turns deferred (accumulation) mode on or off; allocates the        *
+ *   deposit grid when turned on.  Any deposits not yet applied are     *
+ *   applied before turning it off.                                     *
+ *                                                                      *
+ * Parameters                                                           *
+ *   bool flag:		true to accumulate changes                      *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Molecule::setDeferChanges(bool flag)
+{
+  if (!flag)
+  {
+    applyChanges();
+    m_defer = false;
+    return;
+  }
+
+  m_defer = true;
+  try {
+    m_deposit.resize(m_xsize, m_ysize, m_zsize);
+  }
+  catch(std::bad_alloc&) {
+    cerr << "not enough memory to set up molecular deposit data" << endl;
+    abort();
+  }
+  m_deposit.setAll(0);
+  m_pending = false;
+}
+
+/************************************************************************ 
+ * applyChanges()                                                       *
+ *   Adds all changes recorded by changeConc in deferred mode, in one   *
+ *   pass over the grid.  Changes to the same grid cell have been       *
+ *   summed first (in the order recorded), so the result doesn't depend *
+ *   on which cell acted first; if the total would make the             *
+ *   concentration negative, it is set to 0 - i.e. cells consuming more *
+ *   than is there between them just get what there is.                *
+ *   The total concentration is summed again, and any decay scale       *
+ *   multiplied out, on the way.                                        *
+ *                                                                      *
+ * Parameters - none                                                    *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Molecule::applyChanges()
+{
+  if (!m_pending)
+    return;
+
+  Conc *dep = &m_deposit[0];
+  Conc total = 0;
+  for (int i=0; i<m_size; i++)
+  {
+    Conc c = value(i)*m_scale + dep[i];		// scale applied too
+    value(i) = (c < 0) ? 0 : c;
+    total += value(i);
+    dep[i] = 0;
+  }
+  m_scale = 1;
+  m_total = total;
+  if (m_refined)
+    m_total += m_refined->applyDeposits(&m_concentration[0]);
+
+  m_pending = false;
+  resetRowFlags();
 }
 
 /************************************************************************ 
  * decay()                                                              *
  *   Calculates changes in molecular concentration due to exponential	*
  *   decay only - no diffusion						*
- *   Periodic boundary conditions.                                      *
+ *                                                                      *
+ *   Rows with nothing above the active threshold are left alone.       *
  *                                                                      *
  * Parameters                                                           *
  *   double deltaT:              duration of time step in seconds	*
@@ -342,353 +563,1064 @@ void Molecule::addConc(int i, int j, int k, Conc change)
  ************************************************************************/
 void Molecule::decay(double deltaT)
 { 
-  int i,j,k;
   Conc current;
 
   double decay_factor = m_decayRate*deltaT;
   assert (decay_factor < 1);
 
-  // update all grid cells - including guard layers 
-  for (i=0; i<=sm_xsize+1; i++)
-    for (j=0; j<=sm_ysize+1; j++)
-      for (k=0; k<=sm_zsize+1; k++)
-      {
-	current = m_concentration.at(i,j,k);
-        m_concentration.at(i,j,k) = current - decay_factor*current;
-        assert(m_concentration.at(i,j,k)>=0);
-      }
+  // update all grid cells in active rows
+  const int len = getRowLength();
+  for (int r=0; r<getNumRows(); r++)
+  {
+    if (!(m_rowFlags[r] & ROW_ACTIVE))
+      continue;
+    for (int n=r*len; n<(r+1)*len; n++)
+    {
+      current = value(n);
+      value(n) = current - decay_factor*current;
+      assert(value(n)>=0);
+    }
+    m_rowFlags[r] = scanRow(&value(r*len)) | ROW_CHANGED;
+  }
 }
 
 /************************************************************************ 
- * explicitDecayDiff2D()                                                *
+ * explicitDecayDiff()                                                  *
  *   Calculates changes in molecular concentration due to exponential	*
  *   decay and diffusion 						*
  *   This is an explicit method for solving diffusion equation -        *
  *   assumes calling routine has chosen time step appropriately         *
- *   Periodic boundary conditions.                                      *
- *   This version assumes zsize == 1                                    *
+ *   New values are written to m_deltaConc (see borrowScratch), so old  *
+ *   ones aren't changed before they've been used; then the two arrays  *
+ *   are swapped.  Slabs of x planes are done in parallel by the        *
+ *   Scheduler; each slab is small enough to stay in L2 cache while     *
+ *   it's worked on.                                                    *
  *                                                                      *
  * Parameters                                                           *
  *   double deltaT:              duration of time step in seconds	*
  *                                                                      *
  * Returns - nothing                                                    *
  ************************************************************************/
-void Molecule::explicitDecayDiff2D(double deltaT)
+void Molecule::explicitDecayDiff(double deltaT)
 { 
-  assert(sm_zsize=1);
-
-  int i,j;
-  Conc sum, current;
-
   // premultiply constants, instead of in loop
   // if deltaT is always the same, can do this in routines that set
   // diffusion & decay rates, but for now, assume it may vary
   double decay_factor = m_decayRate*deltaT;
   assert (decay_factor < 1);
-  double diff_factor = m_diffusionRate*deltaT/sm_gridsq;
+  double diff_factor = m_diffusionRate*deltaT/m_gridsq;
+
+  double start = now();
+
+  int plane = m_ysize*m_zsize*sizeof(Conc);
+  int grain = SWEEP_CACHE_BYTES / plane;
+  if (grain < 1)
+    grain = 1;
+  borrowScratch();
+  SweepTask task(this, decay_factor, diff_factor);
+  Scheduler::getInstance()->run(task, m_xsize, grain);
+  m_concentration.swap(*m_deltaConc);
+  m_field = &m_concentration[0];
+  m_rowFlags.swap(m_nextRowFlags);
+
+  sm_numSweeps++;
+  sm_sweepPoints += m_size;
+  sm_sweepSeconds += now() - start;
+}
 
-  // calculate all the changes before applying any to avoid
-  // changing values before using them
-  for (i=1; i<=sm_xsize; i++)
-    for (j=1; j<=sm_ysize; j++)
+/************************************************************************ 
+ * sweepSlab()                                                          *
+ *   One explicit step for x planes [begin,end) - see explicitDecayDiff *
+ *   Periodic boundary conditions:  neighbor rows in x and y are chosen *
+ *   with wrapping once per row; along each row (z in 3D, y in 2D -     *
+ *   contiguous in memory) the first and last points are peeled off so *
+ *   the rest need no wrapping (and can use SIMD - see Stencil).        *
+ *   In 3D, if planes are too big to stay in cache, the slab is done a  *
+ *   band of y rows at a time, so the rows of plane i-1, i and i+1 that *
+ *   a band needs are still in cache when plane i+1 is done.            *
+ *   A row that isn't active, with no active neighbor rows, is left as  *
+ *   it is (copied, if the new array's row may be out of date).  New    *
+ *   row flags go to m_nextRowFlags.                                    *
+ *                                                                      *
+ * Parameters                                                           *
+ *   int begin, end:		range of x indices                      *
+ *   double decay_factor:	decay rate * time step                  *
+ *   double diff_factor:	diffusion rate * time step / gridsize^2 *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Molecule::sweepSlab(int begin, int end, double decay_factor, 
+			 double diff_factor)
+{
+  const int nx = m_xsize, ny = m_ysize, nz = m_zsize;
+  const Conc *conc = &m_concentration[0];
+  Conc *next = &(*m_deltaConc)[0];
+  const unsigned char *flags = &m_rowFlags[0];
+  unsigned char *next_flags = &m_nextRowFlags[0];
+  Stencil::Row5 row5 = Stencil::getRow5();	// SIMD if available
+  Stencil::Row7 row7 = Stencil::getRow7();
+
+  if (nz == 1)		// essentially 2D - rows are y
+  {
+    for (int i=begin; i<end; i++)
+    {
+      int im = (i == 0) ? nx-1 : i-1;
+      int ip = (i == nx-1) ? 0 : i+1;
+      const Conc *row = conc + i*ny;
+      const Conc *xm = conc + im*ny;
+      const Conc *xp = conc + ip*ny;
+      Conc *out = next + i*ny;
+
+      if (!((flags[i] | flags[im] | flags[ip]) & ROW_ACTIVE))
       {
-	current = m_concentration.at(i,j,1);
-        m_deltaConc.at(i,j,1) = -decay_factor*current;
-	sum = 0;
-	sum += m_concentration.at(i-1,j,1) - current;
-	sum += m_concentration.at(i+1,j,1) - current;
-	sum += m_concentration.at(i,j-1,1) - current;
-	sum += m_concentration.at(i,j+1,1) - current;
-        m_deltaConc.at(i,j,1) += diff_factor*sum;
+        if (flags[i] & ROW_CHANGED)
+          copy(row, row+ny, out);
+        next_flags[i] = 0;
+        continue;
       }
 
-  // now apply changes 
-  for (i=1; i<=sm_xsize; i++)
-    for (j=1; j<=sm_ysize; j++)
+      out[0] = Stencil::point5(row, xm, xp, 0, ny-1, (ny>1) ? 1 : 0, 
+			decay_factor, diff_factor);
+      row5(out, row, xm, xp, ny, decay_factor, diff_factor);
+      if (ny > 1)
+        out[ny-1] = Stencil::point5(row, xm, xp, ny-1, ny-2, 0, 
+			     decay_factor, diff_factor);
+      next_flags[i] = scanRow(out) | ROW_CHANGED;
+    }
+    return;
+  }
+
+  // full 3D - rows are z; 4 rows (3 planes read, 1 written) per band row
+  int band = SWEEP_CACHE_BYTES / (4*nz*sizeof(Conc));
+  if (band < 1)
+    band = 1;
+  for (int j0=0; j0<ny; j0+=band)
+  {
+    int j1 = (j0+band < ny) ? j0+band : ny;
+    for (int i=begin; i<end; i++)
+    {
+      int im = (i == 0) ? nx-1 : i-1;
+      int ip = (i == nx-1) ? 0 : i+1;
+      for (int j=j0; j<j1; j++)
       {
-        m_concentration.at(i,j,1) = 
-		m_concentration.at(i,j,1) + m_deltaConc.at(i,j,1);
-        assert(m_concentration.at(i,j,1)>=0);
+        int jm = (j == 0) ? ny-1 : j-1;
+        int jp = (j == ny-1) ? 0 : j+1;
+        int r = i*ny+j;
+        const Conc *row = conc + r*nz;
+        const Conc *xm = conc + (im*ny+j)*nz;
+        const Conc *xp = conc + (ip*ny+j)*nz;
+        const Conc *ym = conc + (i*ny+jm)*nz;
+        const Conc *yp = conc + (i*ny+jp)*nz;
+        Conc *out = next + r*nz;
+
+        if (!((flags[r] | flags[im*ny+j] | flags[ip*ny+j] | 
+	       flags[i*ny+jm] | flags[i*ny+jp]) & ROW_ACTIVE))
+        {
+          if (flags[r] & ROW_CHANGED)
+            copy(row, row+nz, out);
+          next_flags[r] = 0;
+          continue;
+        }
+
+        out[0] = Stencil::point7(row, xm, xp, ym, yp, 0, nz-1, 1, 
+			  decay_factor, diff_factor);
+        row7(out, row, xm, xp, ym, yp, nz, decay_factor, diff_factor);
+        out[nz-1] = Stencil::point7(row, xm, xp, ym, yp, nz-1, nz-2, 0, 
+			     decay_factor, diff_factor);
+        next_flags[r] = scanRow(out) | ROW_CHANGED;
       }
+    }
+  }
+}
 
-  // update guard layers 
-  setGuards();
-  setGuardCorners();
+/************************************************************************ 
+ * scanRow()                                                            *
+ *   Checks one row (getRowLength() values) against the active 		*
+ *   threshold                                                          *
+ *                                                                      *
+ * Parameters                                                           *
+ *   const Conc *row:		first value in row                      *
+ *                                                                      *
+ * Returns - ROW_ACTIVE if any value is above threshold, else 0         *
+ ************************************************************************/
+unsigned char Molecule::scanRow(const Conc *row) const
+{
+  const int len = getRowLength();
+  for (int k=0; k<len; k++)
+    if (row[k] > m_activeThreshold)
+      return ROW_ACTIVE;
+  return 0;
 }
 
 /************************************************************************ 
- * explicitDecayDiff3D()                                                *
- *   Calculates changes in molecular concentration due to exponential	*
- *   decay and diffusion 						*
- *   This is an explicit method for solving diffusion equation -        *
- *   assumes calling routine has chosen time step appropriately         *
- *   Periodic boundary conditions.                                      *
+ * resetRowFlags()                                                      *
+ *   Sets all row flags from the current concentrations, after they've *
+ *   been changed other than by a sweep; m_deltaConc is out of date, so *
+ *   every row is marked changed                                        *
+ *                                                                      *
+ * Parameters - none                                                    *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Molecule::resetRowFlags()
+{
+  const int len = getRowLength();
+  for (int r=0; r<getNumRows(); r++)
+    if (m_bundled)		// not used, but keep them sensible
+      m_rowFlags[r] = ROW_ACTIVE | ROW_CHANGED;
+    else
+      m_rowFlags[r] = scanRow(&m_field[r*len]) | ROW_CHANGED;
+}
+
+/************************************************************************ 
+ * getActiveFraction()                                                  *
+ *   Fraction of rows the next explicit sweep has to update - those     *
+ *   that are active or have an active neighbor row                     *
+ *                                                                      *
+ * Parameters - none                                                    *
+ *                                                                      *
+ * Returns - fraction of rows, 0 to 1                                   *
+ ************************************************************************/
+double Molecule::getActiveFraction() const
+{
+  const int nx = m_xsize, ny = m_ysize;
+  const unsigned char *flags = &m_rowFlags[0];
+  int count = 0;
+
+  for (int i=0; i<nx; i++)
+  {
+    int im = (i == 0) ? nx-1 : i-1;
+    int ip = (i == nx-1) ? 0 : i+1;
+    if (m_zsize == 1)
+    {
+      count += ((flags[i] | flags[im] | flags[ip]) & ROW_ACTIVE);
+      continue;
+    }
+    for (int j=0; j<ny; j++)
+    {
+      int jm = (j == 0) ? ny-1 : j-1;
+      int jp = (j == ny-1) ? 0 : j+1;
+      count += ((flags[i*ny+j] | flags[im*ny+j] | flags[ip*ny+j] | 
+		 flags[i*ny+jm] | flags[i*ny+jp]) & ROW_ACTIVE);
+    }
+  }
+  return double(count)/getNumRows();
+}
+
+/************************************************************************ 
+ * getBlockDepth()                                                      *
+ *   Number of substeps blockedDecayDiff should do at once:  as many    *
+ *   as keep the intermediate planes (3 per substep but the last) 	*
+ *   within BLOCK_CACHE_BYTES, up to MAX_BLOCK_DEPTH.  Less than 2 	*
+ *   means planes are too big for blocking to help.			*
+ *                                                                      *
+ * Parameters - none                                                    *
+ *                                                                      *
+ * Returns - number of substeps                                         *
+ ************************************************************************/
+int Molecule::getBlockDepth() const
+{
+  int plane = m_ysize*m_zsize*sizeof(Conc);
+  int depth = BLOCK_CACHE_BYTES/(3*plane) + 1;
+  return (depth < MAX_BLOCK_DEPTH) ? depth : MAX_BLOCK_DEPTH;
+}
+
+/************************************************************************ 
+ * borrowScratch()                                                      *
+ *   Points m_deltaConc at the grid a sweep writes new values into:     *
+ *   this molecule's own, or the scratch pool's spare.  If someone else *
+ *   used the spare last, every row of it may differ (see m_rowFlags).  *
+ *                                                                      *
+ * Parameters - none                                                    *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Molecule::borrowScratch()
+{
+  if (!m_pool)
+  {
+    m_deltaConc = &m_ownDelta;
+    return;
+  }
+
+  bool same;
+  m_deltaConc = &m_pool->borrow(m_xsize, m_ysize, m_zsize, this, same);
+  if (!same)
+    for (int r=0; r<getNumRows(); r++)
+      m_rowFlags[r] |= ROW_CHANGED;
+}
+
+/************************************************************************ 
+ * blockedDecayDiff()                                                   *
+ *   Same as 'depth' calls to explicitDecayDiff, with identical         *
+ *   results, but the grid is read from and written to memory only     *
+ *   once:  each slab of x planes is taken through all substeps while   *
+ *   its planes are still in cache (see blockedSlab).  Slabs are done   *
+ *   in parallel; each is at least a few times 'depth' planes thick,    *
+ *   since the planes a slab redoes for its neighbors grow with depth.  *
  *                                                                      *
  * Parameters                                                           *
- *   double deltaT:              duration of time step in seconds	*
+ *   double deltaT:		duration of one substep in seconds      *
+ *   int depth:			number of substeps                      *
  *                                                                      *
  * Returns - nothing                                                    *
  ************************************************************************/
-void Molecule::explicitDecayDiff3D(double deltaT)
-{ 
-  // premultiply constants, instead of in loop
-  // if deltaT is always the same, can do this in routines that set
-  // diffusion & decay rates, but for now, assume it may vary
+void Molecule::blockedDecayDiff(double deltaT, int depth)
+{
   double decay_factor = m_decayRate*deltaT;
   assert (decay_factor < 1);
-  double diff_factor = m_diffusionRate*deltaT/sm_gridsq;
-
-  // calculate all the changes before applying any to avoid
-  // changing values before using them
-  int i,j,k;
-  Conc sum, current;
-  for (i=1; i<=sm_xsize; i++)
-    for (j=1; j<=sm_ysize; j++)
-      for (k=1; k<=sm_zsize; k++)
-      {
-	current = m_concentration.at(i,j,k);
-        m_deltaConc.at(i,j,k) = -decay_factor*current;
-	sum = 0;
-	sum += m_concentration.at(i-1,j,k) - current;
-	sum += m_concentration.at(i+1,j,k) - current;
-	sum += m_concentration.at(i,j-1,k) - current;
-	sum += m_concentration.at(i,j+1,k) - current;
-	sum += m_concentration.at(i,j,k-1) - current;
-	sum += m_concentration.at(i,j,k+1) - current;
-        m_deltaConc.at(i,j,k) += diff_factor*sum;
-      }
-
-  // now apply changes 
-  for (i=1; i<=sm_xsize; i++)
-    for (j=1; j<=sm_ysize; j++)
-      for (k=1; k<=sm_zsize; k++)
-      {
-        m_concentration.at(i,j,k) = 
-		m_concentration.at(i,j,k) + m_deltaConc.at(i,j,k);
-        assert(m_concentration.at(i,j,k)>=0);
-      }
-
-  // update guard layers
-  setGuards();
-  setGuardCorners();  
+  double diff_factor = m_diffusionRate*deltaT/m_gridsq;
+
+  double start = now();
+
+  int threads = Scheduler::getInstance()->getNumThreads();
+  int grain = (m_xsize + threads-1) / threads;
+  if (grain < 4*depth)
+    grain = 4*depth;
+  borrowScratch();
+  BlockTask task(this, depth, decay_factor, diff_factor);
+  Scheduler::getInstance()->run(task, m_xsize, grain);
+  m_concentration.swap(*m_deltaConc);
+  m_field = &m_concentration[0];
+  m_rowFlags.swap(m_nextRowFlags);
+
+  sm_numSweeps += depth;
+  sm_sweepPoints += double(m_size)*depth;
+  sm_sweepSeconds += now() - start;
 }
 
 /************************************************************************ 
- * setGuards()                                                          *
- *   Copies concentration data from each 'edge' of array to the guard   *
- *   layer on the opposite 'edge'.  This routine does not set values    *
- *   in the array 'corners' (such as at (0,0,0).                        *
+ * blockedSlab()                                                        *
+ *   'depth' explicit steps for x planes [begin,end), as a wavefront:   *
+ *   plane i at step t needs planes i-1, i and i+1 at step t-1, so      *
+ *   after step t-1's plane i+1 is done, step t's plane i can be.  Each *
+ *   intermediate step keeps only its last 3 planes, in a ring.  Step   *
+ *   t is computed for planes begin-(depth-t) to end-1+(depth-t), so    *
+ *   the slab never needs another slab's intermediate results; those    *
+ *   extra planes are wasted work, which is why slabs are thick.        *
+ *   The final step goes to m_deltaConc.  All rows are updated - active *
+ *   rows aren't tracked within a block - but the new values' row flags *
+ *   are set.                                                           *
  *                                                                      *
  * Parameters                                                           *
+ *   int begin, end:		range of x indices                      *
+ *   int depth:			number of steps (at least 2)            *
+ *   double decay_factor:	decay rate * time step                  *
+ *   double diff_factor:	diffusion rate * time step / gridsize^2 *
  *                                                                      *
  * Returns - nothing                                                    *
  ************************************************************************/
-void Molecule::setGuards()           
+void Molecule::blockedSlab(int begin, int end, int depth, 
+			   double decay_factor, double diff_factor)
 {
-  int i,j,k;
-  for (j=1; j<=sm_ysize; j++)
-    for (k=1; k<=sm_zsize; k++)
+  assert(depth >= 2);
+  const int nx = m_xsize, plane = m_ysize*m_zsize;
+  const Conc *conc = &m_concentration[0];
+  Conc *next = &(*m_deltaConc)[0];
+  vector<Conc> ring(3*(depth-1)*plane);	// steps 1 to depth-1
+  const int len = getRowLength(), rows = plane/len;	// rows per plane
+
+  for (int w=begin-depth+1; w<=end+depth-2; w++)
+    for (int t=1; t<=depth; t++)
     {
-      m_concentration.at(0,j,k) = m_concentration.at(sm_xsize,j,k);
-      m_concentration.at(sm_xsize+1,j,k) = m_concentration.at(1,j,k);
+      int i = w-t+1;
+      if (i < begin-(depth-t) || i >= end+(depth-t))
+        continue;
+
+      // planes i-1, i, i+1 at step t-1:  old values (wrapped) or ring
+      const Conc *in[3];
+      for (int d=0; d<3; d++)
+        if (t == 1)
+          in[d] = conc + ((i+d-1)%nx + nx)%nx * plane;
+        else
+          in[d] = &ring[(3*(t-2) + ((i+d-1)%3 + 3)%3) * plane];
+      Conc *out = (t == depth) ? next + i*plane : 
+		&ring[(3*(t-1) + (i%3 + 3)%3) * plane];
+
+      sweepPlane(out, in[0], in[1], in[2], decay_factor, diff_factor);
+
+      if (t == depth)		// flags for plane i's rows
+        for (int r=0; r<rows; r++)
+          m_nextRowFlags[i*rows + r] = scanRow(out + r*len) | ROW_CHANGED;
     }
-  for (i=1; i<=sm_xsize; i++)
-    for (k=1; k<=sm_zsize; k++)
+}
+
+/************************************************************************ 
+ * sweepPlane()                                                         *
+ *   One explicit step for one x plane, given the old values of it and  *
+ *   its neighbor planes - same scheme as sweepSlab                     *
+ *                                                                      *
+ * Parameters                                                           *
+ *   Conc *out:			new values for the plane                *
+ *   const Conc *xm, *cur, *xp:	old values, planes i-1, i and i+1       *
+ *   double decay_factor:	decay rate * time step                  *
+ *   double diff_factor:	diffusion rate * time step / gridsize^2 *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Molecule::sweepPlane(Conc *out, const Conc *xm, const Conc *cur, 
+			  const Conc *xp, double decay_factor, 
+			  double diff_factor) const
+{
+  const int ny = m_ysize, nz = m_zsize;
+
+  if (nz == 1)		// essentially 2D - the plane is one row, along y
+  {
+    Stencil::Row5 row5 = Stencil::getRow5();
+    out[0] = Stencil::point5(cur, xm, xp, 0, ny-1, (ny>1) ? 1 : 0, 
+		      decay_factor, diff_factor);
+    row5(out, cur, xm, xp, ny, decay_factor, diff_factor);
+    if (ny > 1)
+      out[ny-1] = Stencil::point5(cur, xm, xp, ny-1, ny-2, 0, 
+			   decay_factor, diff_factor);
+    return;
+  }
+
+  Stencil::Row7 row7 = Stencil::getRow7();
+  for (int j=0; j<ny; j++)
+  {
+    int jm = (j == 0) ? ny-1 : j-1;
+    int jp = (j == ny-1) ? 0 : j+1;
+    const Conc *row = cur + j*nz;
+    const Conc *rxm = xm + j*nz, *rxp = xp + j*nz;
+    const Conc *ym = cur + jm*nz, *yp = cur + jp*nz;
+    Conc *rout = out + j*nz;
+
+    rout[0] = Stencil::point7(row, rxm, rxp, ym, yp, 0, nz-1, 1, 
+		       decay_factor, diff_factor);
+    row7(rout, row, rxm, rxp, ym, yp, nz, decay_factor, diff_factor);
+    rout[nz-1] = Stencil::point7(row, rxm, rxp, ym, yp, nz-1, nz-2, 0, 
+			  decay_factor, diff_factor);
+  }
+}
+
+/************************************************************************ 
+ * adiDecayDiff()                                                       *
+ *   Calculates changes in molecular concentration due to exponential	*
+ *   decay and diffusion over a whole time step, implicitly:  decay is  *
+ *   backward Euler, then diffusion is split into one backward-Euler    *
+ *   solve along each dimension in turn (locally one-dimensional ADI).  *
+ *   Each solve is a periodic tridiagonal system per line of grid       *
+ *   cells.  Unconditionally stable, and concentrations stay >= 0, but  *
+ *   only first-order accurate in time - large steps smear out peaks    *
+ *   somewhat faster than the explicit method would.                    *
+ *   (Crank-Nicolson is second order, but for large steps it rings,     *
+ *   giving negative concentrations near cells that secrete.)           *
+ *                                                                      *
+ * Parameters                                                           *
+ *   double deltaT:              duration of time step in seconds	*
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Molecule::adiDecayDiff(double deltaT)
+{
+  double decay_factor = 1 / (1 + m_decayRate*deltaT);
+  double r = m_diffusionRate*deltaT/m_gridsq;
+
+  const int nx = m_xsize, ny = m_ysize, nz = m_zsize;
+  Conc *conc = &m_concentration[0];
+
+  if (m_decayRate)
+    for (int n=0; n<m_concentration.size(); n++)
+      conc[n] *= decay_factor;
+
+  // x lines - stride ny*nz; all ny*nz of them solved together
+  if (nx > 1)
+  {
+    m_xline.setSystem(nx, r);
+    m_xline.solveLines(conc, ny*nz, ny*nz);
+  }
+
+  // y lines - stride nz; the nz lines in each x plane solved together
+  if (ny > 1)
+  {
+    m_yline.setSystem(ny, r);
+    for (int i=0; i<nx; i++)
+      m_yline.solveLines(conc+i*ny*nz, nz, nz);
+  }
+
+  // z lines - contiguous
+  if (nz > 1)
+  {
+    m_zline.setSystem(nz, r);
+    for (int n=0; n<nx*ny; n++)
+      m_zline.solve(conc+n*nz);
+  }
+}
+
+/************************************************************************ 
+ * spectralDecayDiff()                                                  *
+ *   Calculates changes in molecular concentration due to exponential	*
+ *   decay and diffusion over a whole time step, exactly:  the grid's   *
+ *   diffusion operator (the same 7-point Laplacian the explicit method *
+ *   uses) is diagonal in Fourier space, so each mode is just           *
+ *   multiplied by exp(-D*deltaT*lambda), and decay by exp(-k*deltaT).  *
+ *   The factor for a 3D mode is the product of one factor per          *
+ *   dimension, so this is done as a filter along each dimension in     *
+ *   turn.  Any step size gives the same answer as infinitely many      *
+ *   infinitely small explicit steps.                                   *
+ *                                                                      *
+ * Parameters                                                           *
+ *   double deltaT:              duration of time step in seconds	*
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Molecule::spectralDecayDiff(double deltaT)
+{
+  const int nx = m_xsize, ny = m_ysize, nz = m_zsize;
+  Conc *conc = &m_concentration[0];
+
+  if (m_decayRate)
+  {
+    double decay_factor = exp(-m_decayRate*deltaT);
+    for (int n=0; n<m_concentration.size(); n++)
+      conc[n] *= decay_factor;
+  }
+
+  // x lines - stride ny*nz, all adjacent
+  if (nx > 1)
+  {
+    setModeFactors(m_xfft, nx, deltaT);
+    spectralLines(m_xfft, conc, ny*nz, ny*nz);
+  }
+
+  // y lines - stride nz, adjacent within each x plane
+  if (ny > 1)
+  {
+    setModeFactors(m_yfft, ny, deltaT);
+    for (int i=0; i<nx; i++)
+      spectralLines(m_yfft, conc+i*ny*nz, nz, nz);
+  }
+
+  // z lines - contiguous, so filtered in place, two at a time
+  if (nz > 1)
+  {
+    setModeFactors(m_zfft, nz, deltaT);
+    int n;
+    for (n=0; n+1<nx*ny; n+=2)
+      m_zfft.filter(conc+n*nz, conc+(n+1)*nz, 1, &m_modeFactor[0]);
+    if (n < nx*ny)
+      m_zfft.filter(conc+n*nz, 0, 1, &m_modeFactor[0]);
+  }
+}
+
+/************************************************************************ 
+ * setModeFactors()                                                     *
+ *   Sets up an FFT for one dimension of spectralDecayDiff, and the     *
+ *   diffusion factor for each mode:  mode m of a periodic line of n    *
+ *   points has Laplacian eigenvalue -4 sin^2(pi m/n) / gridsize^2.     *
+ *                                                                      *
+ * Parameters                                                           *
+ *   FFT &fft:			transform for this dimension            *
+ *   int n:			number of points in each line           *
+ *   double deltaT:		duration of time step in seconds        *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Molecule::setModeFactors(FFT &fft, int n, double deltaT)
+{
+  fft.setSize(n);
+  m_modeFactor.resize(n);
+  double r = m_diffusionRate*deltaT/m_gridsq;
+  for (int m=0; m<n; m++)
+  {
+    double s = sin(M_PI*m/n);
+    m_modeFactor[m] = exp(-4*r*s*s);
+  }
+}
+
+/************************************************************************ 
+ * spectralLines()                                                      *
+ *   Filters strided lines for spectralDecayDiff.  Lines are copied a   *
+ *   block at a time into contiguous storage, so each strided read or   *
+ *   write brings in values for all lines of the block together.        *
+ *                                                                      *
+ * Parameters                                                           *
+ *   FFT &fft:			transform, set up by setModeFactors     *
+ *   Conc *first:		first point of first line               *
+ *   int stride:		distance between points in a line       *
+ *   int nlines:		number of lines (adjacent in memory)    *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Molecule::spectralLines(FFT &fft, Conc *first, int stride, int nlines)
+{
+  const int n = m_modeFactor.size();
+  m_spectralBlock.resize(SPECTRAL_BLOCK*n);
+  Conc *block = &m_spectralBlock[0];
+
+  for (int l=0; l<nlines; l+=SPECTRAL_BLOCK)
+  {
+    int nb = (nlines-l < SPECTRAL_BLOCK) ? nlines-l : SPECTRAL_BLOCK;
+    for (int i=0; i<n; i++)
+      for (int b=0; b<nb; b++)
+        block[b*n+i] = first[i*stride+l+b];
+
+    int b;
+    for (b=0; b+1<nb; b+=2)
+      fft.filter(block+b*n, block+(b+1)*n, 1, &m_modeFactor[0]);
+    if (b < nb)
+      fft.filter(block+b*n, 0, 1, &m_modeFactor[0]);
+
+    for (int i=0; i<n; i++)
+      for (int b=0; b<nb; b++)
+        first[i*stride+l+b] = block[b*n+i];
+  }
+}
+
+/************************************************************************ 
+ * rkcDecayDiff()                                                       *
+ *   Calculates changes in molecular concentration due to exponential	*
+ *   decay and diffusion, with damped Runge-Kutta-Chebyshev super steps *
+ *   (first order; Verwer, Hundsdorfer & Sommeijer 1990):  s stages,    *
+ *   each one explicit sweep combined with the stage before, so that    *
+ *   the whole step multiplies each mode by T_s(w0 + w1*z)/T_s(w0),     *
+ *   z being the mode's eigenvalue times the step and T_s the Chebyshev *
+ *   polynomial.  With the usual damping (w0 = 1 + RKC_LIGHT_DAMPING/   *
+ *   s^2) that's stable for steps about 0.9*s^2 times the explicit      *
+ *   limit, so a step that needs n explicit substeps takes about        *
+ *   sqrt(n) sweeps (so for slowly diffusing molecules it's no better). *
+ *   But stiff modes then only shrink to about 0.86 per super step, so  *
+ *   the spike a secreting cell leaves in one grid cell is barely       *
+ *   spread (and the negative values around it, set to 0, add to the    *
+ *   total).  So if there's been any such change since the last update  *
+ *   (see m_rkcRough), the whole update is damped with RKC_DAMPING,     *
+ *   which shrinks every stiff mode by at least 1/T_s(w0), about 1/250, *
+ *   but is stable only for steps about s^2/6 times the explicit limit. *
+ *   (Damping just the last super step isn't enough:  the stages all    *
+ *   commute, and it only reaches modes above about 10/s^2 of the       *
+ *   largest.)                                                          *
+ *   Not positivity preserving in general; any negative values left     *
+ *   are set to 0.  Every row is swept (no active threshold).           *
+ *   Stages alternate between m_concentration and the grid explicit     *
+ *   sweeps write into (see borrowScratch), so RKC needs no more memory *
+ *   than EXPLICIT.                                                     *
+ *                                                                      *
+ * Parameters                                                           *
+ *   double deltaT:              duration of time step in seconds	*
+ *                                                                      *
+ * Returns - the factor the total of all concentrations decayed by      *
+ *   (what the same steps do to a uniform field)                        *
+ ************************************************************************/
+double Molecule::rkcDecayDiff(double deltaT)
+{
+  // most negative eigenvalue of decay and diffusion on the grid; then 
+  // fewest stages that are stable for it, in as few super steps as need be
+  double lambda = 4*dims()*m_diffusionRate/m_gridsq + m_decayRate;
+  double damping = m_rkcRough ? RKC_DAMPING : RKC_LIGHT_DAMPING;
+  m_rkcRough = false;
+  int num_steps = 1, s;
+  double w0, w1;
+  for (;;)
+  {
+    for (s=1; s<=RKC_MAX_STAGES; s++)
     {
-      m_concentration.at(i,0,k) = m_concentration.at(i,sm_ysize,k);
-      m_concentration.at(i,sm_ysize+1,k) = m_concentration.at(i,1,k);
+      double deriv;
+      w0 = 1 + damping/(s*s);
+      w1 = chebyshev(s, w0, deriv) / deriv;
+      if ((1 + w0)/w1 >= lambda*deltaT/num_steps)	// w0+w1*z >= -1
+        break;
     }
-  for (i=1; i<=sm_xsize; i++)
-    for (j=1; j<=sm_ysize; j++)
+    if (s <= RKC_MAX_STAGES)
+      break;
+    num_steps++;
+  }
+  double tau = deltaT / num_steps;
+
+  // T_j(w0) for each stage
+  vector<double> t(s+1);
+  t[0] = 1;
+  t[1] = w0;
+  for (int j=2; j<=s; j++)
+    t[j] = 2*w0*t[j-1] - t[j-2];
+
+  double start = now();
+
+  int plane = m_ysize*m_zsize*sizeof(Conc);
+  int grain = SWEEP_CACHE_BYTES / plane;
+  if (grain < 1)
+    grain = 1;
+  borrowScratch();
+  Array3D<Conc> *grid[2];
+  grid[0] = &m_concentration;
+  grid[1] = m_deltaConc;
+
+  double factor = 1;			// a uniform field's decay
+  int cur = 0;				// grid holding the last stage
+  for (int n=0; n<num_steps; n++)
+  {
+    RkcStage st;
+    st.decay = m_decayRate*tau;
+    st.diff = m_diffusionRate*tau/m_gridsq;
+    st.prev1 = st.prev2 = &(*grid[cur])[0];
+    double y1 = 1, y2 = 1;		// uniform field
+    for (int j=1; j<=s; j++)
     {
-      m_concentration.at(i,j,0) = m_concentration.at(i,j,sm_zsize);
-      m_concentration.at(i,j,sm_zsize+1) = m_concentration.at(i,j,1);
+      st.mu = (j == 1) ? 1 : 2*w0*t[j-1]/t[j];
+      st.nu = (j == 1) ? 0 : -t[j-2]/t[j];
+      st.mu_t = (j == 1) ? w1/w0 : 2*w1*t[j-1]/t[j];
+      st.last = (j == s);
+      // the first stage needs a grid of its own; after that, each new 
+      // value only replaces the one from two stages back at its own 
+      // point, so it can go in that grid
+      st.out = &(*grid[1-cur])[0];
+
+      RkcTask task(this, st);
+      Scheduler::getInstance()->run(task, m_xsize, grain);
+
+      double y = (st.mu - st.mu_t*st.decay)*y1 + st.nu*y2;
+      y2 = y1;
+      y1 = y;
+      st.prev2 = st.prev1;
+      st.prev1 = st.out;
+      cur = 1-cur;
     }
+    factor *= y1;
+  }
+
+  if (cur != 0)
+    m_concentration.swap(*grid[cur]);
+  m_field = &m_concentration[0];
+  resetRowFlags();
+
+  sm_numSweeps += num_steps*s;
+  sm_sweepPoints += double(m_size)*num_steps*s;
+  sm_sweepSeconds += now() - start;
+  return factor;
+}
+
+/************************************************************************ 
+ * rkcSlab()                                                            *
+ *   One RKC stage (see RkcStage) for x planes [begin,end), in one pass *
+ *   per row.  Periodic boundaries as in sweepSlab, but written out     *
+ *   here:  the Stencil kernels require nonnegative results, and RKC's  *
+ *   intermediate stages can have negative values.                      *
+ *                                                                      *
+ * Parameters                                                           *
+ *   int begin, end:		x planes to do                          *
+ *   const RkcStage &st:	the stage                               *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Molecule::rkcSlab(int begin, int end, const RkcStage &st)
+{
+  const int nx = m_xsize, ny = m_ysize, nz = m_zsize;
+  const int plane = ny*nz;
+  // out = a*prev1 + diff*(sum of prev1's neighbors) + nu*prev2
+  const double diff = st.mu_t*st.diff;
+  const double a = st.mu - st.mu_t*st.decay - 2*dims()*diff, nu = st.nu;
+
+  for (int i=begin; i<end; i++)
+  {
+    const Conc *cur = st.prev1 + i*plane;
+    const Conc *xm = st.prev1 + wrapIndex(i-1, nx)*plane;
+    const Conc *xp = st.prev1 + wrapIndex(i+1, nx)*plane;
+    const Conc *old = st.prev2 + i*plane;
+    Conc *out = st.out + i*plane;
+
+    if (nz == 1)	// essentially 2D - the plane is one row, along y
+      for (int j=0; j<ny; j++)
+        out[j] = a*cur[j] + nu*old[j] + diff*(xm[j] + xp[j] 
+		 + cur[wrapIndex(j-1, ny)] + cur[wrapIndex(j+1, ny)]);
+    else
+      for (int j=0; j<ny; j++)
+      {
+        const Conc *row = cur + j*nz, *prow = old + j*nz;
+        const Conc *rxm = xm + j*nz, *rxp = xp + j*nz;
+        const Conc *ym = cur + wrapIndex(j-1, ny)*nz;
+        const Conc *yp = cur + wrapIndex(j+1, ny)*nz;
+        Conc *rout = out + j*nz;
+
+        // ends of the row wrap; the rest don't need to
+        rout[0] = a*row[0] + nu*prow[0] + diff*(rxm[0] + rxp[0] + ym[0] 
+		  + yp[0] + row[nz-1] + row[1]);
+        for (int k=1; k<nz-1; k++)
+          rout[k] = a*row[k] + nu*prow[k] + diff*(rxm[k] + rxp[k] + ym[k] 
+		    + yp[k] + row[k-1] + row[k+1]);
+        rout[nz-1] = a*row[nz-1] + nu*prow[nz-1] + diff*(rxm[nz-1] 
+		     + rxp[nz-1] + ym[nz-1] + yp[nz-1] + row[nz-2] + row[0]);
+      }
+
+    if (st.last)
+      for (int n=0; n<plane; n++)
+        if (out[n] < 0)
+          out[n] = 0;
+  }
 }
 
 /************************************************************************ 
- * setGuardCorners()                                                    *
- *   Copies concentration data to the corner guard layers missed by     *
- *   setGuards.                                                         *
- *                                                                      *
- * Parameters                                                           *
- *                                                                      *
- * Returns - nothing                                                    *
- ************************************************************************/
-void Molecule::setGuardCorners()           
-{
- // four edges in x direction
- for (int i=1; i<=sm_xsize; i++)
- {
-   m_concentration.at(i,0,0) = m_concentration.at(i,sm_ysize,sm_zsize);
-   m_concentration.at(i,0,sm_zsize+1) = m_concentration.at(i,sm_ysize,1);
-   m_concentration.at(i,sm_ysize+1,0) = m_concentration.at(i,1,sm_zsize);
-   m_concentration.at(i,sm_ysize+1,sm_zsize+1) = m_concentration.at(i,1,1);
- }
-
- // four edges in y direction
- for (int j=1; j<=sm_ysize; j++)
- {
-   m_concentration.at(0,j,0) = m_concentration.at(sm_xsize,j,sm_zsize);
-   m_concentration.at(0,j,sm_zsize+1) = m_concentration.at(sm_xsize,j,1);
-   m_concentration.at(sm_xsize+1,j,0) = m_concentration.at(1,j,sm_zsize);
-   m_concentration.at(sm_xsize+1,j,sm_zsize+1) = m_concentration.at(1,j,1);
- }
-
- // four edges in z direction
- for (int k=1; k<=sm_zsize; k++)
- {
-   m_concentration.at(0,0,k) = m_concentration.at(sm_xsize,sm_ysize,1);
-   m_concentration.at(0,sm_ysize+1,k) = m_concentration.at(sm_xsize,1,k);
-   m_concentration.at(sm_xsize+1,0,k) = m_concentration.at(1,sm_ysize,1);
-   m_concentration.at(sm_xsize+1,sm_ysize+1,k) = m_concentration.at(1,1,k);
- }
-
- // eight corners
- m_concentration.at(0,0,0) = m_concentration.at(sm_xsize,sm_ysize,sm_zsize);
- m_concentration.at(0,0,sm_zsize+1) = m_concentration.at(sm_xsize,sm_ysize,1);
- m_concentration.at(0,sm_ysize+1,0) = m_concentration.at(sm_xsize,1,sm_zsize);
- m_concentration.at(0,sm_ysize+1,sm_zsize+1)=m_concentration.at(sm_xsize,1,1);
- m_concentration.at(sm_xsize+1,0,0) = m_concentration.at(1,sm_ysize,sm_zsize);
- m_concentration.at(sm_xsize+1,0,sm_zsize+1)=m_concentration.at(1,sm_ysize,1);
- m_concentration.at(sm_xsize+1,sm_ysize+1,0)=m_concentration.at(1,1,sm_zsize);
- m_concentration.at(sm_xsize+1,sm_ysize+1,sm_zsize+1)=m_concentration.at(1,1,1);
-}
-
-/************************************************************************ 
- * setSpecificGuards()                                                  *
- *   Copies concentration data from a newly-changed array location      *
- *   to the appropriate guard layer locations (up to 7)                 *
- *                                                                      *
- * Parameters                                                           *
- *   int i,j,k:		Indices of changed concentration                *
- *                                                                      *
- * Returns - nothing                                                    *
- ************************************************************************/
-void Molecule::setSpecificGuards(int i, int j, int k)           
-{
-  assert(i>=1 && i<=sm_xsize && j>=1 && j<=sm_ysize && k>=1 && k<=sm_zsize);
-
-  Conc original = m_concentration.at(i,j,k);
-
-  // there must be a better way!
-  if (i == 1) {
-    m_concentration.at(sm_xsize+1, j, k) = original;      		// i
-    if (j == 1) {
-      m_concentration.at(sm_xsize+1, sm_ysize+1, k) = original; 	// i&j 
-      if (k == 1) {
-        m_concentration.at(i, sm_ysize+1, sm_zsize+1) = original; 	// j&k
-        m_concentration.at(sm_xsize+1,sm_ysize+1,sm_zsize+1) = original; // all
-	}	// end inner if k==1
-      if (k == sm_zsize) {
-        m_concentration.at(i, sm_ysize+1, 0) = original; 	// j&k
-        m_concentration.at(sm_xsize+1,sm_ysize+1,0) = original; // all
-	}	// end inner if k==zsize
-      }		// end if j==1
-    if (j == sm_ysize) {
-      m_concentration.at(sm_xsize+1, 0, k) = original; 			// i&j 
-      if (k == 1) {
-        m_concentration.at(i, 0, sm_zsize+1) = original; 		// j&k
-        m_concentration.at(sm_xsize+1, 0, sm_zsize+1) = original; 	// all
-	}	// end inner if k==1
-      if (k == sm_zsize) {
-        m_concentration.at(i, 0, 0) = original; 		// j&k
-        m_concentration.at(sm_xsize+1, 0, 0) = original; 	// all
-	}	// end inner if k==zsize
-      }		// end if j==ysize
-    if (k == 1) 
-      m_concentration.at(sm_xsize+1, j, sm_zsize+1) = original; 	// i&k
-    if (k == sm_zsize) 
-      m_concentration.at(sm_xsize+1, j, 0) = original; 	// i&k
-    }	// end if i==1
-  if (i == sm_xsize) {
-    m_concentration.at(0, j, k) = original;      			// i
-    if (j == 1) {
-      m_concentration.at(0, sm_ysize+1, k) = original; 			// i&j 
-      if (k == 1) {
-        m_concentration.at(i, sm_ysize+1, sm_zsize+1) = original; 	// j&k
-        m_concentration.at(0, sm_ysize+1, sm_zsize+1) = original; 	// all
-	}	// end inner if k==1
-      if (k == sm_zsize) {
-        m_concentration.at(i, sm_ysize+1, 0) = original; 	// j&k
-        m_concentration.at(0, sm_ysize+1, 0) = original; 	// all
-	}	// end inner if k==zsize
-      }		// end if j==1
-    if (j == sm_ysize) {
-      m_concentration.at(0, 0, k) = original;	 			// i&j 
-      if (k == 1) {
-        m_concentration.at(i, 0, sm_zsize+1) = original; 		// j&k
-        m_concentration.at(0, 0, sm_zsize+1) = original; 		// all
-	}	// end inner if k==1
-      if (k == sm_zsize) {
-        m_concentration.at(i, 0, 0) = original; 		// j&k
-        m_concentration.at(0, 0, 0) = original; 		// all
-	}	// end inner if k==zsize
-      }		// end if j==ysize
-    if (k == 1) 		// i still xsize, but j has middle value
-      m_concentration.at(0, j, sm_zsize+1) = original; 			// i&k
-    if (k == sm_zsize) 
-      m_concentration.at(0, j, 0) = original; 		// i&k
-    }	// end if i==xsize
-  if (j == 1)  { 		// but i may have a middle value
-    m_concentration.at(i, sm_ysize+1, k) = original;   			// j
-    if (k == 1) 
-      m_concentration.at(i, sm_ysize+1, sm_zsize+1) = original;		// j&k
-    if (k == sm_zsize) 
-      m_concentration.at(i, sm_ysize+1, 0) = original; 		// j&k
-    }		// end if j==1
-  if (j == sm_ysize) {	
-    m_concentration.at(i, 0, k) = original;       		// j
-    if (k == 1) 
-      m_concentration.at(i, 0, sm_zsize+1) = original;		// j&k
-    if (k == sm_zsize) 
-      m_concentration.at(i, 0, 0) = original; 			// j&k
-    }		// end if j==ysize
-  if (k == 1) 		
-    m_concentration.at(i, j, sm_zsize+1) = original;  		// k
-  if (k == sm_zsize) 	
-    m_concentration.at(i, j, 0) = original;  			// k
+ * steadyState()                                                        *
+ *   Sets concentrations to the steady state of decay and diffusion     *
+ *   with the sources of the last time step:                            *
+ *     D*laplacian(c) - k*c + s = 0                                     *
+ *   s being what cells secreted (or took up) since the last steady     *
+ *   state was written, divided by deltaT.  For molecules whose         *
+ *   diffusion equilibrates much faster than cells move, that's all the *
+ *   transient would come to.  Solved by multigrid (see Multigrid),     *
+ *   starting from the last solution, so usually in a V-cycle or two.   *
+ *   Negative values (from uptake) are set to 0.  Concentrations set    *
+ *   wholesale (initial or reset values) aren't sources - with no       *
+ *   secretion they're gone after one update.                           *
+ *                                                                      *
+ * Parameters                                                           *
+ *   double deltaT:              duration of time step in seconds	*
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Molecule::steadyState(double deltaT)
+{
+  assert(!m_refined);
+  double start = now();
+
+  applyScale();
+  m_steady.setSystem(m_xsize, m_ysize, m_zsize, m_decayRate, 
+		     m_diffusionRate/m_gridsq);
+  double *u = m_steady.getSolution();
+  Conc *conc = &m_concentration[0];
+  if (m_steadyRestart)
+  {
+    for (int n=0; n<m_size; n++)
+      u[n] = conc[n];
+    m_steadyRestart = false;
+  }
+
+  // source rates, in place of the concentrations (which the solution 
+  // replaces anyway)
+  for (int n=0; n<m_size; n++)
+    conc[n] = (conc[n] - ((u[n] < 0) ? 0 : u[n])) / deltaT;
+  sm_numCycles += m_steady.solve(conc, STEADY_TOLERANCE, STEADY_MAX_CYCLES);
+  for (int n=0; n<m_size; n++)
+    conc[n] = (u[n] < 0) ? 0 : u[n];
+
+  resumTotal();
+  resetRowFlags();
+
+  sm_numSolves++;
+  sm_solveSeconds += now() - start;
 }
 
 /************************************************************************ 
  * update()                                                             *
+ *   Advances the field by deltaT (see advance).  With an update        *
+ *   interval of k steps, deltaT is k steps, and cells see the field    *
+ *   from 0 to k-1 steps late.  If the field changed evenly over the    *
+ *   update, what they see just before the next one would be off from   *
+ *   the field updated every step by (k-1)/k of the change; that's      *
+ *   recorded for getLagBound.  It's a heuristic, not a measurement:    *
+ *   the change is only sampled (every LAG_SAMPLE_STRIDE'th grid cell), *
+ *   it's assumed even, and deposits left undiffused until the next     *
+ *   update (operator splitting at this cadence) aren't counted.        *
+ *                                                                      *
+ * Parameters                                                           *
+ *   double deltaT:              time since the last update (seconds)   *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Molecule::update(double deltaT)
+{
+  if (m_updateInterval == 1 || m_size == 1)
+  {
+    advance(deltaT);
+    return;
+  }
+
+  m_lagSample.resize((m_size + LAG_SAMPLE_STRIDE-1) / LAG_SAMPLE_STRIDE);
+  for (int n=0, s=0; n<m_size; n+=LAG_SAMPLE_STRIDE, s++)
+    m_lagSample[s] = value(n)*m_scale;
+
+  advance(deltaT);
+
+  double change = 0, norm = 0;
+  for (int n=0, s=0; n<m_size; n+=LAG_SAMPLE_STRIDE, s++)
+  {
+    Conc c = value(n)*m_scale;
+    change += (c - m_lagSample[s])*(c - m_lagSample[s]);
+    norm += c*c;
+  }
+  if (norm > 0)
+  {
+    double k = m_updateInterval;
+    double lag = sqrt(change/norm) * (k-1)/k;
+    m_lagSum += lag;
+    m_lagCount++;
+    if (lag > m_lagMax)
+      m_lagMax = lag;
+  }
+}
+
+/************************************************************************ 
+ * advance()                                                            *
  *   Eventually designed to implement all changes to molecules during   *
  *   one timestep:  molecular diffusion, decay, (maybe reactions later) *
- *   This assumes an explicit method for solving the diffusion         *
- *   equation and runs calculation multiple times at the appropriate    *
- *   time steps if necessary.                                           *
+ *   With the explicit solver, runs the calculation multiple times at   *
+ *   the appropriate time steps if necessary; with ADI or SPECTRAL,     *
+ *   once; with RKC, in as few super steps as are stable.  STEADY skips *
+ *   to the steady state.                                               *
  *                                                                      *
  * Parameters                                                           *
  *   double deltaT:              duration of time step in seconds	*
  *                                                                      *
  * Returns - nothing                                                    *
  ************************************************************************/
-void Molecule::update(double deltaT)
+void Molecule::advance(double deltaT)
 {
-  if ( !m_diffusionRate||sm_size==1 ) 	// don't need diffusion
+  assert(!m_bundled);		// MoleculeBundle does the update
+
+  if (m_solver == STEADY)
+  {
+    steadyState(deltaT);
+    return;
+  }
+
+  if (m_refined)
+  {
+    if (m_regridCount++ % REGRID_INTERVAL == 0)
+      m_refined->regrid(&m_concentration[0]);
+    m_refined->beginStep(&m_concentration[0]);
+  }
+
+  // diffusion doesn't change the total (space is periodic), so it just 
+  // decays by the factor each method applies
+  if (m_scale != 1 && m_diffusionRate && m_size > 1)
+    applyScale();		// solvers need actual concentrations
+  if ( !m_diffusionRate||m_size==1 ) 	// don't need diffusion
     if (!m_decayRate)
       return;			// nothing to update
     else
-      decay(deltaT);		// decay only
+    {
+      // decay only - the same factor for every grid cell, so unless 
+      // refined cells need it, just scale.  With an update interval, 
+      // deltaT is several time steps:  decay as if updated every step 
+      // (and never in steps so long they'd decay past 0)
+      int num_time_steps = int(m_decayRate*deltaT) + 1;
+      if (num_time_steps < m_updateInterval)
+        num_time_steps = m_updateInterval;
+      double factor = pow(1 - m_decayRate*deltaT/num_time_steps, 
+		          num_time_steps);
+      if (m_refined)
+        for (int i=0; i<num_time_steps; i++)
+          decay(deltaT/num_time_steps);
+      else
+      {
+        m_scale *= factor;
+        if (m_scale < MIN_DECAY_SCALE || m_scale > 1/MIN_DECAY_SCALE)
+          applyScale();
+      }
+      decayTotal(factor);
+    }
+  else if (m_solver == ADI)
+  {
+    adiDecayDiff(deltaT);
+    decayTotal(1 / (1 + m_decayRate*deltaT));
+  }
+  else if (m_solver == SPECTRAL)
+  {
+    spectralDecayDiff(deltaT);
+    decayTotal(exp(-m_decayRate*deltaT));
+  }
+  else if (m_solver == RKC)
+    decayTotal(rkcDecayDiff(deltaT));
   else
   { // diffusion
     // check time step against diffusion rate, choose appropriate number
     // of iterations for explicit method
-    // stability requirement:  deltaT <= (deltaX)^2/(2*numdim*D)
+    // stability requirement:  deltaT <= (deltaX)^2/(2*numdim*D); and
+    // for values to stay positive, 2*numdim*D*deltaT/(deltaX)^2 plus 
+    // decay rate*deltaT under 1 (which matters when the decay rate is 
+    // high, or deltaT is several time steps - see update)
     int i, num_time_steps;
 
-    if (sm_zsize==1)	// essentially 2D
-    {
-      num_time_steps = int(4*m_diffusionRate*deltaT/sm_gridsq) + 1;
-      for (i=0; i<num_time_steps; i++)
-        explicitDecayDiff2D(deltaT/num_time_steps);
-    }
+    if (m_zsize==1)	// essentially 2D
+      num_time_steps = int(4*m_diffusionRate*deltaT/m_gridsq 
+		      	   + m_decayRate*deltaT) + 1;
     else		// full 3D
+      num_time_steps = int(6*m_diffusionRate*deltaT/m_gridsq 
+		      	   + m_decayRate*deltaT) + 1;
+
+    // while few rows are active, sweep singly, skipping the others;
+    // then as many substeps as possible a block at a time, the rest singly
+    for (i=0; i<num_time_steps && getActiveFraction() < ACTIVE_FRACTION; 
+	 i++)
+      explicitDecayDiff(deltaT/num_time_steps);
+    int depth = getBlockDepth();
+    for ( ; num_time_steps-i >= 2 && depth >= 2; )
     {
-      num_time_steps = int(6*m_diffusionRate*deltaT/sm_gridsq) + 1;
-      for (i=0; i<num_time_steps; i++)
-        explicitDecayDiff3D(deltaT/num_time_steps);
+      int d = (num_time_steps-i < depth) ? num_time_steps-i : depth;
+      blockedDecayDiff(deltaT/num_time_steps, d);
+      i += d;
     }
+    for (; i<num_time_steps; i++)
+      explicitDecayDiff(deltaT/num_time_steps);
+    decayTotal(pow(1 - m_decayRate*deltaT/num_time_steps, num_time_steps));
+  }
+
+  if (m_refined)
+  {
+    m_total += m_refined->update(&m_concentration[0], m_diffusionRate, 
+		    		 m_decayRate, deltaT);
+    markRefinedRows();
+  }
+}
+
+/************************************************************************ 
+ * decayTotal()                                                         *
+ *   Multiplies the running total of all concentrations by the factor   *
+ *   one update's decay multiplied every grid cell by; every            *
+ *   TOTAL_RESUM_INTERVAL updates it's summed from the grid instead.    *
+ *   Not exact with an active threshold (rows left as they are don't    *
+ *   decay, or diffuse), but then not far off, and only until resummed. *
+ *                                                                      *
+ * Parameters                                                           *
+ *   double factor:		decay over the whole update             *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Molecule::decayTotal(double factor)
+{
+  if (++m_totalCount >= TOTAL_RESUM_INTERVAL)
+    resumTotal();
+  else
+    m_total *= factor;
+}
+
+/************************************************************************ 
+ * resumTotal()                                                         *
+ *   Sums all concentrations again, for the running total               *
+ *                                                                      *
+ * Parameters - none                                                    *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Molecule::resumTotal()
+{
+  Conc total = 0;
+  for (int n=0; n<m_size; n++)
+    total += value(n);
+  m_total = total*m_scale;
+  m_totalCount = 0;
+}
+
+/************************************************************************ 
+ * markRefinedRows()                                                    *
+ *   Marks rows under refined blocks active and changed - their coarse  *
+ *   values have just been set from the fine grid                       *
+ *                                                                      *
+ * Parameters - none                                                    *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Molecule::markRefinedRows()
+{
+  int i0, i1, j0, j1, k0, k1;
+  for (int n=0; n<m_refined->getNumBlocks(); n++)
+  {
+    m_refined->getCoarseBox(n, i0, i1, j0, j1, k0, k1);
+    for (int i=i0; i<i1; i++)
+      if (m_zsize == 1)
+        m_rowFlags[i] = ROW_ACTIVE | ROW_CHANGED;
+      else
+        for (int j=j0; j<j1; j++)
+          m_rowFlags[i*m_ysize + j] = ROW_ACTIVE | ROW_CHANGED;
   }
 }
 
@@ -707,25 +1639,29 @@ void Molecule::update(double deltaT)
 Molecule::Conc Molecule::getConc(const SimPoint &p) const
 {
   // find indices of grid cell to change - nearest grid point to p
-  int xi=1, yi=1, zi=1;		// default - only one grid cell
-  if (sm_gridsize)
+  int xi=0, yi=0, zi=0;		// default - only one grid cell
+  if (m_gridsize)
   {
-    assert(p.getX()>=0); assert(p.getX()<sm_gridsize*sm_xsize);
-    assert(p.getY()>=0); assert(p.getY()<sm_gridsize*sm_ysize);
-    assert(p.getZ()>=0); assert(p.getZ()<sm_gridsize*sm_zsize);
-    xi = int(p.getX()/sm_gridsize+1);
-    yi = int(p.getY()/sm_gridsize+1);
-    zi = int(p.getZ()/sm_gridsize+1);
+    assert(p.getX()>=0); assert(p.getX()<m_gridsize*m_xsize);
+    assert(p.getY()>=0); assert(p.getY()<m_gridsize*m_ysize);
+    assert(p.getZ()>=0); assert(p.getZ()<m_gridsize*m_zsize);
+    xi = int(p.getX()/m_gridsize);
+    yi = int(p.getY()/m_gridsize);
+    zi = int(p.getZ()/m_gridsize);
   }
 
-  return m_concentration.at( xi, yi, zi );
+  Conc c;
+  if (m_refined && m_refined->getConc(p, c))
+    return c;
+  return value(index(xi, yi, zi))*m_scale;
 }
 
 /************************************************************************ 
  * getInterpConc()                                                      *
  *   Returns the molecular concentration at a specific location.        *
- *   Relies on linear interpolation function in Array3D.                *
- *   This version not const because it needs to set guard layers.       *
+ *   Linear interpolation between the centers of the 8 surrounding grid *
+ *   cells (4 in 2D), wrapping around the periodic boundaries - see     *
+ *   interpConc.                                                        *
  *                                                                      *
  * Parameters                                                           *
  *   const SimPoint &p:         grid location                       	*
@@ -738,29 +1674,81 @@ Molecule::Conc Molecule::getInterpConc(const SimPoint &p) const
   // be up to half a grid cell outside of normal sim boundaries
   // interpolation valid for points from -gridsize/2 to range+gridsize/2
   // (we're assuming concentrations stored represent values at the centers
-  // of the indexed grid cells, but interpolation uses those points as
-  // 'corners')
-  double halfgrid = 0.5*sm_gridsize;
-  assert(p.getX()>=-halfgrid); assert(p.getX()<sm_gridsize*sm_xsize+halfgrid);
-  assert(p.getY()>=-halfgrid); assert(p.getY()<sm_gridsize*sm_ysize+halfgrid);
-  assert(p.getZ()>=-halfgrid); assert(p.getZ()<sm_gridsize*sm_zsize+halfgrid);
+  // of the indexed grid cells)
+  double halfgrid = 0.5*m_gridsize;
+  assert(p.getX()>=-halfgrid); assert(p.getX()<m_gridsize*m_xsize+halfgrid);
+  assert(p.getY()>=-halfgrid); assert(p.getY()<m_gridsize*m_ysize+halfgrid);
+  assert(p.getZ()>=-halfgrid); assert(p.getZ()<m_gridsize*m_zsize+halfgrid);
 
   // if only 1 grid cell, no reason to interpolate
-  if (sm_size == 1)
-    return m_concentration.at(1, 1, 1);
+  if (m_size == 1)
+    return value(0)*m_scale;
 
-  // find 'fractional indices' that interpolation routine uses
-  // given that indices of (-halfgrid, -halfgrid, -halfgrid) are (0,0,0)
-  double fix = p.getX()/sm_gridsize + 0.5;
-  double fiy = p.getY()/sm_gridsize + 0.5;
-  double fiz = p.getZ()/sm_gridsize + 0.5;
+  Conc c;
+  if (m_refined && m_refined->getInterpConc(p, c))
+    return c;
 
-  return m_concentration.interpolate(fix, fiy, fiz);
+  return (this->*m_interpConc)(p);
+}
+
+/************************************************************************ 
+ * interpConc<DIMS>()                                                   *
+ *   Linear interpolation for getInterpConc:  between the centers of    *
+ *   the 8 surrounding grid cells, or the 4 surrounding ones in the     *
+ *   only layer for DIMS 2, wrapping around the periodic boundaries.    *
+ *                                                                      *
+ * Parameters                                                           *
+ *   const SimPoint &p:         grid location                       	*
+ *                                                                      *
+ * Returns - concentration                                              *
+ ************************************************************************/
+template<int DIMS>
+Molecule::Conc Molecule::interpConc(const SimPoint &p) const
+{
+  // 'fractional indices', offset by one so they're never negative:
+  // center of grid cell i is at i+1, and the point at -halfgrid is at 0
+  double fix = p.getX()/m_gridsize + 0.5;
+  double fiy = p.getY()/m_gridsize + 0.5;
+
+  // grid cells on either side, wrapped; interpolation parameters
+  int xi = int(fix); int yi = int(fiy);
+  double fx = fix - xi; double fy = fiy - yi;
+  int x0 = wrapIndex(xi-1, m_xsize), x1 = wrapIndex(xi, m_xsize);
+  int y0 = wrapIndex(yi-1, m_ysize), y1 = wrapIndex(yi, m_ysize);
+
+  Conc c;
+  if (DIMS == 2)
+  {
+    // interpolate - using 4 known values surrounding unknown value
+    c = (1-fx)*(1-fy)*value(index(x0,y0,0));
+    c += fx*(1-fy)*value(index(x1,y0,0));
+    c += fx*fy*value(index(x1,y1,0));
+    c += (1-fx)*fy*value(index(x0,y1,0));
+    return c*m_scale;
+  }
+
+  double fiz = p.getZ()/m_gridsize + 0.5;
+  int zi = int(fiz);
+  double fz = fiz - zi;
+  int z0 = wrapIndex(zi-1, m_zsize), z1 = wrapIndex(zi, m_zsize);
+
+  // interpolate - using 8 known values surrounding unknown value
+  c = (1-fx)*(1-fy)*(1-fz)*value(index(x0,y0,z0));
+  c += fx*(1-fy)*(1-fz)*value(index(x1,y0,z0));
+  c += fx*fy*(1-fz)*value(index(x1,y1,z0));
+  c += (1-fx)*fy*(1-fz)*value(index(x0,y1,z0));
+  c += (1-fx)*(1-fy)*fz*value(index(x0,y0,z1));
+  c += fx*(1-fy)*fz*value(index(x1,y0,z1));
+  c += fx*fy*fz*value(index(x1,y1,z1));
+  c += (1-fx)*fy*fz*value(index(x0,y1,z1));
+
+  return c*m_scale;
 }
 
 /************************************************************************ 
  * getAvgConc()                                                         *
- *   Calculates average concentration over all indices                  *
+ *   Average concentration over all indices, from the running total     *
+ *   (see decayTotal) - doesn't depend on grid size                     *
  *                                                                      *
  * Parameters - none                                                    *
  *                                                                      *
@@ -768,17 +1756,77 @@ Molecule::Conc Molecule::getInterpConc(const SimPoint &p) const
  ************************************************************************/
 Molecule::Conc Molecule::getAvgConc() const
 {
-  Molecule::Conc total=0.0;
-  Molecule::Conc average;
+  return m_total/m_size;
+}
 
-  for (int i=1; i<=sm_xsize; i++)
-    for (int j=1; j<=sm_ysize; j++)
-      for (int k=1; k<=sm_zsize; k++)
-        total += m_concentration.at(i,j,k);
+/************************************************************************ 
+ * getConc()                                                            *
+ *   Returns all concentrations, as an array.  If this molecule is part *
+ *   of a MoleculeBundle, they're copied out of the bundle first.       *
+ *                                                                      *
+ * Parameters - none                                                    *
+ *                                                                      *
+ * Returns - concentrations (moles/ml)                                  *
+ ************************************************************************/
+const Array3D<Molecule::Conc>& Molecule::getConc()
+{
+  if (m_bundled)
+    for (int n=0; n<m_size; n++)
+      m_concentration[n] = value(n);
+  else
+    applyScale();
+  return m_concentration;
+}
 
-  average = total/sm_size;		
+/************************************************************************ 
+ * setField()                                                           *
+ *   Switches concentration storage to a MoleculeBundle's interleaved   *
+ *   array, or back to m_concentration.  Doesn't copy values - the      *
+ *   bundle does that.                                                  *
+ *                                                                      *
+ * Parameters                                                           *
+ *   Conc *field:		this molecule's first value in bundle,  *
+ *				or 0 to go back to m_concentration      *
+ *   int stride:		distance between values in bundle       *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Molecule::setField(Conc *field, int stride)
+{
+  if (field)
+  {
+    assert(stride>0);
+    m_field = field;
+    m_stride = stride;
+    m_bundled = true;
+  }
+  else
+  {
+    m_field = &m_concentration[0];
+    m_stride = 1;
+    m_bundled = false;
+    if (m_pool)			// flags may be stale; start over
+      m_pool->release(this);
+    m_rowFlags.assign(getNumRows(), ROW_ACTIVE | ROW_CHANGED);
+  }
+}
 
-  return average;
+/************************************************************************ 
+ * applyScale()                                                         *
+ *   Multiplies stored concentrations by the decay scale (see m_scale), *
+ *   so they're the actual concentrations again                         *
+ *                                                                      *
+ * Parameters - none                                                    *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Molecule::applyScale()
+{
+  if (m_scale == 1)
+    return;
+  for (int n=0; n<m_size; n++)
+    m_field[n*m_stride] *= m_scale;
+  m_scale = 1;
 }
 
 /************************************************************************ 
@@ -805,6 +1853,8 @@ int Molecule::getNumMolecules(double volume, const SimPoint &pos) const
  *   Returns the concentration gradient at a specific location          *
  *   This version samples the concentration at a specified distance r   *
  *   in each direction (6) from the specified point.			*
+ *   If the gradient is cached (and has been updated), it's             *
+ *   interpolated from that instead, and r isn't used.                  *
  *                                                                      *
  * Parameters                                                           *
  *   const SimPoint &p:         grid location                       	*
@@ -814,20 +1864,23 @@ int Molecule::getNumMolecules(double volume, const SimPoint &pos) const
 SimPoint Molecule::getGradient(const SimPoint &pos, double r) const
 {
   // if there is only 1 grid cell, gradient always 0
-  if (sm_size == 1) 
+  if (m_size == 1) 
     return (SimPoint(0,0,0));
 
-  assert(pos.getX()>=0); assert(pos.getX()<sm_gridsize*sm_xsize);
-  assert(pos.getY()>=0); assert(pos.getY()<sm_gridsize*sm_ysize);
-  assert(pos.getZ()>=0); assert(pos.getZ()<sm_gridsize*sm_zsize);
-  assert(r>0); assert(r<=sm_gridsize/2.0);
+  assert(pos.getX()>=0); assert(pos.getX()<m_gridsize*m_xsize);
+  assert(pos.getY()>=0); assert(pos.getY()<m_gridsize*m_ysize);
+  assert(pos.getZ()>=0); assert(pos.getZ()<m_gridsize*m_zsize);
+  assert(r>0); assert(r<=m_gridsize/2.0);
+
+  if (m_gradientValid)
+    return getCachedGradient(pos);
 
   Conc x = getInterpConc( pos + SimPoint(r,0,0) ) 
 	- getInterpConc( pos + SimPoint(-r,0,0) );
   Conc y = getInterpConc( pos + SimPoint(0,r,0) ) 
 	- getInterpConc( pos + SimPoint(0,-r,0) );
   Conc z = 0;
-  if (sm_zsize > 1)
+  if (m_zsize > 1)
     z = getInterpConc( pos + SimPoint(0,0,r) )
 	- getInterpConc( pos + SimPoint(0,0,-r) );
 
@@ -835,21 +1888,177 @@ SimPoint Molecule::getGradient(const SimPoint &pos, double r) const
   return (SimPoint(x,y,z)*scale);
 }
 
+/************************************************************************ 
+ * getCachedGradient()                                                  *
+ *   Gradient at a specific location - linear interpolation between the *
+ *   gradients at the centers of the 8 surrounding grid cells (see      *
+ *   updateGradient), wrapping around the periodic boundaries           *
+ *                                                                      *
+ * Parameters                                                           *
+ *   const SimPoint &p:         grid location                       	*
+ *                                                                      *
+ * Returns - gradient (moles/ml per micron)                             *
+ ************************************************************************/
+SimPoint Molecule::getCachedGradient(const SimPoint &p) const
+{
+  assert(m_gradientValid);
+  return (this->*m_cachedGradient)(p);
+}
+
+/************************************************************************ 
+ * cachedGradient<DIMS>()                                               *
+ *   Interpolation for getCachedGradient, as in interpConc:  8 grid     *
+ *   points, or 4 for DIMS 2 (z component is 0 there anyway)            *
+ *                                                                      *
+ * Parameters                                                           *
+ *   const SimPoint &p:         grid location                       	*
+ *                                                                      *
+ * Returns - gradient (moles/ml per micron)                             *
+ ************************************************************************/
+template<int DIMS>
+SimPoint Molecule::cachedGradient(const SimPoint &p) const
+{
+  // as in getInterpConc:  'fractional indices', offset by one
+  double fix = p.getX()/m_gridsize + 0.5;
+  double fiy = p.getY()/m_gridsize + 0.5;
+  int xi = int(fix); int yi = int(fiy);
+  double fx = fix - xi; double fy = fiy - yi;
+  int x[2] = { wrapIndex(xi-1, m_xsize), wrapIndex(xi, m_xsize) };
+  int y[2] = { wrapIndex(yi-1, m_ysize), wrapIndex(yi, m_ysize) };
+  double wx[2] = { 1-fx, fx }, wy[2] = { 1-fy, fy };
+
+  if (DIMS == 2)
+  {
+    // x and y components only
+    double g[2] = { 0, 0 };
+    for (int a=0; a<2; a++)
+      for (int b=0; b<2; b++)
+      {
+        double w = wx[a]*wy[b];
+        const double *pg = &m_gradient[3*index(x[a], y[b], 0)];
+        g[0] += w*pg[0];
+        g[1] += w*pg[1];
+      }
+    return SimPoint(g[0], g[1], 0);
+  }
+
+  double fiz = p.getZ()/m_gridsize + 0.5;
+  int zi = int(fiz);
+  double fz = fiz - zi;
+  int z[2] = { wrapIndex(zi-1, m_zsize), wrapIndex(zi, m_zsize) };
+  double wz[2] = { 1-fz, fz };
+
+  // interpolate all 3 components together
+  double g[3] = { 0, 0, 0 };
+  for (int a=0; a<2; a++)
+    for (int b=0; b<2; b++)
+      for (int c=0; c<2; c++)
+      {
+        double w = wx[a]*wy[b]*wz[c];
+        const double *pg = &m_gradient[3*index(x[a], y[b], z[c])];
+        g[0] += w*pg[0];
+        g[1] += w*pg[1];
+        g[2] += w*pg[2];
+      }
+
+  return SimPoint(g[0], g[1], g[2]);
+}
+
+/************************************************************************ 
+ * updateGradient()                                                     *
+ *   If the gradient is cached, works it out at every grid point from   *
+ *   the current concentrations:  central differences between the      *
+ *   neighbors on either side, wrapping around the periodic boundaries. *
+ *   Slabs of x planes are done in parallel by the Scheduler.           *
+ *                                                                      *
+ * Parameters - none                                                    *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Molecule::updateGradient()
+{
+  if (!m_cacheGradient || m_refined || m_size == 1)
+    return;
+
+  try {
+    m_gradient.resize(3*m_size);
+  }
+  catch(std::bad_alloc&) {
+    cerr << "not enough memory to set up molecular gradient data" << endl;
+    abort();
+  }
+
+  int plane = m_ysize*m_zsize*(3+m_stride)*sizeof(double);
+  int grain = SWEEP_CACHE_BYTES / plane;
+  if (grain < 1)
+    grain = 1;
+  GradientTask task(this);
+  Scheduler::getInstance()->run(task, m_xsize, grain);
+  m_gradientValid = true;
+}
+
+/************************************************************************ 
+ * gradientSlab()                                                       *
+ *   Gradient at the grid points in x planes [begin,end) - see          *
+ *   updateGradient.  Neighbor rows in x and y are chosen with wrapping *
+ *   once per row; along each row the first and last points are peeled  *
+ *   off so the rest need no wrapping.                                  *
+ *                                                                      *
+ * Parameters                                                           *
+ *   int begin, end:		range of x indices                      *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Molecule::gradientSlab(int begin, int end)
+{
+  const int ny = m_ysize, nz = m_zsize, s = m_stride;
+  const double scale = m_scale / (2.0*m_gridsize);
+
+  for (int i=begin; i<end; i++)
+    for (int j=0; j<ny; j++)
+    {
+      const Conc *row = &value(index(i, j, 0));
+      const Conc *xm = &value(index(wrapIndex(i-1, m_xsize), j, 0));
+      const Conc *xp = &value(index(wrapIndex(i+1, m_xsize), j, 0));
+      const Conc *ym = &value(index(i, wrapIndex(j-1, ny), 0));
+      const Conc *yp = &value(index(i, wrapIndex(j+1, ny), 0));
+      double *g = &m_gradient[3*index(i, j, 0)];
+
+      for (int k=0; k<nz; k++)
+      {
+        g[3*k] = (xp[k*s] - xm[k*s])*scale;
+        g[3*k+1] = (yp[k*s] - ym[k*s])*scale;
+      }
+
+      if (nz == 1)
+        g[2] = 0;		// 2D
+      else
+      {
+        g[2] = (row[s] - row[(nz-1)*s])*scale;
+        for (int k=1; k<nz-1; k++)
+          g[3*k+2] = (row[(k+1)*s] - row[(k-1)*s])*scale;
+        g[3*(nz-1)+2] = (row[0] - row[(nz-2)*s])*scale;
+      }
+    }
+}
+
 /************************************************************************ 
  * printConc()                                                          *
  *   Prints list of 3D indices and associated concentrations            *
+ *   (indices printed starting from 1)                                  *
  *                                                                      *
  * Parameters - none                                                    *
  *                                                                      *
  * Returns - nothing                                                    *
  ************************************************************************/
-void Molecule::printConc() const
+void Molecule::printConc()
 {
-  for (int i=1; i<=sm_xsize; i++)
-    for (int j=1; j<=sm_ysize; j++)
-      for (int k=1; k<=sm_zsize; k++)
-        cout << i << "\t" << j << "\t" << k << "\t" 
-	     << m_concentration.at(i,j,k) << endl;
+  applyScale();
+  for (int i=0; i<m_xsize; i++)
+    for (int j=0; j<m_ysize; j++)
+      for (int k=0; k<m_zsize; k++)
+        cout << i+1 << "\t" << j+1 << "\t" << k+1 << "\t" 
+	     << value(index(i,j,k)) << endl;
 }
 
 /************************************************************************ 
@@ -865,6 +2074,24 @@ void Molecule::writeDefinition(ofstream &outfile) const
 {
     outfile << "molecule_type " << m_name << "{" << endl;
     outfile << "diffusion_rate " << m_diffusionRate << endl;
+    if (m_solver == ADI)
+      outfile << "solver adi" << endl;
+    else if (m_solver == SPECTRAL)
+      outfile << "solver spectral" << endl;
+    else if (m_solver == RKC)
+      outfile << "solver rkc" << endl;
+    else if (m_solver == STEADY)
+      outfile << "solver steady" << endl;
+    if (m_activeThreshold)
+      outfile << "active_threshold " << m_activeThreshold << endl;
+    if (m_refineRatio > 1)
+      outfile << "refine " << m_refineRatio << endl;
+    if (m_cacheGradient)
+      outfile << "gradient cached" << endl;
+    if (m_resolution >= 0)
+      outfile << "resolution " << m_resolution << endl;
+    if (m_updateInterval > 1)
+      outfile << "update_interval " << m_updateInterval << endl;
     outfile << "decay_rate " << m_decayRate << endl << "}" << endl;
 }
 
@@ -877,14 +2104,47 @@ void Molecule::writeDefinition(ofstream &outfile) const
  *                                                                      *
  * Returns - nothing                                                    *
  ************************************************************************/
-void Molecule::writeData(ofstream &outfile) const
+void Molecule::writeData(ofstream &outfile)
 {
   outfile << "molecule_detail: " << m_name << endl;
 
-  for (int i=1; i<=sm_xsize; i++)
-    for (int j=1; j<=sm_ysize; j++)
-      for (int k=1; k<=sm_zsize; k++)
-        outfile << m_concentration.at(i,j,k) << "\t";
+  applyScale();
+  for (int n=0; n<m_size; n++)
+    outfile << value(n) << "\t";
   outfile << endl;
 }
     
+
+/************************************************************************ 
+ * printStats()                                                         *
+ *   Prints number and total time of explicit diffusion sweeps, and     *
+ *   the memory bandwidth achieved, counting only the traffic a sweep   *
+ *   can't avoid:  one read of the old and one write of the new value   *
+ *   per grid point.  (Write-allocate adds another read on most         *
+ *   machines.)  A rate near the machine's stream bandwidth means the   *
+ *   sweeps are memory bound.  Temporally blocked substeps (see         *
+ *   blockedDecayDiff) are counted as if each were a full sweep, so     *
+ *   with blocking the rate can be well above stream bandwidth.         *
+ *                                                                      *
+ * Parameters -                                                         *
+ *   ostream &s:		where to print                          *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Molecule::printStats(ostream &s)
+{
+  if (sm_numSolves)
+    s << "steady state:  " << sm_numSolves << " solves, " << sm_numCycles 
+      << " V-cycles, " << sm_solveSeconds << " s" << endl;
+  if (!sm_numSweeps)
+    return;
+
+  double bytes = 2*sizeof(Conc)*sm_sweepPoints;
+  s << "explicit diffusion (" << Stencil::getName() << "):  " 
+    << sm_numSweeps << " sweeps, " 
+    << sm_sweepSeconds << " s, ";
+  if (sm_sweepSeconds > 0)
+    s << bytes/sm_sweepSeconds/1e9 << " GB/s";
+  s << endl;
+}
+    
@@ -33,32 +33,138 @@
 #include <fstream>			// for file I/O
 #include <cassert>
 #include "array3D.h"
+#include "tridiag.h"
+#include "fft.h"
+#include "multigrid.h"
+#include "refinedField.h"
+#include "scratchPool.h"
 class SimPoint;        
 
+// model size in microns (each dimension) assumed until Tissue sets the 
+// geometry - the same as its default
+#define DEFAULT_RANGE 1000
+
+// bytes of grid data an explicit sweep chunk should work on at once - 
+// about the size of a (per-core) L2 cache
+#define SWEEP_CACHE_BYTES (256*1024)
+
+// bytes of intermediate planes a temporally blocked sweep may keep 
+// (see Molecule::blockedSlab) - about a core's share of last-level cache, 
+// and the most substeps it does at once
+#define BLOCK_CACHE_BYTES (2*1024*1024)
+#define MAX_BLOCK_DEPTH 8
+
+// explicit sweeps skip inactive rows (see setActiveThreshold) only while
+// fewer than this fraction of rows need updating; otherwise the whole 
+// grid is done, temporally blocked
+#define ACTIVE_FRACTION 0.5
+
+// the running total behind getAvgConc is summed over again from the grid 
+// every this many updates, so rounding (and the approximations noted at 
+// decayTotal) can't build up
+#define TOTAL_RESUM_INTERVAL 100
+
+// the lag bound for molecules updated every few steps (see Molecule::
+// update) compares every this many grid cells before and after an 
+// update - enough for a rough figure, without copying the whole field
+#define LAG_SAMPLE_STRIDE 17
+
+// decay-only molecules keep a scale factor instead of decaying every grid
+// cell each step (see m_scale); values are multiplied out again once it 
+// gets this small (or its inverse this big)
+#define MIN_DECAY_SCALE 1e-30
+
+// most stages an RKC super step may take - a time step needing more is 
+// split into several super steps (the stable step grows as stages^2, so
+// more would only add rounding error) - and its damping:  the usual 
+// light damping, and heavy damping for updates after deposits (see 
+// Molecule::rkcDecayDiff)
+#define RKC_MAX_STAGES 32
+#define RKC_LIGHT_DAMPING (2.0/13)
+#define RKC_DAMPING 20.0
+
+// steady-state solves stop when the residual is this fraction of the 
+// sources, or after this many V-cycles (see Molecule::steadyState)
+#define STEADY_TOLERANCE 1e-6
+#define STEADY_MAX_CYCLES 20
+
+#define SPECTRAL_BLOCK 8		// lines gathered at once (8 doubles 
+					// is a typical cache line)
+
 using namespace std;
 
 class Molecule {
   public:
     typedef double Conc;
 
+    // how diffusion is calculated:  EXPLICIT takes as many substeps as 
+    // stability requires; ADI does one implicit (backward Euler) solve 
+    // per dimension per step, regardless of diffusion rate; SPECTRAL 
+    // solves exactly in Fourier space, for any step size; RKC takes 
+    // explicit super steps (Runge-Kutta-Chebyshev), each s sweeps long 
+    // but as stable as about 0.9*s^2 explicit substeps (s^2/6 in steps 
+    // after deposits, which need more damping); STEADY doesn't follow 
+    // the transient at all, but sets concentrations to the steady state
+    // for the secretion and uptake since the last update (for molecules 
+    // that equilibrate much faster than cells change)
+    enum Solver {EXPLICIT, ADI, SPECTRAL, RKC, STEADY};
+
     //--------------------------- CREATORS --------------------------------- 
     explicit Molecule(const string& title);
     Molecule(const string& title, double diff, double decay);
     // copy constructor not used
-    // ~Molecule();				// use default destructor
+    ~Molecule();
 
     //------------------------- MANIPULATORS -------------------------------
     // assignment not used
 
-    // set number and size of grid cells used by all Molecule objects
-    // MUST CALL initialize() for each Molecule object after calling setGeometry
-    static void setGeometry(int xrange, int yrange, int zrange, int gridsize);
+    // set number and size of grid cells for this molecule type (Tissue 
+    // does this, with getResolution if set, otherwise its own)
+    // MUST CALL initialize() after calling setGeometry
+    void setGeometry(int xrange, int yrange, int zrange, int gridsize);
 
     void initialize();		// allocates memory for concentration arrays
 
+    // borrow the grid updates write new values into from this pool 
+    // (Tissue's), instead of having one of its own; call before initialize
+    void setScratchPool(ScratchPool *pool) {m_pool = pool;};
+
     // set diffusion and decay parameters
     void setDiffRate(double rate) {assert(rate>=0); m_diffusionRate = rate;};
     void setDecayRate(double rate) {m_decayRate = rate;};
+    void setSolver(Solver solver) {m_solver = solver;};
+
+    // explicit solver only:  a row of grid cells (along z in 3D, y in 2D)
+    // whose concentrations are all at or below the threshold, as are its
+    // neighbor rows', is left as it is.  With the default threshold of 0 
+    // this doesn't change results - such rows are all 0, and would stay 0.
+    void setActiveThreshold(Conc threshold)
+    	{assert(threshold>=0); m_activeThreshold = threshold;};
+
+    // refine parts of the grid by this ratio (see RefinedField); 1 for 
+    // none.  Takes effect at initialize().
+    void setRefinement(int ratio) {assert(ratio>=1); m_refineRatio = ratio;};
+
+    // cached gradient:  getGradient interpolates between central 
+    // differences at the grid points, computed once per step by 
+    // updateGradient, instead of differencing interpolated concentrations
+    // (see getGradient).  Not used for refined molecules.
+    void setCachedGradient(bool flag) 
+    	{m_cacheGradient = flag; m_gradientValid = false;};
+    void updateGradient();
+
+    // grid cell size (microns) to use instead of the model's; -1 for 
+    // the model's.  Cells sense and secrete wherever they are, whatever 
+    // the grid.
+    void setResolution(int gridsize) 
+    	{assert(gridsize>=-1); m_resolution = gridsize;};
+
+    // update only every this many cell steps (Tissue does the counting, 
+    // and passes the time since the last update); deposits in between 
+    // are just added to the field as usual.  Cells see a field up to 
+    // steps-1 time steps old, which getLagBound gives a rough idea of.
+    void setUpdateInterval(int steps) 
+    	{assert(steps>=1); m_updateInterval = steps;};
 
     // setting initial concentrations - measured in moles/ml
     void setUniformConc(Conc amount, double stddev=0);	
@@ -68,6 +174,13 @@ class Molecule {
     // for secretion or binding by cells
     void changeConc(double amount, const SimPoint &p);  
 
+    // in deferred (accumulation) mode changeConc only adds to a deposit 
+    // grid; applyChanges adds all deposits to the field at once, with 
+    // concentrations not allowed to go below 0 (required for synchronous
+    // cell updates, optional otherwise)
+    void setDeferChanges(bool flag);
+    void applyChanges();
+
     void update(double deltaT);
 
     //--------------------------- ACCESSORS --------------------------------
@@ -76,58 +189,218 @@ class Molecule {
     const string& getName() const {return m_name;};
     double getDiffRate() const {return m_diffusionRate;};
     double getDecayRate() const {return m_decayRate;};
+    Solver getSolver() const {return m_solver;};
+    Conc getActiveThreshold() const {return m_activeThreshold;};
+    int getRefinement() const {return m_refineRatio;};
+    bool isRefined() const {return m_refined != 0;};
+    bool hasCachedGradient() const {return m_cacheGradient;};
+    int getResolution() const {return m_resolution;};
+    int getGridSize() const {return m_gridsize;};
+    int getUpdateInterval() const {return m_updateInterval;};
+
+    // with an update interval:  a heuristic bound on how far the field 
+    // cells see is from the one they'd see if it was updated every step,
+    // as a fraction of it (L2 norms, from a sample of grid cells) - 
+    // average and largest over updates.  Not checked against updating 
+    // every step; see update for what it leaves out.
+    double getLagBound() const 
+    	{return m_lagCount ? m_lagSum/m_lagCount : 0;};
+    double getMaxLagBound() const {return m_lagMax;};
 
     // getting concentrations - measured in moles/ml
     Conc getConc(const SimPoint &pos) const;	// from nearest grid point   
-    Conc getInterpConc(const SimPoint &pos) const;	// using 8 grid points
+    Conc getInterpConc(const SimPoint &pos) const;	// using 8 (2D: 4) points
     Conc getAvgConc() const;
     SimPoint getGradient(const SimPoint &pos, double r) const;
 
-    // note that indices to real data from this 3D array should start at 1
-    const Array3D<Conc>& getConc() const {return m_concentration;};
+    // indices start at 0; there are no guard layers (space is periodic)
+    // (applies the decay scale, and copies out of a bundle, first)
+    const Array3D<Conc>& getConc();
+    bool isBundled() const {return m_bundled;};
 
     // get number of molecules in specified volume centered on specified point
     // (volume in ml)                                                          
     int getNumMolecules(double volume, const SimPoint &pos) const;
 
     // I/O stuff
-    void printConc() const;
+    void printConc();
     void writeDefinition(ofstream &outfile) const;
-    void writeData(ofstream &outfile) const;
+    void writeData(ofstream &outfile);
+
+    // time spent in explicit diffusion sweeps (all molecules), and the 
+    // memory bandwidth that implies; and in steady-state solves
+    static void printStats(ostream &s);
 
   private:
-    // geometry info that applies to all molecules
-    static int sm_xsize;
-    static int sm_ysize;
-    static int sm_zsize;
+    // geometry info
+    int m_resolution;			// requested grid size, or -1
+    int m_xsize;
+    int m_ysize;
+    int m_zsize;
+
+    int m_gridsize;
+    int m_size;
+    int m_gridsq;			// used in diffusion calculations
+    double m_invNavVol;			// used in changeConc             
+
+    // explicit diffusion performance, for printStats
+    static long sm_numSweeps;
+    static double sm_sweepPoints;
+    static double sm_sweepSeconds;
 
-    static int sm_gridsize;
-    static int sm_size;
-    static int sm_gridsq;		// used in diffusion calculations
-    static double sm_invNavVol;		// used in changeConc             
+    // steady-state solves, likewise
+    static long sm_numSolves;
+    static long sm_numCycles;
+    static double sm_solveSeconds;
 
     string m_name;
     double m_diffusionRate;		// microns^2/sec
     double m_decayRate;			// /sec
+    Solver m_solver;
+
+    // cell steps per update, and the lag bounds (see getLagBound) with 
+    // the sampled values they're taken from
+    int m_updateInterval;
+    double m_lagSum, m_lagMax;
+    int m_lagCount;
+    vector<Conc> m_lagSample;
+    void advance(double deltaT);	// update without the estimate
+
+    // line solvers for ADI, one per dimension (set up for each size)
+    CyclicTridiag m_xline, m_yline, m_zline;
+
+    // transforms for SPECTRAL, one per dimension, per-mode factors, and
+    // space to gather a block of strided lines
+    FFT m_xfft, m_yfft, m_zfft;
+    vector<double> m_modeFactor;
+    vector<Conc> m_spectralBlock;
+
+    // solver for STEADY, which also keeps the last solution (before 
+    // negative values were set to 0); m_steadyRestart is set when the 
+    // concentrations are replaced wholesale (so they aren't sources)
+    Multigrid m_steady;
+    bool m_steadyRestart;
+
+    // set by deposits and by concentrations set wholesale - changes that 
+    // can leave spikes for RKC to damp (see rkcDecayDiff)
+    bool m_rkcRough;
 
     // concentrations measured in moles/ml
-    Array3D<Conc> m_concentration;	// unordered list of grid spaces
-    Array3D<Conc> m_deltaConc;		// grid space list used for updates
+    Array3D<Conc> m_concentration;	// unordered list of grid 
+    					// spaces; only a copy for getConc()
+					// when bundled
+    Array3D<Conc> *m_deltaConc;		// grid space list used for updates:
+    					// new concentrations are written 
+					// here, then the two are swapped
+    Array3D<Conc> m_ownDelta;		// m_deltaConc, if there's no pool
+    ScratchPool *m_pool;		// where m_deltaConc is borrowed from
+    void borrowScratch();
+
+    // where concentrations actually are:  m_concentration, or this 
+    // molecule's slot in a MoleculeBundle (every m_stride'th value)
+    Conc *m_field;
+    int m_stride;
+    bool m_bundled;
+
+    // actual concentrations are the stored ones times m_scale; decay 
+    // without diffusion just changes m_scale.  applyScale multiplies it
+    // out (before diffusion, or bundling, or when stored values are 
+    // wanted); const functions read values times m_scale instead.
+    double m_scale;
+    void applyScale();
+
+    // concentration at linear index n (i*ysize*zsize + j*zsize + k)
+    Conc& value(int n) 
+    	{ assert(n>=0 && n<m_size); return m_field[n*m_stride]; };
+    const Conc& value(int n) const
+    	{ assert(n>=0 && n<m_size); return m_field[n*m_stride]; };
+    int index(int i, int j, int k) const
+    	{ return (i*m_ysize + j)*m_zsize + k; };
+    void setField(Conc *field, int stride);
+
+    // for each row (see setActiveThreshold) of m_concentration: whether 
+    // any value is above the threshold (ROW_ACTIVE), and whether it may 
+    // differ from the same row of m_deltaConc (ROW_CHANGED); a sweep 
+    // writes the flags for its new values to m_nextRowFlags
+    Conc m_activeThreshold;
+    vector<unsigned char> m_rowFlags;
+    vector<unsigned char> m_nextRowFlags;
+    int getNumRows() const
+    	{ return (m_zsize == 1) ? m_xsize : m_xsize*m_ysize; };
+    int getRowLength() const
+    	{ return (m_zsize == 1) ? m_ysize : m_zsize; };
+    int dims() const { return (m_zsize == 1) ? 2 : 3; };
+    unsigned char scanRow(const Conc *row) const;
+    void resetRowFlags();
+    double getActiveFraction() const;
+
+    // finer grid around sources/steep gradients, if any; choose its 
+    // blocks again every REGRID_INTERVAL updates
+    int m_refineRatio;
+    RefinedField *m_refined;
+    int m_regridCount;
+    void markRefinedRows();
+
+    // sum of all concentrations, kept up to date as they change, so 
+    // getAvgConc doesn't have to visit the grid; updates since resummed
+    Conc m_total;
+    int m_totalCount;
+    void decayTotal(double factor);
+    void resumTotal();
+
+    // gradient at each grid point, x, y and z together (concentration 
+    // per micron), if cached; valid once updateGradient has been called
+    bool m_cacheGradient;
+    bool m_gradientValid;
+    vector<double> m_gradient;
+    void gradientSlab(int begin, int end);	// x planes [begin,end)
+    class GradientTask;		// Scheduler task for gradientSlab
+    SimPoint getCachedGradient(const SimPoint &pos) const;
+
+    // interpolation between grid points, specialized at compile time:
+    // bilinear for a single layer of grid cells (DIMS 2), trilinear 
+    // otherwise; setGeometry picks the ones getInterpConc and 
+    // getCachedGradient use
+    template<int DIMS> Conc interpConc(const SimPoint &pos) const;
+    template<int DIMS> SimPoint cachedGradient(const SimPoint &pos) const;
+    Conc (Molecule::*m_interpConc)(const SimPoint &pos) const;
+    SimPoint (Molecule::*m_cachedGradient)(const SimPoint &pos) const;
+
+    // changes recorded by changeConc in deferred mode (moles/ml); only
+    // allocated in deferred mode
+    bool m_defer;
+    bool m_pending;			// any deposits since last applied?
+    Array3D<Conc> m_deposit;
 
     // private functions - explicit solution of diffusion equation, w/decay
     void decay(double deltaT);
-    void explicitDecayDiff2D(double deltaT);	
-    void explicitDecayDiff3D(double deltaT);	
-
-    // add (possibly negative) concentration to grid cell at (i,j,k);
-    // checks whether (i,j,k) is a guard cell, changes corresponding 'real'
-    // cell if so
-    void addConc(int i, int j, int k, Conc change);	
-
-    // set various guard cells
-    void setGuards();	
-    void setGuardCorners();	
-    void setSpecificGuards(int i, int j, int k);	
+    void explicitDecayDiff(double deltaT);	
+    void sweepSlab(int begin, int end, double decay_factor, 
+    		   double diff_factor);	// x planes [begin,end)
+    class SweepTask;		// Scheduler task for sweepSlab
+    int getBlockDepth() const;
+    void blockedDecayDiff(double deltaT, int depth);
+    void blockedSlab(int begin, int end, int depth, double decay_factor,
+    		     double diff_factor);
+    class BlockTask;		// Scheduler task for blockedSlab
+    void sweepPlane(Conc *out, const Conc *xm, const Conc *cur, 
+    		    const Conc *xp, double decay_factor, 
+		    double diff_factor) const;
+    void adiDecayDiff(double deltaT);
+    void spectralDecayDiff(double deltaT);
+    void setModeFactors(FFT &fft, int n, double deltaT);
+    void spectralLines(FFT &fft, Conc *first, int stride, int nlines);
+    double rkcDecayDiff(double deltaT);
+    void steadyState(double deltaT);
+    struct RkcStage;		// what one RKC stage combines
+    void rkcSlab(int begin, int end, const RkcStage &st);
+    class RkcTask;		// Scheduler task for rkcSlab
+
+    // index i wrapped into [0,n) - for i no more than n out of range
+    static int wrapIndex(int i, int n)
+	{ return (i < 0) ? i+n : ((i >= n) ? i-n : i); };
+
+    friend class MoleculeBundle;
 
     // not used
     Molecule(const Molecule &m);
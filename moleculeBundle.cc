@@ -0,0 +1,301 @@
+
+/************************************************************************
+ * 									*
+ * Copyright (C) 2004  Christina Warrender				*
+ * 									*
+ * This file is part of CyCells.					*
+ *									*
+ * CyCells is free software; you can redistribute it and/or modify it 	*
+ * under the terms of the GNU General Public License as published by	*
+ * the Free Software Foundation; either version 2 of the License, or	*
+ * (at your option) any later version.					*
+ *									*
+ * CyCells is distributed in the hope that it will be useful,		*
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of	*
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the	*
+ * GNU General Public License for more details.				*
+ *									*
+ * You should have received a copy of the GNU General Public License	*
+ * along with CyCells; if not, write to the Free Software Foundation, 	*
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA	*
+ *									*
+ ************************************************************************/
+/************************************************************************
+ * file moleculeBundle.cc                                               *
+ * Routines for MoleculeBundle class                                    *
+ ************************************************************************/
+
+#include "moleculeBundle.h"
+#include <iostream>
+#include <chrono>
+#include <cassert>
+#include <cmath>
+#include "scheduler.h"
+#include "stencil.h"
+
+using namespace std;
+
+static double now()
+{
+  return chrono::duration<double>(
+	chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/************************************************************************ 
+ * class MoleculeBundle::SweepTask                 			*
+ *   Scheduler task for one explicit step of all species:  each chunk   *
+ *   is a slab of x planes                                              *
+ ************************************************************************/
+class MoleculeBundle::SweepTask : public Task {
+  public:
+    SweepTask(MoleculeBundle *pb) : m_pb(pb) {};
+    void run(int begin, int end, int chunk, int thread)
+	{ m_pb->sweepSlab(begin, end); };
+
+  private:
+    MoleculeBundle *m_pb;
+};
+
+/************************************************************************ 
+ * MoleculeBundle()                                                     *
+ *   Constructor; allocates interleaved storage, copies each molecule's *
+ *   concentrations into it and points the molecules at it              *
+ *                                                                      *
+ * Parameters                                                           *
+ *   const vector<Molecule*> &mols:	molecules to bundle - must use  *
+ *					the explicit solver, and the    *
+ *					same grid                       *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+MoleculeBundle::MoleculeBundle(const vector<Molecule*> &mols) : 
+	m_mols(mols), m_size(mols[0]->m_size), m_data(0), m_next(0),
+	m_decay(mols.size()), m_diff(mols.size())
+{
+  const int num = m_mols.size();
+  assert(num > 0);
+
+  try {
+    m_data = new Conc[m_size*num];
+    m_next = new Conc[m_size*num];
+  }
+  catch(std::bad_alloc&) {
+    cerr << "not enough memory to set up molecule bundle" << endl;
+    abort();
+  }
+
+  for (int s=0; s<num; s++)
+  {
+    Molecule *pm = m_mols[s];
+    assert(!pm->isBundled());
+    assert(pm->getSolver() == Molecule::EXPLICIT);
+    assert(!pm->isRefined());
+    assert(pm->m_xsize == m_mols[0]->m_xsize && 
+	   pm->m_ysize == m_mols[0]->m_ysize && 
+	   pm->m_zsize == m_mols[0]->m_zsize && 
+	   pm->m_gridsize == m_mols[0]->m_gridsize);
+    pm->applyScale();
+    for (int n=0; n<m_size; n++)
+      m_data[n*num+s] = pm->value(n);
+  }
+  attach();
+}
+
+/************************************************************************ 
+ * ~MoleculeBundle()                                                    *
+ *   Destructor; copies concentrations back to the molecules' own       *
+ *   arrays, and points them back there                                 *
+ *                                                                      *
+ * Parameters - none                                                    *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+MoleculeBundle::~MoleculeBundle()
+{
+  const int num = m_mols.size();
+  for (int s=0; s<num; s++)
+  {
+    Molecule *pm = m_mols[s];
+    pm->setField(0, 1);
+    for (int n=0; n<m_size; n++)
+      pm->value(n) = m_data[n*num+s];
+  }
+
+  delete [] m_data;
+  delete [] m_next;
+}
+
+/************************************************************************ 
+ * update()                                                             *
+ *   Diffusion and decay for all species in the bundle for one time     *
+ *   step.  Takes as many explicit substeps as the fastest-diffusing    *
+ *   species needs; each substep is one pass over the grid for all      *
+ *   species.  For each species this does exactly what                  *
+ *   Molecule::update would (same operations, same order) when the      *
+ *   number of substeps is the same, so bundling species with equal     *
+ *   diffusion rates doesn't change results at all.                     *
+ *                                                                      *
+ * Parameters                                                           *
+ *   double deltaT:		duration of time step in seconds        *
+ *   const vector<bool> &skip:	species not to update this step         *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void MoleculeBundle::update(double deltaT, const vector<bool> &skip)
+{
+  const int num = m_mols.size();
+  assert(int(skip.size()) == num);
+  const Molecule &grid = *m_mols[0];	// all have the same grid
+
+  // stability requirement:  deltaT <= (deltaX)^2/(2*numdim*D)
+  int numdim2 = (grid.m_zsize == 1) ? 4 : 6;
+  int num_time_steps = 0;
+  for (int s=0; s<num; s++)
+    if (!skip[s])
+    {
+      int steps = int(numdim2*m_mols[s]->getDiffRate()*deltaT/
+		      grid.m_gridsq) + 1;
+      if (steps > num_time_steps)
+        num_time_steps = steps;
+    }
+  if (!num_time_steps)
+    return;			// nothing to do
+
+  // skipped species get 0 factors - their values come out unchanged
+  double dt = deltaT/num_time_steps;
+  for (int s=0; s<num; s++)
+  {
+    m_decay[s] = skip[s] ? 0 : m_mols[s]->getDecayRate()*dt;
+    assert(m_decay[s] < 1);
+    m_diff[s] = skip[s] ? 0 : m_mols[s]->getDiffRate()*dt/grid.m_gridsq;
+  }
+  int row_length = (grid.m_zsize == 1) ? grid.m_ysize : grid.m_zsize;
+  m_rowDecay.resize(row_length*num);
+  m_rowDiff.resize(row_length*num);
+  for (int m=0; m<row_length*num; m++)
+  {
+    m_rowDecay[m] = m_decay[m%num];
+    m_rowDiff[m] = m_diff[m%num];
+  }
+
+  int plane = grid.m_ysize*grid.m_zsize*num*sizeof(Conc);
+  int grain = SWEEP_CACHE_BYTES / plane;
+  if (grain < 1)
+    grain = 1;
+  for (int i=0; i<num_time_steps; i++)
+  {
+    double start = now();
+
+    SweepTask task(this);
+    Scheduler::getInstance()->run(task, grid.m_xsize, grain);
+    Conc *temp = m_data; m_data = m_next; m_next = temp;
+    attach();
+
+    Molecule::sm_numSweeps++;
+    Molecule::sm_sweepPoints += double(m_size)*num;
+    Molecule::sm_sweepSeconds += now() - start;
+  }
+
+  // each species' total, as Molecule::update would
+  for (int s=0; s<num; s++)
+    if (!skip[s])
+      m_mols[s]->decayTotal(pow(1 - m_decay[s], num_time_steps));
+}
+
+/************************************************************************ 
+ * attach()                                                             *
+ *   Points each molecule at its values in m_data                       *
+ *                                                                      *
+ * Parameters - none                                                    *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void MoleculeBundle::attach()
+{
+  const int num = m_mols.size();
+  for (int s=0; s<num; s++)
+    m_mols[s]->setField(m_data+s, num);
+}
+
+/************************************************************************ 
+ * sweepSlab()                                                          *
+ *   One explicit step for x planes [begin,end), all species.  Same     *
+ *   scheme as Molecule::sweepSlab, but a row holds all species' values *
+ *   for each point, so neighbors along the row are #species apart;     *
+ *   the row kernels handle all but the first and last points, which    *
+ *   wrap.                                                              *
+ *                                                                      *
+ * Parameters                                                           *
+ *   int begin, end:		range of x indices                      *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void MoleculeBundle::sweepSlab(int begin, int end)
+{
+  const Molecule &grid = *m_mols[0];	// all have the same grid
+  const int nx = grid.m_xsize, ny = grid.m_ysize, nz = grid.m_zsize;
+  const int num = m_mols.size();
+  const double *decay = &m_decay[0], *diff = &m_diff[0];
+  const double *row_decay = &m_rowDecay[0], *row_diff = &m_rowDiff[0];
+
+  if (nz == 1)		// essentially 2D - rows are y
+  {
+    const int len = ny*num;
+    Stencil::Row5S row5 = Stencil::getRow5Strided();
+    for (int i=begin; i<end; i++)
+    {
+      int im = (i == 0) ? nx-1 : i-1;
+      int ip = (i == nx-1) ? 0 : i+1;
+      const Conc *row = m_data + i*len;
+      const Conc *xm = m_data + im*len;
+      const Conc *xp = m_data + ip*len;
+      Conc *out = m_next + i*len;
+
+      for (int s=0; s<num; s++)
+        out[s] = Stencil::point5(row, xm, xp, s, len-num+s, 
+			(ny>1) ? num+s : s, decay[s], diff[s]);
+      row5(out, row, xm, xp, len, num, row_decay, row_diff);
+      if (ny > 1)
+        for (int s=0; s<num; s++)
+          out[len-num+s] = Stencil::point5(row, xm, xp, len-num+s, 
+			  len-2*num+s, s, decay[s], diff[s]);
+    }
+    return;
+  }
+
+  // full 3D - rows are z; see Molecule::sweepSlab for banding
+  const int len = nz*num;
+  Stencil::Row7S row7 = Stencil::getRow7Strided();
+  int band = SWEEP_CACHE_BYTES / (4*len*sizeof(Conc));
+  if (band < 1)
+    band = 1;
+  for (int j0=0; j0<ny; j0+=band)
+  {
+    int j1 = (j0+band < ny) ? j0+band : ny;
+    for (int i=begin; i<end; i++)
+    {
+      int im = (i == 0) ? nx-1 : i-1;
+      int ip = (i == nx-1) ? 0 : i+1;
+      for (int j=j0; j<j1; j++)
+      {
+        int jm = (j == 0) ? ny-1 : j-1;
+        int jp = (j == ny-1) ? 0 : j+1;
+        const Conc *row = m_data + (i*ny+j)*len;
+        const Conc *xm = m_data + (im*ny+j)*len;
+        const Conc *xp = m_data + (ip*ny+j)*len;
+        const Conc *ym = m_data + (i*ny+jm)*len;
+        const Conc *yp = m_data + (i*ny+jp)*len;
+        Conc *out = m_next + (i*ny+j)*len;
+
+        for (int s=0; s<num; s++)
+          out[s] = Stencil::point7(row, xm, xp, ym, yp, s, len-num+s, 
+			  num+s, decay[s], diff[s]);
+        row7(out, row, xm, xp, ym, yp, len, num, row_decay, row_diff);
+        for (int s=0; s<num; s++)
+          out[len-num+s] = Stencil::point7(row, xm, xp, ym, yp, 
+			  len-num+s, len-2*num+s, s, decay[s], diff[s]);
+      }
+    }
+  }
+}
+
@@ -0,0 +1,83 @@
+
+/************************************************************************
+ * 									*
+ * Copyright (C) 2004  Christina Warrender				*
+ * 									*
+ * This file is part of CyCells.					*
+ *									*
+ * CyCells is free software; you can redistribute it and/or modify it 	*
+ * under the terms of the GNU General Public License as published by	*
+ * the Free Software Foundation; either version 2 of the License, or	*
+ * (at your option) any later version.					*
+ *									*
+ * CyCells is distributed in the hope that it will be useful,		*
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of	*
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the	*
+ * GNU General Public License for more details.				*
+ *									*
+ * You should have received a copy of the GNU General Public License	*
+ * along with CyCells; if not, write to the Free Software Foundation, 	*
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA	*
+ *									*
+ ************************************************************************/
+/************************************************************************
+ * file moleculeBundle.h                                                *
+ * Declarations for MoleculeBundle class                                *
+ * Several molecule types stored interleaved and diffused together      *
+ ***********************************************************************/
+
+#ifndef MOLECULEBUNDLE_H
+#define MOLECULEBUNDLE_H
+
+#include <vector>
+#include "molecule.h"
+
+using namespace std;
+
+// Holds the concentrations of several Molecules (same grid, explicit 
+// solver) interleaved - all species' values for a grid cell are 
+// adjacent - and does one explicit sweep that updates them all, each 
+// with its own diffusion and decay rates.  The Molecules keep working 
+// as usual otherwise; their concentrations just live here.
+class MoleculeBundle {
+  public:
+    typedef Molecule::Conc Conc;
+
+    //--------------------------- CREATORS --------------------------------- 
+    // takes over the molecules' storage, copying their concentrations
+    explicit MoleculeBundle(const vector<Molecule*> &mols);
+    // copy constructor not used
+    ~MoleculeBundle();		// gives storage back, copying values
+
+    //------------------------- MANIPULATORS -------------------------------
+    // assignment not used
+
+    // diffusion and decay for one time step; species i is left alone if
+    // skip[i] is set (e.g. its concentration was just reset)
+    void update(double deltaT, const vector<bool> &skip);
+
+    //--------------------------- ACCESSORS --------------------------------
+    int getNumSpecies() const {return m_mols.size();};
+
+  private:
+    vector<Molecule*> m_mols;
+    int m_size;				// #grid cells
+    Conc *m_data;			// m_size x #species
+    Conc *m_next;			// new values written here, then swapped
+
+    // per-species factors for the current substep, and the same 
+    // repeated along a row (the stencil row kernels take one per element)
+    vector<double> m_decay, m_diff;
+    vector<double> m_rowDecay, m_rowDiff;
+
+    void attach();			// point molecules at m_data
+    void sweepSlab(int begin, int end);	// x planes [begin,end)
+    class SweepTask;			// Scheduler task for sweepSlab
+
+    // not used
+    MoleculeBundle(const MoleculeBundle &b);
+    MoleculeBundle operator = (const MoleculeBundle &b);
+};
+
+#endif
+
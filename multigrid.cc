@@ -0,0 +1,364 @@
+
+/************************************************************************
+ * 									*
+ * Copyright (C) 2004  Christina Warrender				*
+ * 									*
+ * This file is part of CyCells.					*
+ *									*
+ * CyCells is free software; you can redistribute it and/or modify it 	*
+ * under the terms of the GNU General Public License as published by	*
+ * the Free Software Foundation; either version 2 of the License, or	*
+ * (at your option) any later version.					*
+ *									*
+ * CyCells is distributed in the hope that it will be useful,		*
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of	*
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the	*
+ * GNU General Public License for more details.				*
+ *									*
+ * You should have received a copy of the GNU General Public License	*
+ * along with CyCells; if not, write to the Free Software Foundation, 	*
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA	*
+ *									*
+ ************************************************************************/
+/************************************************************************
+ * file multigrid.cc                                                    *
+ * Routines for Multigrid class                                         *
+ ************************************************************************/
+
+#include "multigrid.h"
+#include <cassert>
+#include <cmath>
+
+using namespace std;
+
+/************************************************************************ 
+ * ~Level()                                                             *
+ *   Destructor - frees one grid's vectors (out of line:  m_levels      *
+ *   would otherwise inline it wherever it resizes)                     *
+ *                                                                      *
+ * Parameters                                                           *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+Multigrid::Level::~Level()
+{
+}
+
+/************************************************************************ 
+ * setSystem()                                                          *
+ *   Sets up the grids:  the given one, then coarser ones, each with    *
+ *   half as many cells per dimension (and so r/4), for as long as all  *
+ *   dimensions longer than 1 are at least 4.  An odd dimension n gets  *
+ *   (n+1)/2 coarse cells, the last covering only one fine cell - not   *
+ *   quite the same operator there, but close enough for a correction.  *
+ *   Does nothing but change coefficients if the size is the same as    *
+ *   before.                                                            *
+ *                                                                      *
+ * Parameters                                                           *
+ *   int nx, ny, nz:		grid size                               *
+ *   double a:			decay rate                              *
+ *   double r:			diffusion rate / grid size^2            *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Multigrid::setSystem(int nx, int ny, int nz, double a, double r)
+{
+  assert(nx>0 && ny>0 && nz>0); assert(a>0); assert(r>=0);
+  m_a = a;
+  if (!m_levels.empty() && m_levels[0].nx == nx && m_levels[0].ny == ny 
+		  && m_levels[0].nz == nz)
+  {
+    for (unsigned int l=0; l<m_levels.size(); l++, r/=4)
+      m_levels[l].r = r;
+    return;
+  }
+
+  // sizes first, so the levels can be made in place (Level has no
+  // inline copy constructor to spare vector's reallocation)
+  int size[MG_MAX_LEVELS][3];
+  int num = 0;
+  for (;;)
+  {
+    size[num][0] = nx; size[num][1] = ny; size[num][2] = nz;
+    num++;
+
+    bool halve = (num < MG_MAX_LEVELS);
+    int n[3] = {nx, ny, nz};
+    for (int d=0; d<3; d++)
+      if (n[d] > 1 && n[d] < 4)
+        halve = false;
+    if (!halve || nx*ny*nz == 1)
+      break;
+    if (nx > 1) nx = (nx+1)/2;
+    if (ny > 1) ny = (ny+1)/2;
+    if (nz > 1) nz = (nz+1)/2;
+  }
+
+  vector<Level>(num).swap(m_levels);
+  for (int i=0; i<num; i++, r/=4)
+  {
+    Level &l = m_levels[i];
+    l.nx = size[i][0]; l.ny = size[i][1]; l.nz = size[i][2];
+    l.r = r;
+    l.u.assign(l.nx*l.ny*l.nz, 0);
+    l.f.assign(l.nx*l.ny*l.nz, 0);
+    l.res.assign(l.nx*l.ny*l.nz, 0);
+  }
+}
+
+/************************************************************************ 
+ * solve()                                                              *
+ *   Improves the solution (the last one, or 0) by V-cycles until the   *
+ *   residual is small enough.  If f is all 0 the solution is too.      *
+ *                                                                      *
+ * Parameters                                                           *
+ *   const double *f:		right-hand side, nx*ny*nz values        *
+ *   double tol:		residual wanted, relative to f          *
+ *   int max_cycles:		most V-cycles to do                     *
+ *                                                                      *
+ * Returns - number of V-cycles done                                    *
+ ************************************************************************/
+int Multigrid::solve(const double *f, double tol, int max_cycles)
+{
+  assert(!m_levels.empty());
+  Level &top = m_levels[0];
+  int n = top.u.size();
+
+  double fnorm = 0;
+  for (int p=0; p<n; p++)
+  {
+    top.f[p] = f[p];
+    fnorm += f[p]*f[p];
+  }
+  fnorm = sqrt(fnorm);
+  if (fnorm == 0)
+  {
+    top.u.assign(n, 0);
+    return 0;
+  }
+
+  int cycles = 0;
+  while (cycles < max_cycles && residual(top) > tol*fnorm)
+  {
+    vcycle(0);
+    cycles++;
+  }
+  return cycles;
+}
+
+/************************************************************************ 
+ * smooth()                                                             *
+ *   Red-black Gauss-Seidel sweeps:  each cell (first those with i+j+k  *
+ *   even, then odd) is set to what balances its neighbors' values      *
+ *                                                                      *
+ * Parameters                                                           *
+ *   Level &l:			grid to smooth                          *
+ *   int sweeps:		how many times                          *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Multigrid::smooth(Level &l, int sweeps)
+{
+  const int nx = l.nx, ny = l.ny, nz = l.nz;
+  // neighbors count only along dimensions longer than 1
+  const double wx = (nx > 1), wy = (ny > 1), wz = (nz > 1);
+  const double diag = m_a + 2*(wx + wy + wz)*l.r;
+  double *u = &l.u[0];
+  const double *f = &l.f[0];
+
+  for (int s=0; s<sweeps; s++)
+    for (int color=0; color<2; color++)
+      for (int i=0; i<nx; i++)
+      {
+        int im = wrap(i-1, nx), ip = wrap(i+1, nx);
+        for (int j=0; j<ny; j++)
+        {
+          int jm = wrap(j-1, ny), jp = wrap(j+1, ny);
+          double *row = u + (i*ny + j)*nz;
+          const double *xm = u + (im*ny + j)*nz, *xp = u + (ip*ny + j)*nz;
+          const double *ym = u + (i*ny + jm)*nz, *yp = u + (i*ny + jp)*nz;
+          const double *frow = f + (i*ny + j)*nz;
+          for (int k=(i+j+color)%2; k<nz; k+=2)
+          {
+            double sum = wx*(xm[k] + xp[k]) + wy*(ym[k] + yp[k]) 
+	    		 + wz*(row[wrap(k-1, nz)] + row[wrap(k+1, nz)]);
+            row[k] = (frow[k] + l.r*sum) / diag;
+          }
+        }
+      }
+}
+
+/************************************************************************ 
+ * residual()                                                           *
+ *   Computes f minus the operator applied to u, for every cell         *
+ *                                                                      *
+ * Parameters                                                           *
+ *   Level &l:			grid                                    *
+ *                                                                      *
+ * Returns - L2 norm of the residual                                    *
+ ************************************************************************/
+double Multigrid::residual(Level &l)
+{
+  const int nx = l.nx, ny = l.ny, nz = l.nz;
+  const double wx = (nx > 1), wy = (ny > 1), wz = (nz > 1);
+  const double diag = m_a + 2*(wx + wy + wz)*l.r;
+  const double *u = &l.u[0];
+  double norm = 0;
+
+  for (int i=0; i<nx; i++)
+  {
+    int im = wrap(i-1, nx), ip = wrap(i+1, nx);
+    for (int j=0; j<ny; j++)
+    {
+      int jm = wrap(j-1, ny), jp = wrap(j+1, ny);
+      int p = (i*ny + j)*nz;
+      const double *row = u + p;
+      const double *xm = u + (im*ny + j)*nz, *xp = u + (ip*ny + j)*nz;
+      const double *ym = u + (i*ny + jm)*nz, *yp = u + (i*ny + jp)*nz;
+      for (int k=0; k<nz; k++)
+      {
+        double sum = wx*(xm[k] + xp[k]) + wy*(ym[k] + yp[k]) 
+		     + wz*(row[wrap(k-1, nz)] + row[wrap(k+1, nz)]);
+        double res = l.f[p+k] - (diag*row[k] - l.r*sum);
+        l.res[p+k] = res;
+        norm += res*res;
+      }
+    }
+  }
+  return sqrt(norm);
+}
+
+/************************************************************************ 
+ * vcycle()                                                             *
+ *   One V-cycle from the given level down:  smooth, solve for the      *
+ *   residual's correction on the next coarser grid (recursively), add  *
+ *   it, smooth again.  The coarsest grid is just smoothed until its    *
+ *   residual is down by a factor of 100 (it's small).                  *
+ *                                                                      *
+ * Parameters                                                           *
+ *   int level:			0 for the finest grid                   *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Multigrid::vcycle(int level)
+{
+  Level &l = m_levels[level];
+
+  if (level == int(m_levels.size())-1)
+  {
+    double start = residual(l);
+    int n = (l.nx > l.ny) ? l.nx : l.ny;
+    n = (n > l.nz) ? n : l.nz;
+    for (int s=0; s<n*n; s+=10)
+    {
+      smooth(l, 10);
+      if (residual(l) <= 0.01*start)
+        break;
+    }
+    return;
+  }
+
+  smooth(l, MG_SMOOTH_SWEEPS);
+  residual(l);
+  restrictTo(level);
+  m_levels[level+1].u.assign(m_levels[level+1].u.size(), 0);
+  vcycle(level+1);
+  prolongFrom(level);
+  smooth(l, MG_SMOOTH_SWEEPS);
+}
+
+/************************************************************************ 
+ * restrictTo()                                                         *
+ *   Each coarse cell's f is the average of the residual over the fine  *
+ *   cells it covers (2 per halved dimension, or 1 at the end of an odd *
+ *   one)                                                               *
+ *                                                                      *
+ * Parameters                                                           *
+ *   int level:			fine grid; level+1 is the coarse one    *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Multigrid::restrictTo(int level)
+{
+  const Level &fine = m_levels[level];
+  Level &coarse = m_levels[level+1];
+  // fine cells per coarse cell, per dimension (at most)
+  const int rx = (fine.nx > coarse.nx) ? 2 : 1;
+  const int ry = (fine.ny > coarse.ny) ? 2 : 1;
+  const int rz = (fine.nz > coarse.nz) ? 2 : 1;
+
+  for (int I=0; I<coarse.nx; I++)
+    for (int J=0; J<coarse.ny; J++)
+      for (int K=0; K<coarse.nz; K++)
+      {
+        double sum = 0;
+        int count = 0;
+        for (int i=I*rx; i<(I+1)*rx && i<fine.nx; i++)
+          for (int j=J*ry; j<(J+1)*ry && j<fine.ny; j++)
+            for (int k=K*rz; k<(K+1)*rz && k<fine.nz; k++)
+            {
+              sum += fine.res[(i*fine.ny + j)*fine.nz + k];
+              count++;
+            }
+        coarse.f[(I*coarse.ny + J)*coarse.nz + K] = sum/count;
+      }
+}
+
+/************************************************************************ 
+ * prolongFrom()                                                        *
+ *   Adds the coarse grid's correction to the fine grid's u, linearly   *
+ *   interpolated between coarse cell centers:  along each dimension,   *
+ *   3/4 of the coarse cell a fine cell is in and 1/4 of the next one   *
+ *   on that side                                                       *
+ *                                                                      *
+ * Parameters                                                           *
+ *   int level:			fine grid; level+1 is the coarse one    *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Multigrid::prolongFrom(int level)
+{
+  Level &fine = m_levels[level];
+  const Level &coarse = m_levels[level+1];
+  const int cnx = coarse.nx, cny = coarse.ny, cnz = coarse.nz;
+  const double *e = &coarse.u[0];
+
+  for (int i=0; i<fine.nx; i++)
+  {
+    // coarse cells, and weights, along x
+    int I0 = 0, I1 = 0;
+    double a0 = 1, a1 = 0;
+    if (fine.nx > cnx)
+    {
+      I0 = i/2; I1 = wrap(I0 + ((i%2) ? 1 : -1), cnx);
+      a0 = 0.75; a1 = 0.25;
+    }
+    for (int j=0; j<fine.ny; j++)
+    {
+      int J0 = 0, J1 = 0;
+      double b0 = 1, b1 = 0;
+      if (fine.ny > cny)
+      {
+        J0 = j/2; J1 = wrap(J0 + ((j%2) ? 1 : -1), cny);
+        b0 = 0.75; b1 = 0.25;
+      }
+      const double *e00 = e + (I0*cny + J0)*cnz, *e01 = e + (I0*cny + J1)*cnz;
+      const double *e10 = e + (I1*cny + J0)*cnz, *e11 = e + (I1*cny + J1)*cnz;
+      double *u = &fine.u[(i*fine.ny + j)*fine.nz];
+      for (int k=0; k<fine.nz; k++)
+      {
+        int K0 = 0, K1 = 0;
+        double c0 = 1, c1 = 0;
+        if (fine.nz > cnz)
+        {
+          K0 = k/2; K1 = wrap(K0 + ((k%2) ? 1 : -1), cnz);
+          c0 = 0.75; c1 = 0.25;
+        }
+        u[k] += a0*(b0*(c0*e00[K0] + c1*e00[K1]) 
+		    + b1*(c0*e01[K0] + c1*e01[K1]))
+        	+ a1*(b0*(c0*e10[K0] + c1*e10[K1]) 
+		      + b1*(c0*e11[K0] + c1*e11[K1]));
+      }
+    }
+  }
+}
@@ -0,0 +1,87 @@
+
+/************************************************************************
+ * 									*
+ * Copyright (C) 2004  Christina Warrender				*
+ * 									*
+ * This file is part of CyCells.					*
+ *									*
+ * CyCells is free software; you can redistribute it and/or modify it 	*
+ * under the terms of the GNU General Public License as published by	*
+ * the Free Software Foundation; either version 2 of the License, or	*
+ * (at your option) any later version.					*
+ *									*
+ * CyCells is distributed in the hope that it will be useful,		*
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of	*
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the	*
+ * GNU General Public License for more details.				*
+ *									*
+ * You should have received a copy of the GNU General Public License	*
+ * along with CyCells; if not, write to the Free Software Foundation, 	*
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA	*
+ *									*
+ ************************************************************************/
+/************************************************************************
+ * file multigrid.h                                                     *
+ * Declarations for Multigrid class                                     *
+ * Solver for the periodic systems of steady-state diffusion with decay *
+ ***********************************************************************/
+
+#ifndef MULTIGRID_H
+#define MULTIGRID_H
+
+#include <vector>
+
+using namespace std;
+
+#define MG_MAX_LEVELS 10
+#define MG_SMOOTH_SWEEPS 2		// before and after each coarse 
+					// correction
+
+// Solves a*u[p] + r*sum(u[p] - u[q]) = f[p], q being p's neighbors on a
+// periodic nx*ny*nz grid (2 per dimension longer than 1) - one grid 
+// cell's balance of decay, diffusion and sources in a steady state.  
+// Geometric multigrid V-cycles:  red-black Gauss-Seidel smoothing, and
+// coarse grids with half as many cells per dimension, down to one small
+// enough to smooth to convergence.  The solution is kept between calls, 
+// so each solve starts from the last one.
+class Multigrid {
+  public:
+    //--------------------------- CREATORS --------------------------------- 
+    Multigrid() {};
+    // use default copy constructor, destructor
+
+    //------------------------- MANIPULATORS -------------------------------
+    // set grid size and coefficients (a:  decay rate; r:  diffusion rate
+    // / grid size^2); the solution is set to 0 if the size changed
+    void setSystem(int nx, int ny, int nz, double a, double r);
+
+    // the solution (starting point for the next solve), nx*ny*nz values
+    // in the same order as Array3D's
+    double *getSolution() { return &m_levels[0].u[0]; };
+
+    // V-cycles until the residual is at most tol times f (L2 norms), or 
+    // max_cycles; returns the number of cycles
+    int solve(const double *f, double tol, int max_cycles);
+
+  private:
+    struct Level {
+      int nx, ny, nz;
+      double r;
+      vector<double> u, f, res;
+      ~Level();
+    };
+    vector<Level> m_levels;
+    double m_a;
+
+    void smooth(Level &l, int sweeps);
+    double residual(Level &l);		// returns L2 norm
+    void vcycle(int level);
+    void restrictTo(int level);		// residual to f of level+1
+    void prolongFrom(int level);	// level+1's u into level's
+
+    // index i wrapped into [0,n) - for i no more than n out of range
+    static int wrap(int i, int n)
+	{ return (i < 0) ? i+n : ((i >= n) ? i-n : i); };
+};
+
+#endif
@@ -33,10 +33,14 @@
 
 // initialize static variables; reassigned on first call to randk or
 // readFromFile
-int RandK::inext = 0;
-int RandK::inextp = 0;
-long RandK::ma[56] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-int RandK::iff = 0;
+thread_local int RandK::inext = 0;
+thread_local int RandK::inextp = 0;
+thread_local long RandK::ma[56] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+thread_local int RandK::iff = 0;
+
+// deviate saved by gasdev for its next call; per thread, like randk state
+static thread_local int gasdev_iset = 0;
+static thread_local double gasdev_gset;
 
 /************************************************************************
  * randk                                                                *
@@ -88,6 +92,7 @@ double RandK::randk(long idum /* = 1 */)
 	    } 
 	inext=0;
 	inextp=31;			// also a 'special' value
+	gasdev_iset=0;			// don't reuse deviate from old sequence
     } 
  
     // actual generation of uniform random deviate
@@ -99,6 +104,54 @@ double RandK::randk(long idum /* = 1 */)
     return mj*FAC;
 }
 
+/************************************************************************
+ * RandK::seedStream                                                    *
+ *   Initializes the calling thread's sequence from a seed and a stream *
+ *   number.  The two are mixed so that neighbouring streams don't get  *
+ *   neighbouring ran3 seeds.                                           *
+ *                                                                      *
+ * Parameters:                                                          *
+ *   long seed:		base seed (e.g. drawn from the main sequence)   *
+ *   int stream:	stream number (e.g. chunk index)                *
+ *                                                                      *
+ * Returns:  nothing                                                    *
+ ************************************************************************/
+void RandK::seedStream(long seed, int stream)
+{
+  unsigned long h = (unsigned long)seed * 2654435761UL 
+  			+ (unsigned long)(stream+1) * 40503UL;
+  h ^= h >> 15;
+  h *= 2246822519UL;
+  h ^= h >> 13;
+  randk( -long(h % (MBIG-1) + 1) );
+}
+
+/************************************************************************
+ * RandK::getState, RandK::setState                                     *
+ *   Copy the calling thread's generator state (including the deviate   *
+ *   gasdev may be holding) out or back in.                             *
+ *                                                                      *
+ * Parameters:                                                          *
+ *   State &rs:		where to store, or take, the state              *
+ *                                                                      *
+ * Returns:  nothing                                                    *
+ ************************************************************************/
+void RandK::getState(State &rs)
+{
+  rs.inext = inext; rs.inextp = inextp; rs.iff = iff;
+  for (int i=0; i<56; i++)
+    rs.ma[i] = ma[i];
+  rs.gasdevSet = gasdev_iset; rs.gasdevValue = gasdev_gset;
+}
+
+void RandK::setState(const State &rs)
+{
+  inext = rs.inext; inextp = rs.inextp; iff = rs.iff;
+  for (int i=0; i<56; i++)
+    ma[i] = rs.ma[i];
+  gasdev_iset = rs.gasdevSet; gasdev_gset = rs.gasdevValue;
+}
+
 /************************************************************************
  * RandK::writeToFile                                                   *
  *   Writes the values used in randk to keep track of random number	*
@@ -171,11 +224,9 @@ bool sampleBernoulli(double prob)
  ************************************************************************/
 double gasdev()
 {
-  static int iset=0;
-  static double gset;
   double fac, rsq, v1, v2;
  
-  if (iset == 0)		// no deviate already generated
+  if (gasdev_iset == 0)		// no deviate already generated
   {
     do { // until get pair in unit circle
       // pick two uniform numbers in the square extending from -1 to + 1 
@@ -188,14 +239,14 @@ double gasdev()
     fac = sqrt(-2.0*log(rsq)/rsq);
 
     // Box-Muller transformation gives two deviates, save one
-    gset = v1*fac;
-    iset = 1;
+    gasdev_gset = v1*fac;
+    gasdev_iset = 1;
     return v2*fac;
   }
   else				// use deviate generated last time
   {
-    iset = 0;
-    return gset;
+    gasdev_iset = 0;
+    return gasdev_gset;
   }
 }
 
@@ -27,6 +27,7 @@
 
 #include <vector>
 #include <algorithm>
+#include <fstream>
 
 using namespace std;
 
@@ -36,6 +37,23 @@ using namespace std;
 class RandK {
   public:
     static double randk(long idum = 1);
+
+    // (re)initialize the calling thread's sequence from a seed and a 
+    // stream number - gives independent, reproducible sequences to the
+    // chunks of a parallel update
+    static void seedStream(long seed, int stream);
+
+    // the calling thread's generator state, so a stream can be switched
+    // in and the original sequence resumed afterwards
+    struct State {
+      int inext, inextp, iff;
+      long ma[56];
+      int gasdevSet;		// gasdev's saved deviate, if any
+      double gasdevValue;
+    };
+    static void getState(State &rs);
+    static void setState(const State &rs);
+
     static void writeToFile(ofstream &outfile);
     static void readFromFile(ifstream &infile);
 
@@ -43,9 +61,11 @@ class RandK {
     RandK();
 
   private:
-    static int inext, inextp;
-    static long ma[56];
-    static int iff;
+    // each thread has its own generator state; the main thread's is the
+    // one used outside parallel loops, and the one checkpointed
+    static thread_local int inext, inextp;
+    static thread_local long ma[56];
+    static thread_local int iff;
 
     // not used
     RandK(const RandK &rr);
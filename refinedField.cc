@@ -0,0 +1,883 @@
+
+/************************************************************************
+ * 									*
+ * Copyright (C) 2004  Christina Warrender				*
+ * 									*
+ * This file is part of CyCells.					*
+ *									*
+ * CyCells is free software; you can redistribute it and/or modify it 	*
+ * under the terms of the GNU General Public License as published by	*
+ * the Free Software Foundation; either version 2 of the License, or	*
+ * (at your option) any later version.					*
+ *									*
+ * CyCells is distributed in the hope that it will be useful,		*
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of	*
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the	*
+ * GNU General Public License for more details.				*
+ *									*
+ * You should have received a copy of the GNU General Public License	*
+ * along with CyCells; if not, write to the Free Software Foundation, 	*
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA	*
+ *									*
+ ************************************************************************/
+/************************************************************************
+ * file refinedField.cc                                                 *
+ * Routines for RefinedField class                                      *
+ ************************************************************************/
+
+#include "refinedField.h"
+#include <cmath>
+#include <cassert>
+#include "simPoint.h"
+#include "stencil.h"
+
+using namespace std;
+
+/************************************************************************ 
+ * RefinedField()                                                       *
+ *   Constructor; starts with no refined blocks                         *
+ *                                                                      *
+ * Parameters                                                           *
+ *   int xsize, ysize, zsize:	#coarse grid cells in each dimension    *
+ *   int gridsize:		size of coarse grid cell in microns     *
+ *   int ratio:			fine cells per coarse cell, per side    *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+RefinedField::RefinedField(int xsize, int ysize, int zsize, int gridsize, 
+			   int ratio) : 
+	m_xsize(xsize), m_ysize(ysize), m_zsize(zsize), m_gridsize(gridsize),
+	m_ratio(ratio), m_zratio((zsize == 1) ? 1 : ratio),
+	m_bx((xsize+REFINE_BLOCK-1)/REFINE_BLOCK), 
+	m_by((ysize+REFINE_BLOCK-1)/REFINE_BLOCK), 
+	m_bz((zsize+REFINE_BLOCK-1)/REFINE_BLOCK), m_newWeight(1)
+{
+  assert(ratio > 1);
+  assert(gridsize > 0);
+  m_blockIndex.assign(m_bx*m_by*m_bz, -1);
+  m_sources.assign(m_bx*m_by*m_bz, 0);
+}
+
+/************************************************************************ 
+ * ~RefinedField()                                                      *
+ *   Destructor; deletes blocks                                         *
+ *                                                                      *
+ * Parameters - none                                                    *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+RefinedField::~RefinedField()
+{
+  clear();
+}
+
+/************************************************************************ 
+ * clear()                                                              *
+ *   Removes all refined blocks - the coarse grid already has their     *
+ *   (averaged) values                                                  *
+ *                                                                      *
+ * Parameters - none                                                    *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void RefinedField::clear()
+{
+  for (unsigned int n=0; n<m_blocks.size(); n++)
+    delete m_blocks[n];
+  m_blocks.clear();
+  m_blockIndex.assign(m_bx*m_by*m_bz, -1);
+}
+
+/************************************************************************ 
+ * newBlock()                                                           *
+ *   Creates one fine block; each fine cell starts with the value of    *
+ *   the coarse cell containing it (so nothing is gained or lost)       *
+ *                                                                      *
+ * Parameters                                                           *
+ *   int bi, bj, bk:		block indices                           *
+ *   const Conc *coarse:	coarse concentrations                   *
+ *                                                                      *
+ * Returns - new block                                                  *
+ ************************************************************************/
+RefinedField::Block *RefinedField::newBlock(int bi, int bj, int bk, 
+					    const Conc *coarse)
+{
+  Block *pb = new Block;
+  pb->bi = bi; pb->bj = bj; pb->bk = bk;
+  pb->ci = bi*REFINE_BLOCK; pb->cj = bj*REFINE_BLOCK; pb->ck = bk*REFINE_BLOCK;
+  pb->cx = (m_xsize - pb->ci < REFINE_BLOCK) ? m_xsize - pb->ci : REFINE_BLOCK;
+  pb->cy = (m_ysize - pb->cj < REFINE_BLOCK) ? m_ysize - pb->cj : REFINE_BLOCK;
+  pb->cz = (m_zsize - pb->ck < REFINE_BLOCK) ? m_zsize - pb->ck : REFINE_BLOCK;
+  pb->fx = pb->cx*m_ratio; pb->fy = pb->cy*m_ratio; pb->fz = pb->cz*m_zratio;
+  pb->conc.assign((pb->fx+2)*(pb->fy+2)*(pb->fz+2), 0);
+  pb->next.assign(pb->conc.size(), 0);
+  pb->pending = false;
+
+  for (int a=0; a<pb->fx; a++)
+    for (int b=0; b<pb->fy; b++)
+      for (int c=0; c<pb->fz; c++)
+        pb->conc[pb->index(a,b,c)] = coarse[coarseIndex(pb->ci + a/m_ratio,
+		pb->cj + b/m_ratio, pb->ck + c/m_zratio)];
+  return pb;
+}
+
+/************************************************************************ 
+ * regrid()                                                             *
+ *   Chooses blocks to refine:  those with sources since the last       *
+ *   regrid, or with a coarse gradient (largest difference between      *
+ *   neighboring cells) at least REFINE_GRADIENT times the steepest     *
+ *   anywhere, plus one block all around them, so features don't move  *
+ *   out of the refined region before the next regrid.  Blocks still    *
+ *   wanted are kept as they are.                                       *
+ *                                                                      *
+ * Parameters                                                           *
+ *   const Conc *coarse:	coarse concentrations                   *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void RefinedField::regrid(const Conc *coarse)
+{
+  const int nblocks = m_bx*m_by*m_bz;
+  vector<char> flag(m_sources);
+
+  // steepest difference to a neighbor cell (wrapping), per block
+  vector<Conc> block_max(nblocks, 0);
+  Conc max_diff = 0;
+  for (int i=0; i<m_xsize; i++)
+    for (int j=0; j<m_ysize; j++)
+      for (int k=0; k<m_zsize; k++)
+      {
+        Conc c = coarse[coarseIndex(i,j,k)];
+        Conc d = fabs(c - coarse[coarseIndex((i+1)%m_xsize, j, k)]);
+        Conc dy = fabs(c - coarse[coarseIndex(i, (j+1)%m_ysize, k)]);
+        Conc dz = fabs(c - coarse[coarseIndex(i, j, (k+1)%m_zsize)]);
+        if (dy > d) d = dy;
+        if (dz > d) d = dz;
+        int bn = blockNum(i/REFINE_BLOCK, j/REFINE_BLOCK, k/REFINE_BLOCK);
+        if (d > block_max[bn]) block_max[bn] = d;
+        if (d > max_diff) max_diff = d;
+      }
+  if (max_diff > 0)
+    for (int bn=0; bn<nblocks; bn++)
+      if (block_max[bn] >= REFINE_GRADIENT*max_diff)
+        flag[bn] = 1;
+
+  // add a layer of blocks around those (wrapping)
+  vector<char> want(flag);
+  for (int bi=0; bi<m_bx; bi++)
+    for (int bj=0; bj<m_by; bj++)
+      for (int bk=0; bk<m_bz; bk++)
+        if (flag[blockNum(bi,bj,bk)])
+          for (int di=-1; di<=1; di++)
+            for (int dj=-1; dj<=1; dj++)
+              for (int dk=-1; dk<=1; dk++)
+                want[blockNum((bi+di+m_bx)%m_bx, (bj+dj+m_by)%m_by, 
+			      (bk+dk+m_bz)%m_bz)] = 1;
+
+  // keep, create or drop blocks
+  vector<Block*> blocks;
+  for (int bn=0; bn<nblocks; bn++)
+  {
+    int old = m_blockIndex[bn];
+    if (want[bn])
+    {
+      int bi = bn/(m_by*m_bz), bj = (bn/m_bz)%m_by, bk = bn%m_bz;
+      blocks.push_back((old >= 0) ? m_blocks[old] : 
+		       newBlock(bi, bj, bk, coarse));
+    }
+    else if (old >= 0)
+      delete m_blocks[old];
+  }
+  m_blocks.swap(blocks);
+  m_blockIndex.assign(nblocks, -1);
+  for (unsigned int n=0; n<m_blocks.size(); n++)
+    m_blockIndex[blockNum(m_blocks[n]->bi, m_blocks[n]->bj, 
+			  m_blocks[n]->bk)] = n;
+  m_sources.assign(nblocks, 0);
+
+  for (unsigned int n=0; n<m_blocks.size(); n++)
+    fillGhosts(*m_blocks[n], coarse);
+}
+
+/************************************************************************ 
+ * markSource()                                                         *
+ *   Notes that something was added or removed at p, so p's block will  *
+ *   be refined at the next regrid                                      *
+ *                                                                      *
+ * Parameters                                                           *
+ *   const SimPoint &p:		location                                *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void RefinedField::markSource(const SimPoint &p)
+{
+  int i, j, k;
+  double px, py, pz;
+  locate(p, i, j, k, px, py, pz);
+  m_sources[blockNum(i/REFINE_BLOCK, j/REFINE_BLOCK, k/REFINE_BLOCK)] = 1;
+}
+
+/************************************************************************ 
+ * locate()                                                             *
+ *   Wraps p into the model space and finds the coarse cell containing  *
+ *   it                                                                 *
+ *                                                                      *
+ * Parameters                                                           *
+ *   const SimPoint &p:		location                                *
+ *   int &i, &j, &k:		set to coarse cell indices              *
+ *   double &px, &py, &pz:	set to wrapped location                 *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void RefinedField::locate(const SimPoint &p, int &i, int &j, int &k,
+			  double &px, double &py, double &pz) const
+{
+  double lx = m_xsize*m_gridsize, ly = m_ysize*m_gridsize;
+  double lz = m_zsize*m_gridsize;
+  px = fmod(p.getX(), lx); py = fmod(p.getY(), ly); pz = fmod(p.getZ(), lz);
+  if (px < 0) px += lx;
+  if (py < 0) py += ly;
+  if (pz < 0) pz += lz;
+
+  i = int(px/m_gridsize); j = int(py/m_gridsize); k = int(pz/m_gridsize);
+  if (i >= m_xsize) i = m_xsize-1;	// rounding at far edge
+  if (j >= m_ysize) j = m_ysize-1;
+  if (k >= m_zsize) k = m_zsize-1;
+}
+
+/************************************************************************ 
+ * findBlock()                                                          *
+ *   Finds the refined block containing p, if any (p is wrapped into    *
+ *   the model space first), and p's position in the block in fine      *
+ *   cells - fine cell a covers [a,a+1)                                 *
+ *                                                                      *
+ * Parameters                                                           *
+ *   const SimPoint &p:		location                                *
+ *   double &x, &y, &z:		set to position in block                *
+ *                                                                      *
+ * Returns - block, or 0 if p isn't refined                             *
+ ************************************************************************/
+RefinedField::Block *RefinedField::findBlock(const SimPoint &p, double &x,
+					     double &y, double &z) const
+{
+  int i, j, k;
+  double px, py, pz;
+  locate(p, i, j, k, px, py, pz);
+  int n = m_blockIndex[blockNum(i/REFINE_BLOCK, j/REFINE_BLOCK, 
+				k/REFINE_BLOCK)];
+  if (n < 0)
+    return 0;
+
+  Block *pb = m_blocks[n];
+  x = px*m_ratio/m_gridsize - pb->ci*m_ratio;
+  y = py*m_ratio/m_gridsize - pb->cj*m_ratio;
+  z = pz*m_zratio/m_gridsize - pb->ck*m_zratio;
+  return pb;
+}
+
+/************************************************************************ 
+ * fineCell()                                                           *
+ *   Finds the fine cell containing p                                   *
+ *                                                                      *
+ * Parameters                                                           *
+ *   const SimPoint &p:		location                                *
+ *                                                                      *
+ * Returns - pointer to fine cell's concentration, or 0 if p isn't      *
+ *   refined                                                            *
+ ************************************************************************/
+RefinedField::Conc *RefinedField::fineCell(const SimPoint &p) const
+{
+  double x, y, z;
+  Block *pb = findBlock(p, x, y, z);
+  if (!pb)
+    return 0;
+
+  int a = int(x), b = int(y), c = int(z);
+  if (a >= pb->fx) a = pb->fx-1;	// rounding at far edge
+  if (b >= pb->fy) b = pb->fy-1;
+  if (c >= pb->fz) c = pb->fz-1;
+  return &pb->conc[pb->index(a,b,c)];
+}
+
+/************************************************************************ 
+ * changeConc(), deposit()                                              *
+ *   Add a change to the fine cell containing p - immediately, or in    *
+ *   the block's deposit grid.  A fine cell is a fraction of a coarse   *
+ *   cell, so the same number of molecules is a bigger concentration    *
+ *   change.                                                            *
+ *                                                                      *
+ * Parameters                                                           *
+ *   Conc change:		change in coarse concentration units    *
+ *   const SimPoint &p:		location                                *
+ *                                                                      *
+ * Returns - true if p is refined                                       *
+ ************************************************************************/
+bool RefinedField::changeConc(Conc change, const SimPoint &p)
+{
+  Conc *pc = fineCell(p);
+  if (!pc)
+    return false;
+
+  *pc += change*(m_ratio*m_ratio*m_zratio);
+  if (*pc < 0)			// rounding
+    *pc = 0;
+  return true;
+}
+
+bool RefinedField::deposit(Conc change, const SimPoint &p)
+{
+  double x, y, z;
+  Block *pb = findBlock(p, x, y, z);
+  if (!pb)
+    return false;
+
+  int a = int(x), b = int(y), c = int(z);
+  if (a >= pb->fx) a = pb->fx-1;
+  if (b >= pb->fy) b = pb->fy-1;
+  if (c >= pb->fz) c = pb->fz-1;
+  if (pb->deposit.empty())
+    pb->deposit.assign(pb->conc.size(), 0);
+  pb->deposit[pb->index(a,b,c)] += change*(m_ratio*m_ratio*m_zratio);
+  pb->pending = true;
+  return true;
+}
+
+/************************************************************************ 
+ * applyDeposits()                                                      *
+ *   Adds deposits to fine cells, not going below 0 (as 		*
+ *   Molecule::applyChanges does), then resets the coarse cells they    *
+ *   cover                                                              *
+ *                                                                      *
+ * Parameters                                                           *
+ *   Conc *coarse:		coarse concentrations                   *
+ *                                                                      *
+ * Returns - change in sum of coarse concentrations                     *
+ ************************************************************************/
+RefinedField::Conc RefinedField::applyDeposits(Conc *coarse)
+{
+  Conc change = 0;
+  for (unsigned int n=0; n<m_blocks.size(); n++)
+  {
+    Block &b = *m_blocks[n];
+    if (!b.pending)
+      continue;
+    for (int i=0; i<(int)b.conc.size(); i++)
+    {
+      Conc c = b.conc[i] + b.deposit[i];
+      b.conc[i] = (c < 0) ? 0 : c;
+      b.deposit[i] = 0;
+    }
+    b.pending = false;
+    change += restrict(b, coarse);
+  }
+  return change;
+}
+
+/************************************************************************ 
+ * beginStep()                                                          *
+ *   Saves the coarse values at the start of a step, so ghost cells can *
+ *   be interpolated in time as well as space                           *
+ *                                                                      *
+ * Parameters                                                           *
+ *   const Conc *coarse:	coarse concentrations                   *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void RefinedField::beginStep(const Conc *coarse)
+{
+  if (m_blocks.empty())
+    return;
+  m_oldCoarse.assign(coarse, coarse + m_xsize*m_ysize*m_zsize);
+}
+
+/************************************************************************ 
+ * update()                                                             *
+ *   Explicit diffusion and decay on every fine block, with as many     *
+ *   substeps as the fine grid needs for stability (ratio^2 times the   *
+ *   coarse grid's).  Before each substep every block's ghost layer is  *
+ *   filled (see fillGhosts); coarse values for them are interpolated   *
+ *   between the start (see beginStep) and end of the step, at the      *
+ *   middle of the substep.  Then the coarse cells under fine blocks    *
+ *   are set to the fine averages, and the unrefined coarse cells next  *
+ *   to them are corrected for the difference between what crossed      *
+ *   their faces on the fine grid and on the coarse grid (see reflux).  *
+ *                                                                      *
+ * Parameters                                                           *
+ *   Conc *coarse:		coarse concentrations, already updated  *
+ *   double diff_rate:		microns^2/sec                           *
+ *   double decay_rate:		/sec                                    *
+ *   double deltaT:		duration of time step in seconds        *
+ *                                                                      *
+ * Returns - change in sum of coarse concentrations                     *
+ ************************************************************************/
+RefinedField::Conc RefinedField::update(Conc *coarse, double diff_rate, 
+					double decay_rate, double deltaT)
+{
+  if (m_blocks.empty())
+    return 0;
+
+  // stability requirement:  deltaT <= (deltaX)^2/(2*numdim*D), with
+  // decay rate*deltaT counted too (see Molecule::advance)
+  double finesq = double(m_gridsize)*m_gridsize/(m_ratio*m_ratio);
+  int numdim2 = (m_zsize == 1) ? 4 : 6;
+  int num_time_steps = int(numdim2*diff_rate*deltaT/finesq 
+		  	   + decay_rate*deltaT) + 1;
+  double dt = deltaT/num_time_steps;
+  double decay_factor = decay_rate*dt;
+  assert(decay_factor < 1);
+  double diff_factor = diff_rate*dt/finesq;
+
+  // in 2D the ghost cells above and below are the cells themselves, 
+  // so the z terms of the 7-point stencil are 0
+  Stencil::Row7 row7 = Stencil::getRow7();
+  bool have_old = (m_oldCoarse.size() == (unsigned int)m_xsize*m_ysize*m_zsize);
+  for (unsigned int n=0; n<m_blocks.size(); n++)
+    m_blocks[n]->flux.assign(m_blocks[n]->numFaces(), 0);
+  for (int step=0; step<num_time_steps; step++)
+  {
+    m_newWeight = have_old ? (step+0.5)/num_time_steps : 1;
+    for (unsigned int n=0; n<m_blocks.size(); n++)
+      fillGhosts(*m_blocks[n], coarse);
+
+    for (unsigned int n=0; n<m_blocks.size(); n++)
+    {
+      Block &b = *m_blocks[n];
+      addFineFlux(b, diff_factor);
+      for (int a=0; a<b.fx; a++)
+        for (int c=0; c<b.fy; c++)
+        {
+          // whole rows including ghosts - row7 does [1,n-1)
+          const Conc *row = &b.conc[b.index(a,c,-1)];
+          row7(&b.next[b.index(a,c,-1)], row, &b.conc[b.index(a-1,c,-1)], 
+	       &b.conc[b.index(a+1,c,-1)], &b.conc[b.index(a,c-1,-1)], 
+	       &b.conc[b.index(a,c+1,-1)], b.fz+2, decay_factor, 
+	       diff_factor);
+        }
+      b.conc.swap(b.next);
+    }
+  }
+
+  m_newWeight = 1;
+  double coarse_diff = diff_rate*deltaT/(double(m_gridsize)*m_gridsize);
+  if (coarse_diff > REFLUX_MAX_DIFF)
+    coarse_diff = 0;
+  for (unsigned int n=0; n<m_blocks.size(); n++)
+    setCoarseFlux(*m_blocks[n], coarse, coarse_diff);
+  m_oldCoarse.clear();
+  Conc change = 0;
+  for (unsigned int n=0; n<m_blocks.size(); n++)
+    change += restrict(*m_blocks[n], coarse);
+  change += reflux(coarse, change);
+  for (unsigned int n=0; n<m_blocks.size(); n++)
+    fillGhosts(*m_blocks[n], coarse);	// for getInterpConc
+  return change;
+}
+
+/************************************************************************ 
+ * fineValue()                                                          *
+ *   Concentration of a fine cell anywhere in the model space (indices  *
+ *   wrapped):  from its block if refined, otherwise interpolated from  *
+ *   the coarse grid at the fine cell's center                          *
+ *                                                                      *
+ * Parameters                                                           *
+ *   int gx, gy, gz:		fine cell indices for whole space       *
+ *   const Conc *coarse:	coarse concentrations                   *
+ *                                                                      *
+ * Returns - concentration                                              *
+ ************************************************************************/
+RefinedField::Conc RefinedField::fineValue(int gx, int gy, int gz, 
+					   const Conc *coarse) const
+{
+  int nx = m_xsize*m_ratio, ny = m_ysize*m_ratio, nz = m_zsize*m_zratio;
+  gx = (gx%nx + nx)%nx; gy = (gy%ny + ny)%ny; gz = (gz%nz + nz)%nz;
+
+  int n = m_blockIndex[blockNum(gx/m_ratio/REFINE_BLOCK, 
+		gy/m_ratio/REFINE_BLOCK, gz/m_zratio/REFINE_BLOCK)];
+  if (n >= 0)
+  {
+    const Block &b = *m_blocks[n];
+    return b.conc[b.index(gx - b.ci*m_ratio, gy - b.cj*m_ratio, 
+			  gz - b.ck*m_zratio)];
+  }
+
+  // fine cell center in coarse index space; coarse cell i's center is i
+  double u = (gx+0.5)/m_ratio - 0.5;
+  double v = (gy+0.5)/m_ratio - 0.5;
+  double w = (gz+0.5)/m_zratio - 0.5;
+  Conc c = coarseInterp(u, v, w, coarse);
+  if (m_newWeight < 1)
+    c = m_newWeight*c + (1-m_newWeight)*coarseInterp(u, v, w, 
+		    				     &m_oldCoarse[0]);
+  return c;
+}
+
+/************************************************************************ 
+ * coarseInterp()                                                       *
+ *   Linear interpolation between the 8 coarse cell centers around a    *
+ *   point, wrapping around the periodic boundaries                     *
+ *                                                                      *
+ * Parameters                                                           *
+ *   double u, v, w:		point, in coarse indices (cell i's      *
+ *				center is at i)                         *
+ *   const Conc *coarse:	coarse concentrations                   *
+ *                                                                      *
+ * Returns - concentration                                              *
+ ************************************************************************/
+RefinedField::Conc RefinedField::coarseInterp(double u, double v, double w,
+					      const Conc *coarse) const
+{
+  int i0 = int(floor(u)), j0 = int(floor(v)), k0 = int(floor(w));
+  double fx = u-i0, fy = v-j0, fz = w-k0;
+  int i1 = (i0+1)%m_xsize, j1 = (j0+1)%m_ysize, k1 = (k0+1)%m_zsize;
+  i0 = (i0+m_xsize)%m_xsize; j0 = (j0+m_ysize)%m_ysize; 
+  k0 = (k0+m_zsize)%m_zsize;
+
+  Conc c = (1-fx)*(1-fy)*(1-fz)*coarse[coarseIndex(i0,j0,k0)];
+  c += fx*(1-fy)*(1-fz)*coarse[coarseIndex(i1,j0,k0)];
+  c += fx*fy*(1-fz)*coarse[coarseIndex(i1,j1,k0)];
+  c += (1-fx)*fy*(1-fz)*coarse[coarseIndex(i0,j1,k0)];
+  c += (1-fx)*(1-fy)*fz*coarse[coarseIndex(i0,j0,k1)];
+  c += fx*(1-fy)*fz*coarse[coarseIndex(i1,j0,k1)];
+  c += fx*fy*fz*coarse[coarseIndex(i1,j1,k1)];
+  c += (1-fx)*fy*fz*coarse[coarseIndex(i0,j1,k1)];
+  return c;
+}
+
+/************************************************************************ 
+ * fillGhosts()                                                         *
+ *   Sets a block's ghost layer (edges and corners too, for             *
+ *   getInterpConc) - see fineValue                                     *
+ *                                                                      *
+ * Parameters                                                           *
+ *   Block &b:			block                                   *
+ *   const Conc *coarse:	coarse concentrations                   *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void RefinedField::fillGhosts(Block &b, const Conc *coarse)
+{
+  int x0 = b.ci*m_ratio, y0 = b.cj*m_ratio, z0 = b.ck*m_zratio;
+  for (int a=-1; a<=b.fx; a++)
+    for (int c=-1; c<=b.fy; c++)
+    {
+      if (a < 0 || a == b.fx || c < 0 || c == b.fy)	// whole column
+        for (int d=-1; d<=b.fz; d++)
+          b.conc[b.index(a,c,d)] = fineValue(x0+a, y0+c, z0+d, coarse);
+      else						// just the ends
+      {
+        b.conc[b.index(a,c,-1)] = fineValue(x0+a, y0+c, z0-1, coarse);
+        b.conc[b.index(a,c,b.fz)] = fineValue(x0+a, y0+c, z0+b.fz, coarse);
+      }
+    }
+}
+
+/************************************************************************ 
+ * restrict()                                                           *
+ *   Sets each coarse cell a block covers to the average of its fine    *
+ *   cells                                                              *
+ *                                                                      *
+ * Parameters                                                           *
+ *   const Block &b:		block                                   *
+ *   Conc *coarse:		coarse concentrations                   *
+ *                                                                      *
+ * Returns - change in sum of coarse concentrations                     *
+ ************************************************************************/
+RefinedField::Conc RefinedField::restrict(const Block &b, Conc *coarse) const
+{
+  double scale = 1.0/(m_ratio*m_ratio*m_zratio);
+  Conc change = 0;
+  for (int i=0; i<b.cx; i++)
+    for (int j=0; j<b.cy; j++)
+      for (int k=0; k<b.cz; k++)
+      {
+        Conc sum = 0;
+        for (int a=i*m_ratio; a<(i+1)*m_ratio; a++)
+          for (int c=j*m_ratio; c<(j+1)*m_ratio; c++)
+            for (int d=k*m_zratio; d<(k+1)*m_zratio; d++)
+              sum += b.conc[b.index(a,c,d)];
+        Conc &rc = coarse[coarseIndex(b.ci+i, b.cj+j, b.ck+k)];
+        change += sum*scale - rc;
+        rc = sum*scale;
+      }
+  return change;
+}
+
+/************************************************************************ 
+ * addFineFlux()                                                        *
+ *   Adds what leaves a block through its surface in one fine substep   *
+ *   to Block::flux, in coarse cell units, from the current fine cells  *
+ *   and ghost layer                                                    *
+ *                                                                      *
+ * Parameters                                                           *
+ *   Block &b:			block                                   *
+ *   double diff_factor:	D*dt/(fine deltaX)^2                    *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void RefinedField::addFineFlux(Block &b, double diff_factor)
+{
+  double scale = diff_factor/(m_ratio*m_ratio*m_zratio);
+  int nyz = b.cy*b.cz, nxz = b.cx*b.cz, nxy = b.cx*b.cy;
+  Conc *fx = &b.flux[0], *fy = fx + 2*nyz, *fz = fy + 2*nxz;
+
+  for (int c=0; c<b.fy; c++)
+    for (int d=0; d<b.fz; d++)
+    {
+      int f = (c/m_ratio)*b.cz + d/m_zratio;
+      fx[f] += scale*(b.conc[b.index(0,c,d)] - b.conc[b.index(-1,c,d)]);
+      fx[nyz+f] += scale*(b.conc[b.index(b.fx-1,c,d)] 
+		      	  - b.conc[b.index(b.fx,c,d)]);
+    }
+  for (int a=0; a<b.fx; a++)
+    for (int d=0; d<b.fz; d++)
+    {
+      int f = (a/m_ratio)*b.cz + d/m_zratio;
+      fy[f] += scale*(b.conc[b.index(a,0,d)] - b.conc[b.index(a,-1,d)]);
+      fy[nxz+f] += scale*(b.conc[b.index(a,b.fy-1,d)] 
+		      	  - b.conc[b.index(a,b.fy,d)]);
+    }
+  for (int a=0; a<b.fx; a++)
+    for (int c=0; c<b.fy; c++)
+    {
+      int f = (a/m_ratio)*b.cy + c/m_ratio;
+      fz[f] += scale*(b.conc[b.index(a,c,0)] - b.conc[b.index(a,c,-1)]);
+      fz[nxy+f] += scale*(b.conc[b.index(a,c,b.fz-1)] 
+		      	  - b.conc[b.index(a,c,b.fz)]);
+    }
+}
+
+/************************************************************************ 
+ * setCoarseFlux()                                                      *
+ *   Sets Block::coarseFlux to what left through each face on the       *
+ *   coarse grid in the step - the coarse difference across the face    *
+ *   averaged over the start and end of the step.  Only an estimate -   *
+ *   the solver's substeps see the difference change along the way;     *
+ *   reflux makes up the rest.  With diff_factor 0 (a step too long for *
+ *   the estimate - see REFLUX_MAX_DIFF) they're all 0.  Call before    *
+ *   restrict.                                                          *
+ *                                                                      *
+ * Parameters                                                           *
+ *   Block &b:			block                                   *
+ *   const Conc *coarse:	coarse concentrations, already updated  *
+ *   double diff_factor:	D*deltaT/(coarse deltaX)^2              *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void RefinedField::setCoarseFlux(Block &b, const Conc *coarse, 
+				 double diff_factor)
+{
+  bool have_old = !m_oldCoarse.empty();
+  int nfaces = b.numFaces();
+  b.coarseFlux.assign(nfaces, 0);
+  for (int f=0; f<nfaces; f++)
+  {
+    int in, out;
+    if (!faceCells(b, f, in, out))
+      continue;
+    Conc diff = coarse[in] - coarse[out];
+    if (have_old)
+      diff = 0.5*(diff + m_oldCoarse[in] - m_oldCoarse[out]);
+    b.coarseFlux[f] = diff_factor*diff;
+  }
+}
+
+/************************************************************************ 
+ * faceCells()                                                          *
+ *   The coarse cells on either side of one face of a block's surface.  *
+ *   Faces are numbered low x side, high x side (y major), then low and *
+ *   high y (x major), then low and high z (x major).                   *
+ *                                                                      *
+ * Parameters                                                           *
+ *   const Block &b:		block                                   *
+ *   int f:			face                                    *
+ *   int &in:			set to index of coarse cell in block    *
+ *   int &out:			set to index of coarse cell outside     *
+ *                                                                      *
+ * Returns - true if the outside cell is not refined                    *
+ ************************************************************************/
+bool RefinedField::faceCells(const Block &b, int f, int &in, int &out) const
+{
+  int nyz = b.cy*b.cz, nxz = b.cx*b.cz, nxy = b.cx*b.cy;
+  int i, j, k, di = 0, dj = 0, dk = 0;
+  if (f < 2*nyz)
+  {
+    bool high = (f >= nyz);
+    f %= nyz;
+    i = high ? b.cx-1 : 0; j = f/b.cz; k = f%b.cz; di = high ? 1 : -1;
+  }
+  else if ((f -= 2*nyz) < 2*nxz)
+  {
+    bool high = (f >= nxz);
+    f %= nxz;
+    i = f/b.cz; j = high ? b.cy-1 : 0; k = f%b.cz; dj = high ? 1 : -1;
+  }
+  else
+  {
+    f -= 2*nxz;
+    bool high = (f >= nxy);
+    f %= nxy;
+    i = f/b.cy; j = f%b.cy; k = high ? b.cz-1 : 0; dk = high ? 1 : -1;
+  }
+  i += b.ci; j += b.cj; k += b.ck;
+  in = coarseIndex(i, j, k);
+  i = (i + di + m_xsize)%m_xsize;
+  j = (j + dj + m_ysize)%m_ysize;
+  k = (k + dk + m_zsize)%m_zsize;
+  out = coarseIndex(i, j, k);
+  return m_blockIndex[blockNum(i/REFINE_BLOCK, j/REFINE_BLOCK, 
+			       k/REFINE_BLOCK)] < 0;
+}
+
+/************************************************************************ 
+ * reflux()                                                             *
+ *   Gives each unrefined coarse cell next to a fine block what the     *
+ *   fine grid sent it across their shared face, instead of what the    *
+ *   coarse grid did.  The coarse fluxes are estimates (see             *
+ *   setCoarseFlux), but restrict's change in the sum is exactly the    *
+ *   mismatch over all faces, so the estimates' error is spread over    *
+ *   the faces in proportion to their fine fluxes (evenly if there are  *
+ *   none); the total is then the coarse solver's.  A cell is not made  *
+ *   negative - the rest of its share goes to the others - so only if   *
+ *   every cell along the boundary empties is anything left over in the *
+ *   sum.                                                               *
+ *                                                                      *
+ * Parameters                                                           *
+ *   Conc *coarse:		coarse concentrations, restricted       *
+ *   Conc mismatch:		change in sum of coarse concentrations  *
+ *				from restrict                           *
+ *                                                                      *
+ * Returns - change in sum of coarse concentrations                     *
+ ************************************************************************/
+RefinedField::Conc RefinedField::reflux(Conc *coarse, Conc mismatch)
+{
+  // fine minus coarse over all faces should be -mismatch
+  vector<int> cell;
+  vector<Conc> want, weight;
+  Conc residual = -mismatch, total_weight = 0;
+  for (unsigned int n=0; n<m_blocks.size(); n++)
+  {
+    const Block &b = *m_blocks[n];
+    for (int f=0; f<b.numFaces(); f++)
+    {
+      int in, out;
+      if (!faceCells(b, f, in, out))
+        continue;
+      cell.push_back(out);
+      want.push_back(b.flux[f] - b.coarseFlux[f]);
+      weight.push_back(fabs(b.flux[f]));
+      residual -= want.back();
+      total_weight += weight.back();
+    }
+  }
+  if (cell.empty())
+    return 0;
+  if (total_weight == 0)
+  {
+    weight.assign(cell.size(), 1);
+    total_weight = cell.size();
+  }
+
+  // what a cell can't give without going negative is taken from the 
+  // others, by weight
+  Conc change = 0;
+  do
+  {
+    Conc share = residual/total_weight;
+    residual = 0;
+    total_weight = 0;
+    for (unsigned int n=0; n<cell.size(); n++)
+    {
+      Conc &c = coarse[cell[n]];
+      Conc correction = want[n] + share*weight[n];
+      want[n] = 0;
+      if (c + correction < 0)
+      {
+        residual += c + correction;
+        correction = -c;
+        weight[n] = 0;
+      }
+      c += correction;
+      change += correction;
+      total_weight += weight[n];
+    }
+  } while (residual != 0 && total_weight > 0);
+  return change;
+}
+
+/************************************************************************ 
+ * getConc()                                                            *
+ *   Concentration of the fine cell containing p                        *
+ *                                                                      *
+ * Parameters                                                           *
+ *   const SimPoint &p:		location                                *
+ *   Conc &c:			set to concentration, if refined        *
+ *                                                                      *
+ * Returns - true if p is refined                                       *
+ ************************************************************************/
+bool RefinedField::getConc(const SimPoint &p, Conc &c) const
+{
+  Conc *pc = fineCell(p);
+  if (!pc)
+    return false;
+  c = *pc;
+  return true;
+}
+
+/************************************************************************ 
+ * getInterpConc()                                                      *
+ *   Concentration at p, by linear interpolation between the centers of *
+ *   the 8 surrounding fine cells (ghost cells at block edges)          *
+ *                                                                      *
+ * Parameters                                                           *
+ *   const SimPoint &p:		location                                *
+ *   Conc &c:			set to concentration, if refined        *
+ *                                                                      *
+ * Returns - true if p is refined                                       *
+ ************************************************************************/
+bool RefinedField::getInterpConc(const SimPoint &p, Conc &c) const
+{
+  double x, y, z;
+  Block *pb = findBlock(p, x, y, z);
+  if (!pb)
+    return false;
+
+  // cell a's center is at a+0.5; a ranges from -1 (ghost) to fx
+  double u = x-0.5, v = y-0.5, w = z-0.5;
+  int a0 = int(floor(u)), b0 = int(floor(v)), c0 = int(floor(w));
+  if (a0 >= pb->fx) a0 = pb->fx-1;	// rounding at far edge
+  if (b0 >= pb->fy) b0 = pb->fy-1;
+  if (c0 >= pb->fz) c0 = pb->fz-1;
+  double fx = u-a0, fy = v-b0, fz = w-c0;
+  const Block &b = *pb;
+
+  c = (1-fx)*(1-fy)*(1-fz)*b.conc[b.index(a0,b0,c0)];
+  c += fx*(1-fy)*(1-fz)*b.conc[b.index(a0+1,b0,c0)];
+  c += fx*fy*(1-fz)*b.conc[b.index(a0+1,b0+1,c0)];
+  c += (1-fx)*fy*(1-fz)*b.conc[b.index(a0,b0+1,c0)];
+  c += (1-fx)*(1-fy)*fz*b.conc[b.index(a0,b0,c0+1)];
+  c += fx*(1-fy)*fz*b.conc[b.index(a0+1,b0,c0+1)];
+  c += fx*fy*fz*b.conc[b.index(a0+1,b0+1,c0+1)];
+  c += (1-fx)*fy*fz*b.conc[b.index(a0,b0+1,c0+1)];
+  return true;
+}
+
+/************************************************************************ 
+ * getCoarseBox()                                                       *
+ *   Coarse cells covered by one block                                  *
+ *                                                                      *
+ * Parameters                                                           *
+ *   int n:			block number, 0 to getNumBlocks()-1     *
+ *   int &i0, &i1, ...:		set to index ranges [i0,i1) etc.        *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void RefinedField::getCoarseBox(int n, int &i0, int &i1, int &j0, int &j1,
+				int &k0, int &k1) const
+{
+  assert(n >= 0 && n < (int)m_blocks.size());
+  const Block &b = *m_blocks[n];
+  i0 = b.ci; i1 = b.ci + b.cx;
+  j0 = b.cj; j1 = b.cj + b.cy;
+  k0 = b.ck; k1 = b.ck + b.cz;
+}
+
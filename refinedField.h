@@ -0,0 +1,173 @@
+
+/************************************************************************
+ * 									*
+ * Copyright (C) 2004  Christina Warrender				*
+ * 									*
+ * This file is part of CyCells.					*
+ *									*
+ * CyCells is free software; you can redistribute it and/or modify it 	*
+ * under the terms of the GNU General Public License as published by	*
+ * the Free Software Foundation; either version 2 of the License, or	*
+ * (at your option) any later version.					*
+ *									*
+ * CyCells is distributed in the hope that it will be useful,		*
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of	*
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the	*
+ * GNU General Public License for more details.				*
+ *									*
+ * You should have received a copy of the GNU General Public License	*
+ * along with CyCells; if not, write to the Free Software Foundation, 	*
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA	*
+ *									*
+ ************************************************************************/
+/************************************************************************
+ * file refinedField.h                                                  *
+ * Declarations for RefinedField class                                  *
+ * Finer grid for parts of one molecule type's concentration field      *
+ ***********************************************************************/
+
+#ifndef REFINEDFIELD_H
+#define REFINEDFIELD_H
+
+#include <vector>
+class SimPoint;
+
+// coarse grid cells per side of a refinement block
+#define REFINE_BLOCK 4
+
+// a block is refined if its steepest coarse gradient is at least this 
+// fraction of the steepest in the whole field
+#define REFINE_GRADIENT 0.25
+
+// number of updates between choosing blocks again
+#define REGRID_INTERVAL 10
+
+// largest D*deltaT/deltaX^2 for which the coarse flux through a face is
+// estimated from the coarse cells either side (see setCoarseFlux) - 
+// over longer steps (RKC, ADI, spectral) the estimate isn't stable
+#define REFLUX_MAX_DIFF 1.0
+
+using namespace std;
+
+// One level of refinement for a Molecule's field:  the coarse grid is 
+// divided into blocks of REFINE_BLOCK^3 cells, and blocks near sources
+// (wherever changeConc was called) or steep gradients get a grid 'ratio'
+// times finer in each dimension (not z, in 2D).  Fine blocks are updated
+// explicitly after the coarse grid, with ghost cells taken from 
+// neighboring fine blocks or interpolated from the coarse grid, and 
+// then averaged back onto the coarse cells they cover - so the coarse 
+// field stays a complete (if blurrier) picture, and everything that 
+// reads it whole (output, averages) is unaffected.  Point queries and 
+// changes go to the fine grid where there is one.
+// What crosses a coarse/fine boundary is what the fine grid says; the 
+// unrefined coarse cells along it are corrected to match (refluxing), 
+// so the total is the coarse solver's.
+class RefinedField {
+  public:
+    typedef double Conc;
+
+    //--------------------------- CREATORS --------------------------------- 
+    // coarse geometry (as in Molecule) and refinement ratio
+    RefinedField(int xsize, int ysize, int zsize, int gridsize, int ratio);
+    // copy constructor not used
+    ~RefinedField();
+
+    //------------------------- MANIPULATORS -------------------------------
+    // assignment not used
+
+    // choose blocks again (see class comment); new blocks start out 
+    // with their coarse cells' values
+    void regrid(const Conc *coarse);
+    void clear();				// no refined blocks
+
+    // note a source/sink at p, for the next regrid
+    void markSource(const SimPoint &p);
+
+    // add change (in coarse concentration units - moles/ml spread over 
+    // a coarse cell) to the fine cell containing p, if there is one; 
+    // deposit does the same in deferred mode, and applyDeposits adds 
+    // them all (not going below 0).  Both return whether p is refined.
+    bool changeConc(Conc change, const SimPoint &p);
+    bool deposit(Conc change, const SimPoint &p);
+    Conc applyDeposits(Conc *coarse);
+
+    // diffusion and decay for one step:  call beginStep before the 
+    // coarse grid is updated, and update after; refined coarse cells are
+    // then set from the fine ones.  applyDeposits and update return how 
+    // much that changed the sum of the coarse values.
+    void beginStep(const Conc *coarse);
+    Conc update(Conc *coarse, double diff_rate, double decay_rate, 
+    		double deltaT);
+
+    //--------------------------- ACCESSORS --------------------------------
+    // concentration at p from the fine grid - false if p isn't refined
+    bool getConc(const SimPoint &p, Conc &c) const;
+    bool getInterpConc(const SimPoint &p, Conc &c) const;
+
+    // refined blocks, as ranges of coarse indices [i0,i1) etc.
+    int getNumBlocks() const {return m_blocks.size();};
+    void getCoarseBox(int n, int &i0, int &i1, int &j0, int &j1, 
+    		      int &k0, int &k1) const;
+
+  private:
+    struct Block {
+      int bi, bj, bk;			// block indices
+      int ci, cj, ck;			// first coarse cell
+      int cx, cy, cz;			// #coarse cells (fewer at far edges)
+      int fx, fy, fz;			// #fine cells
+      vector<Conc> conc, next;		// fine values, with a ghost layer 
+      					// all around
+      vector<Conc> deposit;		// deferred changes, if any
+      bool pending;			// any deposits?
+
+      // what left through each coarse cell face on the block's surface
+      // in the last update, fine and as the coarse grid had it (see 
+      // faceCells for the order)
+      vector<Conc> flux, coarseFlux;
+      int numFaces() const 
+      	{ return 2*(cy*cz + cx*cz + cx*cy); };
+
+      int index(int a, int b, int c) const	// ghost layer is -1
+      	{ return ((a+1)*(fy+2) + b+1)*(fz+2) + c+1; };
+    };
+
+    int m_xsize, m_ysize, m_zsize;	// coarse grid
+    int m_gridsize;
+    int m_ratio, m_zratio;		// fine cells per coarse cell
+    int m_bx, m_by, m_bz;		// #blocks in each dimension
+    vector<Block*> m_blocks;
+    vector<int> m_blockIndex;		// for each block, index in 
+    					// m_blocks or -1
+    vector<char> m_sources;		// for each block - any sources
+    					// since last regrid?
+    vector<Conc> m_oldCoarse;		// coarse grid at start of step
+    double m_newWeight;			// of coarse grid at end of step, 
+    					// for ghost cells
+
+    int coarseIndex(int i, int j, int k) const
+    	{ return (i*m_ysize + j)*m_zsize + k; };
+    int blockNum(int bi, int bj, int bk) const
+    	{ return (bi*m_by + bj)*m_bz + bk; };
+    Block *newBlock(int bi, int bj, int bk, const Conc *coarse);
+    void locate(const SimPoint &p, int &i, int &j, int &k, 
+    		double &px, double &py, double &pz) const;
+    Block *findBlock(const SimPoint &p, double &x, double &y, 
+		     double &z) const;
+    Conc *fineCell(const SimPoint &p) const;
+    Conc fineValue(int gx, int gy, int gz, const Conc *coarse) const;
+    Conc coarseInterp(double u, double v, double w, 
+    		      const Conc *coarse) const;
+    void fillGhosts(Block &b, const Conc *coarse);
+    Conc restrict(const Block &b, Conc *coarse) const;
+    void addFineFlux(Block &b, double diff_factor);
+    void setCoarseFlux(Block &b, const Conc *coarse, double diff_factor);
+    bool faceCells(const Block &b, int f, int &in, int &out) const;
+    Conc reflux(Conc *coarse, Conc mismatch);
+
+    // not used
+    RefinedField(const RefinedField &f);
+    RefinedField operator = (const RefinedField &f);
+};
+
+#endif
+
@@ -0,0 +1,329 @@
+
+/************************************************************************
+ * 									*
+ * Copyright (C) 2004  Christina Warrender				*
+ * 									*
+ * This file is part of CyCells.					*
+ *									*
+ * CyCells is free software; you can redistribute it and/or modify it 	*
+ * under the terms of the GNU General Public License as published by	*
+ * the Free Software Foundation; either version 2 of the License, or	*
+ * (at your option) any later version.					*
+ *									*
+ * CyCells is distributed in the hope that it will be useful,		*
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of	*
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the	*
+ * GNU General Public License for more details.				*
+ *									*
+ * You should have received a copy of the GNU General Public License	*
+ * along with CyCells; if not, write to the Free Software Foundation, 	*
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA	*
+ *									*
+ ************************************************************************/
+/************************************************************************
+ * file scheduler.cc                                                    *
+ * Definitions for Scheduler, a singleton work-stealing thread pool     *
+ ************************************************************************/
+
+#include "scheduler.h"
+#include <chrono>
+#include <cassert>
+
+using namespace std;
+
+// initialize single instance to null
+Scheduler* Scheduler::m_instance = 0;
+
+// wall-clock time in seconds, for utilization statistics
+static double now()
+{
+  return chrono::duration<double>(
+	chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/************************************************************************ 
+ *  getInstance()                                                       *
+ *  Checks whether an instance has already been created.  If not, calls *
+ *  constructor.                                                        *
+ *                                                                      *
+ *  Returns - pointer to (the only) instance of this class              *
+ ************************************************************************/
+Scheduler* Scheduler::getInstance()
+{
+  if (m_instance == 0)
+    m_instance = new Scheduler();
+
+  return m_instance;
+}
+
+/************************************************************************ 
+ *  Scheduler()                                                         *
+ *    Constructor - starts out serial (calling thread only)             *
+ *                                                                      *
+ *  Returns - nothing                                                   *
+ ************************************************************************/
+Scheduler::Scheduler() : m_task(0), m_n(0), m_grain(1), m_generation(0),
+	m_active(0), m_quit(false), m_wall(0), m_numRuns(0)
+{
+  m_workers.push_back(new Worker());
+}
+
+/************************************************************************ 
+ *  ~Scheduler()                                                        *
+ *    Destructor - stops helper threads, deletes per-worker data        *
+ *                                                                      *
+ *  Returns - nothing                                                   *
+ ************************************************************************/
+Scheduler::~Scheduler()
+{
+  stopThreads();
+  for (unsigned int i=0; i<m_workers.size(); i++)
+    delete m_workers[i];
+}
+
+/************************************************************************ 
+ *  setNumThreads()                                                     *
+ *    Replaces the current pool with one of the specified size.         *
+ *    Must not be called while run() is in progress.                    *
+ *                                                                      *
+ *  Parameters                                                          *
+ *    int num:		total #workers, including calling thread        *
+ *                                                                      *
+ *  Returns - nothing                                                   *
+ ************************************************************************/
+void Scheduler::setNumThreads(int num)
+{
+  assert(num >= 1);
+
+  stopThreads();
+  for (unsigned int i=0; i<m_workers.size(); i++)
+    delete m_workers[i];
+  m_workers.clear();
+
+  for (int i=0; i<num; i++)
+    m_workers.push_back(new Worker());
+
+  m_quit = false;
+  for (int i=1; i<num; i++)
+    m_threads.push_back(thread(&Scheduler::workerLoop, this, i, 
+				m_generation));
+
+  resetStats();
+}
+
+/************************************************************************ 
+ *  stopThreads()                                                       *
+ *    Tells helper threads to exit and waits for them                   *
+ *                                                                      *
+ *  Returns - nothing                                                   *
+ ************************************************************************/
+void Scheduler::stopThreads()
+{
+  {
+    lock_guard<mutex> lk(m_mutex);
+    m_quit = true;
+  }
+  m_start.notify_all();
+  for (unsigned int i=0; i<m_threads.size(); i++)
+    m_threads[i].join();
+  m_threads.clear();
+}
+
+/************************************************************************ 
+ *  resetStats()                                                        *
+ *    Zeroes per-worker utilization data                                *
+ *                                                                      *
+ *  Returns - nothing                                                   *
+ ************************************************************************/
+void Scheduler::resetStats()
+{
+  for (unsigned int i=0; i<m_workers.size(); i++)
+  {
+    m_workers[i]->busy = 0;
+    m_workers[i]->numChunks = 0;
+    m_workers[i]->numStolen = 0;
+  }
+  m_wall = 0;
+  m_numRuns = 0;
+}
+
+/************************************************************************ 
+ *  run()                                                               *
+ *    Deals chunks of [0,n) out to the workers, wakes the helpers and   *
+ *    joins in the work on the calling thread until every chunk is done *
+ *                                                                      *
+ *  Parameters                                                          *
+ *    Task &task:	work to do on each chunk                        *
+ *    int n:		size of index range                             *
+ *    int grain:	#indices per chunk                              *
+ *                                                                      *
+ *  Returns - nothing                                                   *
+ ************************************************************************/
+void Scheduler::run(Task &task, int n, int grain)
+{
+  assert(n >= 0); assert(grain > 0);
+  if (n == 0)
+    return;
+
+  double start = now();
+  int numWorkers = m_workers.size();
+  int numChunks = getNumChunks(n, grain);
+
+  m_task = &task;
+  m_n = n;
+  m_grain = grain;
+
+  // contiguous blocks of chunks to each worker - keeps neighbouring
+  // cells/patches together when there's no need to steal
+  for (int t=0; t<numWorkers; t++)
+  {
+    Worker *pw = m_workers[t];
+    int first = (long)numChunks*t/numWorkers;
+    int last = (long)numChunks*(t+1)/numWorkers;
+    lock_guard<mutex> lk(pw->lock);
+    for (int c=first; c<last; c++)
+      pw->chunks.push_back(c);
+  }
+
+  if (numWorkers > 1)
+  {
+    {
+      lock_guard<mutex> lk(m_mutex);
+      m_active = numWorkers-1;
+      m_generation++;
+    }
+    m_start.notify_all();
+  }
+
+  work(0);
+
+  if (numWorkers > 1)
+  {
+    unique_lock<mutex> lk(m_mutex);
+    while (m_active)
+      m_done.wait(lk);
+  }
+
+  m_task = 0;
+  m_wall += now() - start;
+  m_numRuns++;
+}
+
+/************************************************************************ 
+ *  workerLoop()                                                        *
+ *    Body of each helper thread - waits for a new run, works until no  *
+ *    chunks are left anywhere, reports back                            *
+ *                                                                      *
+ *  Parameters                                                          *
+ *    int t:		worker number                                   *
+ *    int seen:		generation current when the thread was created  *
+ *                                                                      *
+ *  Returns - nothing                                                   *
+ ************************************************************************/
+void Scheduler::workerLoop(int t, int seen)
+{
+  for (;;)
+  {
+    {
+      unique_lock<mutex> lk(m_mutex);
+      while (!m_quit && m_generation == seen)
+        m_start.wait(lk);
+      if (m_quit)
+        return;
+      seen = m_generation;
+    }
+
+    work(t);
+
+    lock_guard<mutex> lk(m_mutex);
+    if (--m_active == 0)
+      m_done.notify_one();
+  }
+}
+
+/************************************************************************ 
+ *  work()                                                              *
+ *    Runs chunks - own first, then stolen ones - until none are left   *
+ *                                                                      *
+ *  Parameters                                                          *
+ *    int t:		worker number                                   *
+ *                                                                      *
+ *  Returns - nothing                                                   *
+ ************************************************************************/
+void Scheduler::work(int t)
+{
+  Worker *pw = m_workers[t];
+  int chunk;
+  while (getChunk(t, chunk))
+  {
+    double start = now();
+    int begin = chunk*m_grain;
+    int end = begin+m_grain < m_n ? begin+m_grain : m_n;
+    m_task->run(begin, end, chunk, t);
+    pw->busy += now() - start;
+    pw->numChunks++;
+  }
+}
+
+/************************************************************************ 
+ *  getChunk()                                                          *
+ *    Takes the next chunk from the front of this worker's own list;    *
+ *    if that is empty, steals from the back of another worker's list   *
+ *                                                                      *
+ *  Parameters                                                          *
+ *    int t:		worker number                                   *
+ *    int &chunk:	set to chunk number found                       *
+ *                                                                      *
+ *  Returns - false if no work is left anywhere                         *
+ ************************************************************************/
+bool Scheduler::getChunk(int t, int &chunk)
+{
+  Worker *pw = m_workers[t];
+  {
+    lock_guard<mutex> lk(pw->lock);
+    if (!pw->chunks.empty())
+    {
+      chunk = pw->chunks.front();
+      pw->chunks.pop_front();
+      return true;
+    }
+  }
+
+  int numWorkers = m_workers.size();
+  for (int i=1; i<numWorkers; i++)
+  {
+    Worker *pv = m_workers[(t+i) % numWorkers];
+    lock_guard<mutex> lk(pv->lock);
+    if (!pv->chunks.empty())
+    {
+      chunk = pv->chunks.back();
+      pv->chunks.pop_back();
+      pw->numStolen++;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/************************************************************************ 
+ *  operator<<                                                          *
+ *    Per-worker utilization - fraction of time spent inside run() that *
+ *    each worker was actually running chunks                           *
+ *                                                                      *
+ *  Returns - output stream                                             *
+ ************************************************************************/
+ostream& operator<<(ostream& s, const Scheduler& sched)
+{
+  s << "#runs\t" << sched.m_numRuns << "\twall(s)\t" << sched.m_wall << endl;
+  s << "#thread\tchunks\tstolen\tbusy(s)\tutilization" << endl;
+  for (unsigned int i=0; i<sched.m_workers.size(); i++)
+  {
+    const Scheduler::Worker *pw = sched.m_workers[i];
+    s << i << "\t" << pw->numChunks << "\t" << pw->numStolen << "\t" 
+      << pw->busy << "\t" << (sched.m_wall ? pw->busy/sched.m_wall : 0) 
+      << endl;
+  }
+  return s;
+}
+
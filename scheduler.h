@@ -0,0 +1,119 @@
+
+/************************************************************************
+ * 									*
+ * Copyright (C) 2004  Christina Warrender				*
+ * 									*
+ * This file is part of CyCells.					*
+ *									*
+ * CyCells is free software; you can redistribute it and/or modify it 	*
+ * under the terms of the GNU General Public License as published by	*
+ * the Free Software Foundation; either version 2 of the License, or	*
+ * (at your option) any later version.					*
+ *									*
+ * CyCells is distributed in the hope that it will be useful,		*
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of	*
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the	*
+ * GNU General Public License for more details.				*
+ *									*
+ * You should have received a copy of the GNU General Public License	*
+ * along with CyCells; if not, write to the Free Software Foundation, 	*
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA	*
+ *									*
+ ************************************************************************/
+/************************************************************************
+ * file scheduler.h                                                     *
+ * Declarations for Task and Scheduler classes                          *
+ * Singleton work-stealing thread pool used to spread per-cell (and     *
+ * later per-grid) work over several processors                         *
+ ************************************************************************/
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <vector>
+#include <deque>
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+// Task is the unit of work handed to the Scheduler; run() is called once
+// for each chunk [begin, end) of the index range passed to Scheduler::run,
+// possibly on different threads at the same time.  'thread' identifies the
+// worker (0 is always the calling thread) and 'chunk' the chunk number, 
+// which does not depend on the number of threads.
+class Task {
+  public:
+    virtual ~Task() {};
+    virtual void run(int begin, int end, int chunk, int thread) = 0;
+};
+
+class Scheduler {
+  public:
+    static Scheduler* getInstance();
+
+    ~Scheduler();
+
+    // number of worker threads, including the calling thread;
+    // 1 means all work is done serially by the caller
+    void setNumThreads(int num);
+    int getNumThreads() const {return m_workers.size();};
+
+    // split [0,n) into chunks of 'grain' indices and call task.run for 
+    // each chunk; returns when all chunks are done.  Chunks are dealt out
+    // to the workers in contiguous blocks; a worker that runs out of its
+    // own chunks steals from the far end of another worker's list.
+    void run(Task &task, int n, int grain);
+
+    static int getNumChunks(int n, int grain) {return (n+grain-1)/grain;};
+
+    void resetStats();
+
+  protected:
+    Scheduler();
+
+  private:
+    struct Worker {
+      mutex lock;		// protects chunks
+      deque<int> chunks;	// chunk numbers not yet started
+      double busy;		// seconds spent running chunks
+      long numChunks;		// #chunks run by this worker
+      long numStolen;		// #those taken from other workers
+      Worker() : busy(0), numChunks(0), numStolen(0) {};
+    };
+
+    static Scheduler* m_instance;
+
+    vector<Worker*> m_workers;
+    vector<thread> m_threads;	// helper threads; worker 0 is the caller
+
+    // description of the current run
+    Task *m_task;
+    int m_n, m_grain;
+
+    // hand-off between run() and the helper threads
+    mutex m_mutex;
+    condition_variable m_start, m_done;
+    int m_generation;		// incremented for each run
+    int m_active;		// helpers still working on current run
+    bool m_quit;
+
+    double m_wall;		// total seconds spent inside run()
+    long m_numRuns;
+
+    void stopThreads();
+    void workerLoop(int t, int seen);
+    void work(int t);
+    bool getChunk(int t, int &chunk);
+
+    // not used
+    Scheduler(const Scheduler &s);
+    Scheduler operator = (const Scheduler &s);
+
+  friend ostream& operator<<(ostream& s, const Scheduler& sched);
+};
+
+#endif
+
@@ -0,0 +1,122 @@
+
+/************************************************************************
+ * 									*
+ * Copyright (C) 2004  Christina Warrender				*
+ * 									*
+ * This file is part of CyCells.					*
+ *									*
+ * CyCells is free software; you can redistribute it and/or modify it 	*
+ * under the terms of the GNU General Public License as published by	*
+ * the Free Software Foundation; either version 2 of the License, or	*
+ * (at your option) any later version.					*
+ *									*
+ * CyCells is distributed in the hope that it will be useful,		*
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of	*
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the	*
+ * GNU General Public License for more details.				*
+ *									*
+ * You should have received a copy of the GNU General Public License	*
+ * along with CyCells; if not, write to the Free Software Foundation, 	*
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA	*
+ *									*
+ ************************************************************************/
+/************************************************************************
+ * file scratchPool.cc                                                  *
+ * Routines for ScratchPool class                                       *
+ ************************************************************************/
+
+#include "scratchPool.h"
+#include <iostream>
+#include <cstdlib>
+#include <cassert>
+#include <new>
+
+/************************************************************************ 
+ * ~ScratchPool()                                                       *
+ *   Destructor; frees spare grids                                      *
+ *                                                                      *
+ * Parameters - none                                                    *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+ScratchPool::~ScratchPool()
+{
+  clear();
+}
+
+/************************************************************************ 
+ * borrow()                                                             *
+ *   Finds the spare grid of the given size, allocating it the first    *
+ *   time, and records user as its borrower                             *
+ *                                                                      *
+ * Parameters                                                           *
+ *   int xsize, ysize, zsize:	grid size                               *
+ *   const void *user:		borrower                                *
+ *   bool &same:		set to whether user borrowed it last    *
+ *                                                                      *
+ * Returns - spare grid                                                 *
+ ************************************************************************/
+Array3D<ScratchPool::Conc>& ScratchPool::borrow(int xsize, int ysize, 
+						int zsize, const void *user,
+						bool &same)
+{
+  assert(user);
+
+  unsigned int n;
+  for (n=0; n<m_spares.size(); n++)
+  {
+    const Array3D<Conc> &g = *m_spares[n].grid;
+    if (g.xsize() == xsize && g.ysize() == ysize && g.zsize() == zsize)
+      break;
+  }
+
+  if (n == m_spares.size())
+  {
+    Spare s;
+    try {
+      s.grid = new Array3D<Conc>(xsize, ysize, zsize);
+    }
+    catch(std::bad_alloc&) {
+      cerr << "not enough memory to set up molecular scratch data" << endl;
+      abort();
+    }
+    s.user = 0;
+    m_spares.push_back(s);
+  }
+
+  same = (m_spares[n].user == user);
+  m_spares[n].user = user;
+  return *m_spares[n].grid;
+}
+
+/************************************************************************ 
+ * release()                                                            *
+ *   Forgets user as a borrower                                         *
+ *                                                                      *
+ * Parameters                                                           *
+ *   const void *user:		borrower                                *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void ScratchPool::release(const void *user)
+{
+  for (unsigned int n=0; n<m_spares.size(); n++)
+    if (m_spares[n].user == user)
+      m_spares[n].user = 0;
+}
+
+/************************************************************************ 
+ * clear()                                                              *
+ *   Frees all spare grids                                              *
+ *                                                                      *
+ * Parameters - none                                                    *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void ScratchPool::clear()
+{
+  for (unsigned int n=0; n<m_spares.size(); n++)
+    delete m_spares[n].grid;
+  m_spares.clear();
+}
+
@@ -0,0 +1,88 @@
+
+/************************************************************************
+ * 									*
+ * Copyright (C) 2004  Christina Warrender				*
+ * 									*
+ * This file is part of CyCells.					*
+ *									*
+ * CyCells is free software; you can redistribute it and/or modify it 	*
+ * under the terms of the GNU General Public License as published by	*
+ * the Free Software Foundation; either version 2 of the License, or	*
+ * (at your option) any later version.					*
+ *									*
+ * CyCells is distributed in the hope that it will be useful,		*
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of	*
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the	*
+ * GNU General Public License for more details.				*
+ *									*
+ * You should have received a copy of the GNU General Public License	*
+ * along with CyCells; if not, write to the Free Software Foundation, 	*
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA	*
+ *									*
+ ************************************************************************/
+/************************************************************************
+ * file scratchPool.h                                                   *
+ * Declarations for ScratchPool class                                   *
+ * Spare concentration grids shared by molecule types                   *
+ ***********************************************************************/
+
+#ifndef SCRATCHPOOL_H
+#define SCRATCHPOOL_H
+
+#include <vector>
+#include "array3D.h"
+
+using namespace std;
+
+// Molecule types are updated one at a time, so they don't each need a 
+// second grid to write new values into:  a ScratchPool (owned by Tissue)
+// keeps one spare grid per grid size, lent to whichever molecule type is
+// being updated.  The borrower swaps it with its own grid (Array3D::swap),
+// so the spare afterwards holds the borrower's old values - the pool 
+// remembers who that was, so a molecule type that gets the same spare 
+// back knows what's in it.
+// EXPLICIT and RKC updates need no other full grid, so N such molecule 
+// types of one grid size take N+1 grids.  ADI and SPECTRAL work a line 
+// at a time; STEADY keeps its own multigrid levels (about 3.4 grids), 
+// deferred changes a deposit grid, and a MoleculeBundle two interleaved
+// copies of its members' grids.
+class ScratchPool {
+  public:
+    typedef double Conc;
+
+    //--------------------------- CREATORS --------------------------------- 
+    ScratchPool() {};
+    // copy constructor not used
+    ~ScratchPool();
+
+    //------------------------- MANIPULATORS -------------------------------
+    // assignment not used
+
+    // spare grid of the given size, for user; 'same' is set to whether
+    // user was also the last to borrow it (so it holds user's values 
+    // from then) - otherwise its contents are unknown
+    Array3D<Conc>& borrow(int xsize, int ysize, int zsize, const void *user,
+    			  bool &same);
+
+    // forget that user borrowed anything (e.g. its values have changed
+    // since); clear frees all spares
+    void release(const void *user);
+    void clear();
+
+    //--------------------------- ACCESSORS --------------------------------
+    int getNumGrids() const {return m_spares.size();};
+
+  private:
+    struct Spare {
+      Array3D<Conc> *grid;
+      const void *user;			// last borrower, or 0
+    };
+    vector<Spare> m_spares;
+
+    // not used
+    ScratchPool(const ScratchPool &p);
+    ScratchPool& operator = (const ScratchPool &p);
+};
+
+#endif
+
@@ -38,19 +38,21 @@
 
 /************************************************************************
  * class SensePhag                                                      *
- *   Implementation of phagocytosis, using Cells::getTarget to pick a 	*
- * random cell within the appropriate distance (may not be able to find *
- * one).  First, phagocyte has to be able to bind target - capability   *
- * represented by some internal attribute of the phagocyte, which must  *
- * be larger than a specified threshold.  If it is, and if the returned *
- * cell is of the appropriate type, SensePhag will remove the 'eaten'   *
- * target cell and update a phagocyte attribute representing internal   *
- * target load.								*
+ *   Implementation of phagocytosis, using Cells::findCell to pick a 	*
+ * cell within the appropriate distance - any cell at random by default *
+ * (which may not be a target), or a target-type cell at random or the  *
+ * closest, depending on choice.  First, phagocyte has to be able to    *
+ * bind target - capability represented by some internal attribute of   *
+ * the phagocyte, which must be larger than a specified threshold.  If  *
+ * it is, and if the returned cell is of the appropriate type,          *
+ * SensePhag will remove the 'eaten' target cell and update a phagocyte *
+ * attribute representing internal target load (via Cells::engulf,      *
+ * which may defer both until the end of the timestep).                 *
  ************************************************************************/
 SensePhag::SensePhag(int pattr, int targettype, double dist, int Rattr,
-		double thr, Cells *cells) :
+		double thr, Cells *cells, Choice choice /* = ANY_NEIGHBOR */) :
 	m_pattr(pattr), m_targetType(targettype), m_dist(dist), 
-	m_Rattr(Rattr), m_thr(thr), m_cells(cells)
+	m_Rattr(Rattr), m_thr(thr), m_cells(cells), m_choice(choice)
 {
   assert(m_pattr >= 0);
   assert(m_targetType >= 0);
@@ -62,13 +64,27 @@ SensePhag::SensePhag(int pattr, int targettype, double dist, int Rattr,
 
 void SensePhag::calculate(Cell *cell, double deltaT)
 { 
-  if (cell->getValue(m_Rattr)>m_thr)
-    if ( Cell *pc = m_cells->getTarget(cell, m_dist) )
-      if ( pc->getTypeIndex() == m_targetType) 
-    {
-      pc->die();
-      cell->setValue(m_pattr, cell->getValue(m_pattr)+1);
-    }	    
+  if (cell->getValue(m_Rattr) <= m_thr)
+    return;
+
+  Cell *pc = 0;
+  switch (m_choice)
+  {
+    case ANY_NEIGHBOR:
+      pc = m_cells->getTarget(cell, m_dist);
+      break;
+    case RANDOM_TARGET:
+      pc = m_cells->findCell(cell, m_dist, m_targetType, 
+			     Cells::SELECT_RANDOM);
+      break;
+    case CLOSEST_TARGET:
+      pc = m_cells->findCell(cell, m_dist, m_targetType, 
+			     Cells::SELECT_CLOSEST);
+      break;
+  }
+
+  if ( pc && (pc->getTypeIndex() == m_targetType) )
+    m_cells->engulf(cell, pc, m_pattr);
 }
 
 /************************************************************************
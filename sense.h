@@ -46,8 +46,13 @@ class Sense {
 class SensePhag : public Sense
 {
   public:
+    // how phagocyte picks a cell to try:  any cell in range at random
+    // (and only takes it if it's the target type), or only target-type
+    // cells - at random or the closest
+    enum Choice { ANY_NEIGHBOR, RANDOM_TARGET, CLOSEST_TARGET };
+
     SensePhag(int pattr, int targettype, double dist, int Rattr, double thr,
-		    Cells *cells);
+		    Cells *cells, Choice choice = ANY_NEIGHBOR);
     // ~SensePhag();			// use default destructor
 
     void calculate(Cell *cell, double deltaT);
@@ -59,6 +64,7 @@ class SensePhag : public Sense
     int m_Rattr;		// index of attribute storing #receptors
     double m_thr;		// threshold value on #receptors for binding
     Cells *m_cells;		// access to Cells routine getTarget       
+    Choice m_choice;		// how target is picked
 
     // not used
     SensePhag(const SensePhag &r);
@@ -40,12 +40,12 @@ using namespace std;
  * Parameters                                                           *
  *   wxWindow *parent:          window containing this view             *
  *   int x, y, w, h:  		position (x,y) and size (w,h) of view   *
- *   const Tissue *t;		pointer to model tissue                 *
+ *   Tissue *t;			pointer to model tissue                 *
  *                                                                      *
  * Returns - nothing                                                    *
  ************************************************************************/
 SimView3D::SimView3D(wxWindow *parent, int x, int y, int w, int h, 
-	const Tissue *t) 
+	Tissue *t) 
 	: SimView(parent, x, y, w, h), 
 	  m_tissuep(t), m_first(true)
 {
@@ -191,9 +191,9 @@ void SimView3D::renderCells()
     Color color = mol_palette[n];
 
     // loop through grid cells
-    for (int i=1; i<=m_xnum; i++)
-      for (int j=1; j<=m_ynum; j++)
-        for (int k=1; k<=m_znum; k++)
+    for (int i=0; i<m_xnum; i++)
+      for (int j=0; j<m_ynum; j++)
+        for (int k=0; k<m_znum; k++)
 	{
 	  double c = conc.at(i, j, k);
 
@@ -208,7 +208,7 @@ void SimView3D::renderCells()
           // scale, translate by grid cell indices & draw
 	  glPushMatrix();
     	    glScalef(m_gridsize, m_gridsize, m_gridsize);
-            glTranslatef(i, j, k);
+            glTranslatef(i+1, j+1, k+1);
             drawGrid();   
 	  glPopMatrix();
 	}
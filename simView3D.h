@@ -37,7 +37,7 @@ class SimView3D : public SimView
 {
   public:
     //--------------------------- CREATORS --------------------------------- 
-    SimView3D(wxWindow *parent, int x, int y, int w, int h, const Tissue *t);	
+    SimView3D(wxWindow *parent, int x, int y, int w, int h, Tissue *t);	
     // copy constructor not used
     // ~SimView3D()			// use default destructor
 
@@ -46,7 +46,7 @@ class SimView3D : public SimView
     void render(wxPaintDC& dc);
 
   private:
-    const Tissue *m_tissuep;		// pointer to model
+    Tissue *m_tissuep;		// pointer to model
     bool m_first;			// flag for first call to render
 
     // local copies of model info needed for drawing
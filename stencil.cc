@@ -0,0 +1,568 @@
+
+/************************************************************************
+ * 									*
+ * Copyright (C) 2004  Christina Warrender				*
+ * 									*
+ * This file is part of CyCells.					*
+ *									*
+ * CyCells is free software; you can redistribute it and/or modify it 	*
+ * under the terms of the GNU General Public License as published by	*
+ * the Free Software Foundation; either version 2 of the License, or	*
+ * (at your option) any later version.					*
+ *									*
+ * CyCells is distributed in the hope that it will be useful,		*
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of	*
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the	*
+ * GNU General Public License for more details.				*
+ *									*
+ * You should have received a copy of the GNU General Public License	*
+ * along with CyCells; if not, write to the Free Software Foundation, 	*
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA	*
+ *									*
+ ************************************************************************/
+/************************************************************************
+ * file stencil.cc                                                      *
+ * Routines for Stencil class                                           *
+ * Compile with -ffp-contract=off, so no version fuses multiplies and   *
+ * adds that the others don't                                           *
+ ************************************************************************/
+
+#include "stencil.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define STENCIL_X86
+#include <immintrin.h>
+#endif
+
+/************************************************************************ 
+ * Scalar versions - the reference                                      *
+ ************************************************************************/
+static void row5Scalar(double *out, const double *row, const double *xm,
+		       const double *xp, int n, double decay, double diff)
+{
+  for (int k=1; k<n-1; k++)
+    out[k] = Stencil::point5(row, xm, xp, k, k-1, k+1, decay, diff);
+}
+
+static void row7Scalar(double *out, const double *row, const double *xm,
+		       const double *xp, const double *ym, const double *yp,
+		       int n, double decay, double diff)
+{
+  for (int k=1; k<n-1; k++)
+    out[k] = Stencil::point7(row, xm, xp, ym, yp, k, k-1, k+1, decay, diff);
+}
+
+static void row5StridedScalar(double *out, const double *row, const double *xm,
+			const double *xp, int n, int stride, 
+			const double *decay, const double *diff)
+{
+  for (int k=stride; k<n-stride; k++)
+    out[k] = Stencil::point5(row, xm, xp, k, k-stride, k+stride, 
+		    	     decay[k], diff[k]);
+}
+
+static void row7StridedScalar(double *out, const double *row, const double *xm,
+			const double *xp, const double *ym, const double *yp,
+			int n, int stride, const double *decay, 
+			const double *diff)
+{
+  for (int k=stride; k<n-stride; k++)
+    out[k] = Stencil::point7(row, xm, xp, ym, yp, k, k-stride, k+stride, 
+		    	     decay[k], diff[k]);
+}
+
+#ifdef STENCIL_X86
+
+/************************************************************************ 
+ * SSE2 versions - 2 points at a time                                   *
+ ************************************************************************/
+__attribute__((target("sse2")))
+static void row5SSE2(double *out, const double *row, const double *xm,
+		     const double *xp, int n, double decay, double diff)
+{
+  const __m128d vdecay = _mm_set1_pd(-decay), vdiff = _mm_set1_pd(diff);
+  __m128d vmin = _mm_set1_pd(0);
+  int k = 1;
+  for (; k+2<=n-1; k+=2)
+  {
+    __m128d c = _mm_loadu_pd(row+k);
+    __m128d sum = _mm_sub_pd(_mm_loadu_pd(xm+k), c);
+    sum = _mm_add_pd(sum, _mm_sub_pd(_mm_loadu_pd(xp+k), c));
+    sum = _mm_add_pd(sum, _mm_sub_pd(_mm_loadu_pd(row+k-1), c));
+    sum = _mm_add_pd(sum, _mm_sub_pd(_mm_loadu_pd(row+k+1), c));
+    __m128d v = _mm_add_pd(c, _mm_add_pd(_mm_mul_pd(vdecay, c), 
+					 _mm_mul_pd(vdiff, sum)));
+    _mm_storeu_pd(out+k, v);
+    vmin = _mm_min_pd(vmin, v);
+  }
+  for (; k<n-1; k++)
+    out[k] = Stencil::point5(row, xm, xp, k, k-1, k+1, decay, diff);
+
+  double m[2];
+  _mm_storeu_pd(m, vmin);
+  assert(m[0] >= 0 && m[1] >= 0);
+}
+
+__attribute__((target("sse2")))
+static void row7SSE2(double *out, const double *row, const double *xm,
+		     const double *xp, const double *ym, const double *yp,
+		     int n, double decay, double diff)
+{
+  const __m128d vdecay = _mm_set1_pd(-decay), vdiff = _mm_set1_pd(diff);
+  __m128d vmin = _mm_set1_pd(0);
+  int k = 1;
+  for (; k+2<=n-1; k+=2)
+  {
+    __m128d c = _mm_loadu_pd(row+k);
+    __m128d sum = _mm_sub_pd(_mm_loadu_pd(xm+k), c);
+    sum = _mm_add_pd(sum, _mm_sub_pd(_mm_loadu_pd(xp+k), c));
+    sum = _mm_add_pd(sum, _mm_sub_pd(_mm_loadu_pd(ym+k), c));
+    sum = _mm_add_pd(sum, _mm_sub_pd(_mm_loadu_pd(yp+k), c));
+    sum = _mm_add_pd(sum, _mm_sub_pd(_mm_loadu_pd(row+k-1), c));
+    sum = _mm_add_pd(sum, _mm_sub_pd(_mm_loadu_pd(row+k+1), c));
+    __m128d v = _mm_add_pd(c, _mm_add_pd(_mm_mul_pd(vdecay, c), 
+					 _mm_mul_pd(vdiff, sum)));
+    _mm_storeu_pd(out+k, v);
+    vmin = _mm_min_pd(vmin, v);
+  }
+  for (; k<n-1; k++)
+    out[k] = Stencil::point7(row, xm, xp, ym, yp, k, k-1, k+1, decay, diff);
+
+  double m[2];
+  _mm_storeu_pd(m, vmin);
+  assert(m[0] >= 0 && m[1] >= 0);
+}
+
+__attribute__((target("sse2")))
+static void row5StridedSSE2(double *out, const double *row, const double *xm,
+			const double *xp, int n, int stride,
+			const double *decay, const double *diff)
+{
+  const __m128d vsign = _mm_set1_pd(-0.0);
+  __m128d vmin = _mm_set1_pd(0);
+  int k = stride;
+  for (; k+2<=n-stride; k+=2)
+  {
+    __m128d c = _mm_loadu_pd(row+k);
+    __m128d sum = _mm_sub_pd(_mm_loadu_pd(xm+k), c);
+    sum = _mm_add_pd(sum, _mm_sub_pd(_mm_loadu_pd(xp+k), c));
+    sum = _mm_add_pd(sum, _mm_sub_pd(_mm_loadu_pd(row+k-stride), c));
+    sum = _mm_add_pd(sum, _mm_sub_pd(_mm_loadu_pd(row+k+stride), c));
+    __m128d vdecay = _mm_xor_pd(_mm_loadu_pd(decay+k), vsign);
+    __m128d v = _mm_add_pd(c, _mm_add_pd(_mm_mul_pd(vdecay, c), 
+			_mm_mul_pd(_mm_loadu_pd(diff+k), sum)));
+    _mm_storeu_pd(out+k, v);
+    vmin = _mm_min_pd(vmin, v);
+  }
+  for (; k<n-stride; k++)
+    out[k] = Stencil::point5(row, xm, xp, k, k-stride, k+stride, 
+		    	     decay[k], diff[k]);
+
+  double m[2];
+  _mm_storeu_pd(m, vmin);
+  assert(m[0] >= 0 && m[1] >= 0);
+}
+
+__attribute__((target("sse2")))
+static void row7StridedSSE2(double *out, const double *row, const double *xm,
+			const double *xp, const double *ym, const double *yp,
+			int n, int stride, const double *decay,
+			const double *diff)
+{
+  const __m128d vsign = _mm_set1_pd(-0.0);
+  __m128d vmin = _mm_set1_pd(0);
+  int k = stride;
+  for (; k+2<=n-stride; k+=2)
+  {
+    __m128d c = _mm_loadu_pd(row+k);
+    __m128d sum = _mm_sub_pd(_mm_loadu_pd(xm+k), c);
+    sum = _mm_add_pd(sum, _mm_sub_pd(_mm_loadu_pd(xp+k), c));
+    sum = _mm_add_pd(sum, _mm_sub_pd(_mm_loadu_pd(ym+k), c));
+    sum = _mm_add_pd(sum, _mm_sub_pd(_mm_loadu_pd(yp+k), c));
+    sum = _mm_add_pd(sum, _mm_sub_pd(_mm_loadu_pd(row+k-stride), c));
+    sum = _mm_add_pd(sum, _mm_sub_pd(_mm_loadu_pd(row+k+stride), c));
+    __m128d vdecay = _mm_xor_pd(_mm_loadu_pd(decay+k), vsign);
+    __m128d v = _mm_add_pd(c, _mm_add_pd(_mm_mul_pd(vdecay, c), 
+			_mm_mul_pd(_mm_loadu_pd(diff+k), sum)));
+    _mm_storeu_pd(out+k, v);
+    vmin = _mm_min_pd(vmin, v);
+  }
+  for (; k<n-stride; k++)
+    out[k] = Stencil::point7(row, xm, xp, ym, yp, k, k-stride, k+stride, 
+		    	     decay[k], diff[k]);
+
+  double m[2];
+  _mm_storeu_pd(m, vmin);
+  assert(m[0] >= 0 && m[1] >= 0);
+}
+
+/************************************************************************ 
+ * AVX2 versions - 4 points at a time                                   *
+ ************************************************************************/
+__attribute__((target("avx2")))
+static void row5AVX2(double *out, const double *row, const double *xm,
+		     const double *xp, int n, double decay, double diff)
+{
+  const __m256d vdecay = _mm256_set1_pd(-decay);
+  const __m256d vdiff = _mm256_set1_pd(diff);
+  __m256d vmin = _mm256_set1_pd(0);
+  int k = 1;
+  for (; k+4<=n-1; k+=4)
+  {
+    __m256d c = _mm256_loadu_pd(row+k);
+    __m256d sum = _mm256_sub_pd(_mm256_loadu_pd(xm+k), c);
+    sum = _mm256_add_pd(sum, _mm256_sub_pd(_mm256_loadu_pd(xp+k), c));
+    sum = _mm256_add_pd(sum, _mm256_sub_pd(_mm256_loadu_pd(row+k-1), c));
+    sum = _mm256_add_pd(sum, _mm256_sub_pd(_mm256_loadu_pd(row+k+1), c));
+    __m256d v = _mm256_add_pd(c, _mm256_add_pd(_mm256_mul_pd(vdecay, c), 
+					       _mm256_mul_pd(vdiff, sum)));
+    _mm256_storeu_pd(out+k, v);
+    vmin = _mm256_min_pd(vmin, v);
+  }
+  for (; k<n-1; k++)
+    out[k] = Stencil::point5(row, xm, xp, k, k-1, k+1, decay, diff);
+
+  double m[4];
+  _mm256_storeu_pd(m, vmin);
+  assert(m[0] >= 0 && m[1] >= 0 && m[2] >= 0 && m[3] >= 0);
+}
+
+__attribute__((target("avx2")))
+static void row7AVX2(double *out, const double *row, const double *xm,
+		     const double *xp, const double *ym, const double *yp,
+		     int n, double decay, double diff)
+{
+  const __m256d vdecay = _mm256_set1_pd(-decay);
+  const __m256d vdiff = _mm256_set1_pd(diff);
+  __m256d vmin = _mm256_set1_pd(0);
+  int k = 1;
+  for (; k+4<=n-1; k+=4)
+  {
+    __m256d c = _mm256_loadu_pd(row+k);
+    __m256d sum = _mm256_sub_pd(_mm256_loadu_pd(xm+k), c);
+    sum = _mm256_add_pd(sum, _mm256_sub_pd(_mm256_loadu_pd(xp+k), c));
+    sum = _mm256_add_pd(sum, _mm256_sub_pd(_mm256_loadu_pd(ym+k), c));
+    sum = _mm256_add_pd(sum, _mm256_sub_pd(_mm256_loadu_pd(yp+k), c));
+    sum = _mm256_add_pd(sum, _mm256_sub_pd(_mm256_loadu_pd(row+k-1), c));
+    sum = _mm256_add_pd(sum, _mm256_sub_pd(_mm256_loadu_pd(row+k+1), c));
+    __m256d v = _mm256_add_pd(c, _mm256_add_pd(_mm256_mul_pd(vdecay, c), 
+					       _mm256_mul_pd(vdiff, sum)));
+    _mm256_storeu_pd(out+k, v);
+    vmin = _mm256_min_pd(vmin, v);
+  }
+  for (; k<n-1; k++)
+    out[k] = Stencil::point7(row, xm, xp, ym, yp, k, k-1, k+1, decay, diff);
+
+  double m[4];
+  _mm256_storeu_pd(m, vmin);
+  assert(m[0] >= 0 && m[1] >= 0 && m[2] >= 0 && m[3] >= 0);
+}
+
+__attribute__((target("avx2")))
+static void row5StridedAVX2(double *out, const double *row, const double *xm,
+			const double *xp, int n, int stride,
+			const double *decay, const double *diff)
+{
+  const __m256d vsign = _mm256_set1_pd(-0.0);
+  __m256d vmin = _mm256_set1_pd(0);
+  int k = stride;
+  for (; k+4<=n-stride; k+=4)
+  {
+    __m256d c = _mm256_loadu_pd(row+k);
+    __m256d sum = _mm256_sub_pd(_mm256_loadu_pd(xm+k), c);
+    sum = _mm256_add_pd(sum, _mm256_sub_pd(_mm256_loadu_pd(xp+k), c));
+    sum = _mm256_add_pd(sum, _mm256_sub_pd(_mm256_loadu_pd(row+k-stride), c));
+    sum = _mm256_add_pd(sum, _mm256_sub_pd(_mm256_loadu_pd(row+k+stride), c));
+    __m256d vdecay = _mm256_xor_pd(_mm256_loadu_pd(decay+k), vsign);
+    __m256d v = _mm256_add_pd(c, _mm256_add_pd(_mm256_mul_pd(vdecay, c), 
+			_mm256_mul_pd(_mm256_loadu_pd(diff+k), sum)));
+    _mm256_storeu_pd(out+k, v);
+    vmin = _mm256_min_pd(vmin, v);
+  }
+  for (; k<n-stride; k++)
+    out[k] = Stencil::point5(row, xm, xp, k, k-stride, k+stride, 
+		    	     decay[k], diff[k]);
+
+  double m[4];
+  _mm256_storeu_pd(m, vmin);
+  assert(m[0] >= 0 && m[1] >= 0 && m[2] >= 0 && m[3] >= 0);
+}
+
+__attribute__((target("avx2")))
+static void row7StridedAVX2(double *out, const double *row, const double *xm,
+			const double *xp, const double *ym, const double *yp,
+			int n, int stride, const double *decay,
+			const double *diff)
+{
+  const __m256d vsign = _mm256_set1_pd(-0.0);
+  __m256d vmin = _mm256_set1_pd(0);
+  int k = stride;
+  for (; k+4<=n-stride; k+=4)
+  {
+    __m256d c = _mm256_loadu_pd(row+k);
+    __m256d sum = _mm256_sub_pd(_mm256_loadu_pd(xm+k), c);
+    sum = _mm256_add_pd(sum, _mm256_sub_pd(_mm256_loadu_pd(xp+k), c));
+    sum = _mm256_add_pd(sum, _mm256_sub_pd(_mm256_loadu_pd(ym+k), c));
+    sum = _mm256_add_pd(sum, _mm256_sub_pd(_mm256_loadu_pd(yp+k), c));
+    sum = _mm256_add_pd(sum, _mm256_sub_pd(_mm256_loadu_pd(row+k-stride), c));
+    sum = _mm256_add_pd(sum, _mm256_sub_pd(_mm256_loadu_pd(row+k+stride), c));
+    __m256d vdecay = _mm256_xor_pd(_mm256_loadu_pd(decay+k), vsign);
+    __m256d v = _mm256_add_pd(c, _mm256_add_pd(_mm256_mul_pd(vdecay, c), 
+			_mm256_mul_pd(_mm256_loadu_pd(diff+k), sum)));
+    _mm256_storeu_pd(out+k, v);
+    vmin = _mm256_min_pd(vmin, v);
+  }
+  for (; k<n-stride; k++)
+    out[k] = Stencil::point7(row, xm, xp, ym, yp, k, k-stride, k+stride, 
+		    	     decay[k], diff[k]);
+
+  double m[4];
+  _mm256_storeu_pd(m, vmin);
+  assert(m[0] >= 0 && m[1] >= 0 && m[2] >= 0 && m[3] >= 0);
+}
+
+/************************************************************************ 
+ * AVX-512 versions - 8 points at a time                                *
+ ************************************************************************/
+
+// running minimums use the masked min with every lane selected - the
+// unmasked one passes an undefined vector that GCC warns about
+#define ALL_LANES ((__mmask8) 0xff)
+
+__attribute__((target("avx512f")))
+static void row5AVX512(double *out, const double *row, const double *xm,
+		       const double *xp, int n, double decay, double diff)
+{
+  const __m512d vdecay = _mm512_set1_pd(-decay);
+  const __m512d vdiff = _mm512_set1_pd(diff);
+  __m512d vmin = _mm512_set1_pd(0);
+  int k = 1;
+  for (; k+8<=n-1; k+=8)
+  {
+    __m512d c = _mm512_loadu_pd(row+k);
+    __m512d sum = _mm512_sub_pd(_mm512_loadu_pd(xm+k), c);
+    sum = _mm512_add_pd(sum, _mm512_sub_pd(_mm512_loadu_pd(xp+k), c));
+    sum = _mm512_add_pd(sum, _mm512_sub_pd(_mm512_loadu_pd(row+k-1), c));
+    sum = _mm512_add_pd(sum, _mm512_sub_pd(_mm512_loadu_pd(row+k+1), c));
+    __m512d v = _mm512_add_pd(c, _mm512_add_pd(_mm512_mul_pd(vdecay, c), 
+					       _mm512_mul_pd(vdiff, sum)));
+    _mm512_storeu_pd(out+k, v);
+    vmin = _mm512_mask_min_pd(vmin, ALL_LANES, vmin, v);
+  }
+  for (; k<n-1; k++)
+    out[k] = Stencil::point5(row, xm, xp, k, k-1, k+1, decay, diff);
+
+  double m[8];
+  _mm512_storeu_pd(m, vmin);
+  for (int i=0; i<8; i++)
+    assert(m[i] >= 0);
+}
+
+__attribute__((target("avx512f")))
+static void row7AVX512(double *out, const double *row, const double *xm,
+		       const double *xp, const double *ym, const double *yp,
+		       int n, double decay, double diff)
+{
+  const __m512d vdecay = _mm512_set1_pd(-decay);
+  const __m512d vdiff = _mm512_set1_pd(diff);
+  __m512d vmin = _mm512_set1_pd(0);
+  int k = 1;
+  for (; k+8<=n-1; k+=8)
+  {
+    __m512d c = _mm512_loadu_pd(row+k);
+    __m512d sum = _mm512_sub_pd(_mm512_loadu_pd(xm+k), c);
+    sum = _mm512_add_pd(sum, _mm512_sub_pd(_mm512_loadu_pd(xp+k), c));
+    sum = _mm512_add_pd(sum, _mm512_sub_pd(_mm512_loadu_pd(ym+k), c));
+    sum = _mm512_add_pd(sum, _mm512_sub_pd(_mm512_loadu_pd(yp+k), c));
+    sum = _mm512_add_pd(sum, _mm512_sub_pd(_mm512_loadu_pd(row+k-1), c));
+    sum = _mm512_add_pd(sum, _mm512_sub_pd(_mm512_loadu_pd(row+k+1), c));
+    __m512d v = _mm512_add_pd(c, _mm512_add_pd(_mm512_mul_pd(vdecay, c), 
+					       _mm512_mul_pd(vdiff, sum)));
+    _mm512_storeu_pd(out+k, v);
+    vmin = _mm512_mask_min_pd(vmin, ALL_LANES, vmin, v);
+  }
+  for (; k<n-1; k++)
+    out[k] = Stencil::point7(row, xm, xp, ym, yp, k, k-1, k+1, decay, diff);
+
+  double m[8];
+  _mm512_storeu_pd(m, vmin);
+  for (int i=0; i<8; i++)
+    assert(m[i] >= 0);
+}
+
+// (avx512f has no _mm512_xor_pd, so the decay factors' sign is flipped 
+// as integers)
+__attribute__((target("avx512f")))
+static void row5StridedAVX512(double *out, const double *row, const double *xm,
+			const double *xp, int n, int stride,
+			const double *decay, const double *diff)
+{
+  const __m512i vsign = _mm512_set1_epi64(0x8000000000000000LL);
+  __m512d vmin = _mm512_set1_pd(0);
+  int k = stride;
+  for (; k+8<=n-stride; k+=8)
+  {
+    __m512d c = _mm512_loadu_pd(row+k);
+    __m512d sum = _mm512_sub_pd(_mm512_loadu_pd(xm+k), c);
+    sum = _mm512_add_pd(sum, _mm512_sub_pd(_mm512_loadu_pd(xp+k), c));
+    sum = _mm512_add_pd(sum, _mm512_sub_pd(_mm512_loadu_pd(row+k-stride), c));
+    sum = _mm512_add_pd(sum, _mm512_sub_pd(_mm512_loadu_pd(row+k+stride), c));
+    __m512d vdecay = _mm512_castsi512_pd(_mm512_xor_si512(
+		    _mm512_castpd_si512(_mm512_loadu_pd(decay+k)), vsign));
+    __m512d v = _mm512_add_pd(c, _mm512_add_pd(_mm512_mul_pd(vdecay, c), 
+			_mm512_mul_pd(_mm512_loadu_pd(diff+k), sum)));
+    _mm512_storeu_pd(out+k, v);
+    vmin = _mm512_mask_min_pd(vmin, ALL_LANES, vmin, v);
+  }
+  for (; k<n-stride; k++)
+    out[k] = Stencil::point5(row, xm, xp, k, k-stride, k+stride, 
+		    	     decay[k], diff[k]);
+
+  double m[8];
+  _mm512_storeu_pd(m, vmin);
+  for (int i=0; i<8; i++)
+    assert(m[i] >= 0);
+}
+
+__attribute__((target("avx512f")))
+static void row7StridedAVX512(double *out, const double *row, const double *xm,
+			const double *xp, const double *ym, const double *yp,
+			int n, int stride, const double *decay,
+			const double *diff)
+{
+  const __m512i vsign = _mm512_set1_epi64(0x8000000000000000LL);
+  __m512d vmin = _mm512_set1_pd(0);
+  int k = stride;
+  for (; k+8<=n-stride; k+=8)
+  {
+    __m512d c = _mm512_loadu_pd(row+k);
+    __m512d sum = _mm512_sub_pd(_mm512_loadu_pd(xm+k), c);
+    sum = _mm512_add_pd(sum, _mm512_sub_pd(_mm512_loadu_pd(xp+k), c));
+    sum = _mm512_add_pd(sum, _mm512_sub_pd(_mm512_loadu_pd(ym+k), c));
+    sum = _mm512_add_pd(sum, _mm512_sub_pd(_mm512_loadu_pd(yp+k), c));
+    sum = _mm512_add_pd(sum, _mm512_sub_pd(_mm512_loadu_pd(row+k-stride), c));
+    sum = _mm512_add_pd(sum, _mm512_sub_pd(_mm512_loadu_pd(row+k+stride), c));
+    __m512d vdecay = _mm512_castsi512_pd(_mm512_xor_si512(
+		    _mm512_castpd_si512(_mm512_loadu_pd(decay+k)), vsign));
+    __m512d v = _mm512_add_pd(c, _mm512_add_pd(_mm512_mul_pd(vdecay, c), 
+			_mm512_mul_pd(_mm512_loadu_pd(diff+k), sum)));
+    _mm512_storeu_pd(out+k, v);
+    vmin = _mm512_mask_min_pd(vmin, ALL_LANES, vmin, v);
+  }
+  for (; k<n-stride; k++)
+    out[k] = Stencil::point7(row, xm, xp, ym, yp, k, k-stride, k+stride, 
+		    	     decay[k], diff[k]);
+
+  double m[8];
+  _mm512_storeu_pd(m, vmin);
+  for (int i=0; i<8; i++)
+    assert(m[i] >= 0);
+}
+
+#endif	// STENCIL_X86
+
+// every version, narrowest first; isSupported relies on this order
+static const Stencil::Version versions[] = {
+  {"scalar", row5Scalar, row7Scalar, row5StridedScalar, row7StridedScalar},
+#ifdef STENCIL_X86
+  {"sse2", row5SSE2, row7SSE2, row5StridedSSE2, row7StridedSSE2},
+  {"avx2", row5AVX2, row7AVX2, row5StridedAVX2, row7StridedAVX2},
+  {"avx512", row5AVX512, row7AVX512, row5StridedAVX512, row7StridedAVX512},
+#endif
+};
+
+/************************************************************************ 
+ * getRow5(), getRow7(), getRow5Strided(), getRow7Strided(), getName() *
+ *   Return the version chosen by select()                              *
+ ************************************************************************/
+Stencil::Row5 Stencil::getRow5()
+{
+  return select().row5;
+}
+
+Stencil::Row7 Stencil::getRow7()
+{
+  return select().row7;
+}
+
+Stencil::Row5S Stencil::getRow5Strided()
+{
+  return select().row5s;
+}
+
+Stencil::Row7S Stencil::getRow7Strided()
+{
+  return select().row7s;
+}
+
+const char* Stencil::getName()
+{
+  return select().name;
+}
+
+/************************************************************************ 
+ * getNumVersions(), getVersion()                                       *
+ *   All versions compiled in, supported or not - see stencilTest       *
+ ************************************************************************/
+int Stencil::getNumVersions()
+{
+  return sizeof(versions)/sizeof(versions[0]);
+}
+
+const Stencil::Version& Stencil::getVersion(int i)
+{
+  assert(i>=0 && i<getNumVersions());
+  return versions[i];
+}
+
+/************************************************************************ 
+ * isSupported()                                                        *
+ *   Whether this processor has the instruction set version i needs     *
+ *                                                                      *
+ * Parameters                                                           *
+ *   int i:			index into versions                     *
+ *                                                                      *
+ * Returns - true if version i can be run                               *
+ ************************************************************************/
+bool Stencil::isSupported(int i)
+{
+  assert(i>=0 && i<getNumVersions());
+#ifdef STENCIL_X86
+  __builtin_cpu_init();
+  switch (i)
+  {
+    case 1: return __builtin_cpu_supports("sse2");
+    case 2: return __builtin_cpu_supports("avx2");
+    case 3: return __builtin_cpu_supports("avx512f");
+  }
+#endif
+  return true;		// scalar
+}
+
+/************************************************************************ 
+ * select()                                                             *
+ *   Picks the widest version the processor supports, the first time    *
+ *   it's called (thread-safe - it's a function-local static).  All     *
+ *   versions give the same results (checked by stencilTest), so the    *
+ *   choice doesn't affect reproducibility.                             *
+ *                                                                      *
+ * Returns - version to use                                             *
+ ************************************************************************/
+const Stencil::Version& Stencil::select()
+{
+  struct Chooser {
+    int index;
+    Chooser() : index(0)
+    {
+      for (int i=getNumVersions()-1; i>0; i--)
+        if (isSupported(i))
+        {
+          index = i;
+          break;
+        }
+    }
+  };
+  static Chooser chooser;
+
+  return versions[chooser.index];
+}
@@ -0,0 +1,119 @@
+
+/************************************************************************
+ * 									*
+ * Copyright (C) 2004  Christina Warrender				*
+ * 									*
+ * This file is part of CyCells.					*
+ *									*
+ * CyCells is free software; you can redistribute it and/or modify it 	*
+ * under the terms of the GNU General Public License as published by	*
+ * the Free Software Foundation; either version 2 of the License, or	*
+ * (at your option) any later version.					*
+ *									*
+ * CyCells is distributed in the hope that it will be useful,		*
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of	*
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the	*
+ * GNU General Public License for more details.				*
+ *									*
+ * You should have received a copy of the GNU General Public License	*
+ * along with CyCells; if not, write to the Free Software Foundation, 	*
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA	*
+ *									*
+ ************************************************************************/
+/************************************************************************
+ * file stencil.h                                                       *
+ * Declarations for Stencil class                                       *
+ * Explicit diffusion/decay update along one contiguous row, with       *
+ * SIMD versions chosen at run time                                     *
+ ***********************************************************************/
+
+#ifndef STENCIL_H
+#define STENCIL_H
+
+#include <cassert>
+
+// new value for point k of a row, given the neighboring rows (x+-1 and,
+// for 3D, y+-1) and the indices of k's neighbors within the row 
+// (wrapped by the caller); 5-point version for 2D, 7-point for 3D.  
+// The SIMD versions do exactly the same operations in the same order,
+// so they give the same results.
+class Stencil {
+  public:
+    // one row, points [1,n-1) - the first and last points need wrapping
+    // and are left to the caller
+    typedef void (*Row5)(double *out, const double *row, const double *xm,
+    			 const double *xp, int n, double decay_factor, 
+			 double diff_factor);
+    typedef void (*Row7)(double *out, const double *row, const double *xm,
+    			 const double *xp, const double *ym, const double *yp,
+			 int n, double decay_factor, double diff_factor);
+
+    // interleaved rows (see MoleculeBundle):  several species' values 
+    // alternate, so neighbors along the row are stride apart, and each 
+    // element has its own factors (decay[k], diff[k]); points 
+    // [stride,n-stride)
+    typedef void (*Row5S)(double *out, const double *row, const double *xm,
+    			  const double *xp, int n, int stride, 
+			  const double *decay, const double *diff);
+    typedef void (*Row7S)(double *out, const double *row, const double *xm,
+    			  const double *xp, const double *ym, 
+			  const double *yp, int n, int stride,
+			  const double *decay, const double *diff);
+
+    // versions for the widest instruction set this processor supports
+    static Row5 getRow5();
+    static Row7 getRow7();
+    static Row5S getRow5Strided();
+    static Row7S getRow7Strided();
+    static const char* getName();	// instruction set chosen
+
+    static double point5(const double *row, const double *xm, 
+    		const double *xp, int k, int km, int kp, 
+		double decay_factor, double diff_factor)
+    {
+      double current = row[k];
+      double sum = 0;
+      sum += xm[k] - current;
+      sum += xp[k] - current;
+      sum += row[km] - current;
+      sum += row[kp] - current;
+      double value = current + (-decay_factor*current + diff_factor*sum);
+      assert(value >= 0);
+      return value;
+    };
+    static double point7(const double *row, const double *xm, 
+    		const double *xp, const double *ym, const double *yp, 
+		int k, int km, int kp, double decay_factor, double diff_factor)
+    {
+      double current = row[k];
+      double sum = 0;
+      sum += xm[k] - current;
+      sum += xp[k] - current;
+      sum += ym[k] - current;
+      sum += yp[k] - current;
+      sum += row[km] - current;
+      sum += row[kp] - current;
+      double value = current + (-decay_factor*current + diff_factor*sum);
+      assert(value >= 0);
+      return value;
+    };
+
+    // every version compiled in, narrowest first (scalar is 0), for 
+    // testing them against each other - see stencilTest
+    struct Version {
+      const char *name;
+      Row5 row5;
+      Row7 row7;
+      Row5S row5s;
+      Row7S row7s;
+    };
+    static int getNumVersions();
+    static const Version& getVersion(int i);
+    static bool isSupported(int i);	// can this processor run it?
+
+  private:
+    static const Version& select();
+};
+
+#endif
+
@@ -0,0 +1,186 @@
+
+/************************************************************************
+ * 									*
+ * Copyright (C) 2004  Christina Warrender				*
+ * 									*
+ * This file is part of CyCells.					*
+ *									*
+ * CyCells is free software; you can redistribute it and/or modify it 	*
+ * under the terms of the GNU General Public License as published by	*
+ * the Free Software Foundation; either version 2 of the License, or	*
+ * (at your option) any later version.					*
+ *									*
+ * CyCells is distributed in the hope that it will be useful,		*
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of	*
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the	*
+ * GNU General Public License for more details.				*
+ *									*
+ * You should have received a copy of the GNU General Public License	*
+ * along with CyCells; if not, write to the Free Software Foundation, 	*
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA	*
+ *									*
+ ************************************************************************/
+/************************************************************************
+ * file stencilTest.cc                                                  *
+ * Test program for Stencil:  runs every SIMD version this processor    *
+ * supports on random rows and compares it with the scalar version      *
+ ************************************************************************/
+
+#include <iostream>
+#include "stencil.h"
+
+using namespace std;
+
+// rows of every length from 3 up to this (so vector loops leave every
+// possible remainder), NUM_TRIALS random sets of rows for each
+#define MAX_LENGTH 100
+#define NUM_TRIALS 5
+
+// strided kernels are tested with every stride up to this
+#define MAX_STRIDE 5
+
+// simple LCG, so every run uses the same rows; returns [0,1)
+static unsigned int seed = 12345;
+static double random01()
+{
+  seed = seed*1103515245 + 12345;
+  return ((seed >> 8) % 100000) / 100000.0;
+}
+
+/************************************************************************ 
+ * fillRows()                                                           *
+ *   Random concentrations for the row and its neighbors, and random    *
+ *   factors small enough to keep results positive (the kernels assert  *
+ *   that); out and ref both start out the same, so points the kernels  *
+ *   shouldn't touch are compared too                                   *
+ *                                                                      *
+ * Parameters                                                           *
+ *   double in[5][MAX_LENGTH]:	row, xm, xp, ym, yp                     *
+ *   double *out, *ref:		output rows                             *
+ *   double *decay, *diff:	per-point factors                       *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+static void fillRows(double in[5][MAX_LENGTH], double *out, double *ref,
+		     double *decay, double *diff)
+{
+  for (int r=0; r<5; r++)
+    for (int k=0; k<MAX_LENGTH; k++)
+      in[r][k] = 1e-12 * random01();
+  for (int k=0; k<MAX_LENGTH; k++)
+  {
+    out[k] = ref[k] = -1;
+    decay[k] = 1e-2 * random01();
+    diff[k] = 0.16 * random01();
+  }
+}
+
+/************************************************************************ 
+ * compare()                                                            *
+ *   Checks a version's output against the scalar version's - they      *
+ *   should be identical - and reports any difference                   *
+ *                                                                      *
+ * Parameters                                                           *
+ *   const double *out, *ref:	outputs to compare                      *
+ *   const char *name:		version name                            *
+ *   const char *kernel:	which kernel                            *
+ *   int n, stride:		row length and stride                   *
+ *                                                                      *
+ * Returns - true if they match                                         *
+ ************************************************************************/
+static bool compare(const double *out, const double *ref, const char *name,
+		    const char *kernel, int n, int stride)
+{
+  for (int k=0; k<MAX_LENGTH; k++)
+    if (out[k] != ref[k])
+    {
+      cout << "stencilTest:  " << name << " " << kernel << " differs from "
+	   << "scalar, length " << n << " stride " << stride << " point " 
+	   << k << ":  " << out[k] << " vs " << ref[k] << endl;
+      return false;
+    }
+  return true;
+}
+
+/************************************************************************ 
+ * testVersion()                                                        *
+ *   Runs each kernel of one version and of the scalar version on the   *
+ *   same random rows, the strided ones with several strides            *
+ *                                                                      *
+ * Parameters                                                           *
+ *   const Stencil::Version &v:	version to test                         *
+ *                                                                      *
+ * Returns - number of mismatches                                       *
+ ************************************************************************/
+static int testVersion(const Stencil::Version &v)
+{
+  const Stencil::Version &scalar = Stencil::getVersion(0);
+  double in[5][MAX_LENGTH], out[MAX_LENGTH], ref[MAX_LENGTH];
+  double decay[MAX_LENGTH], diff[MAX_LENGTH];
+  int failures = 0;
+
+  for (int n=3; n<=MAX_LENGTH; n++)
+    for (int t=0; t<NUM_TRIALS; t++)
+    {
+      fillRows(in, out, ref, decay, diff);
+      scalar.row5(ref, in[0], in[1], in[2], n, decay[0], diff[0]);
+      v.row5(out, in[0], in[1], in[2], n, decay[0], diff[0]);
+      if (!compare(out, ref, v.name, "row5", n, 1))
+        failures++;
+
+      fillRows(in, out, ref, decay, diff);
+      scalar.row7(ref, in[0], in[1], in[2], in[3], in[4], n, 
+		  decay[0], diff[0]);
+      v.row7(out, in[0], in[1], in[2], in[3], in[4], n, decay[0], diff[0]);
+      if (!compare(out, ref, v.name, "row7", n, 1))
+        failures++;
+
+      // interleaved rows (see MoleculeBundle), up to MAX_STRIDE species
+      for (int stride=1; stride<=MAX_STRIDE && 2*stride<n; stride++)
+      {
+        fillRows(in, out, ref, decay, diff);
+        scalar.row5s(ref, in[0], in[1], in[2], n, stride, decay, diff);
+        v.row5s(out, in[0], in[1], in[2], n, stride, decay, diff);
+        if (!compare(out, ref, v.name, "row5 strided", n, stride))
+          failures++;
+
+        fillRows(in, out, ref, decay, diff);
+        scalar.row7s(ref, in[0], in[1], in[2], in[3], in[4], n, stride,
+		     decay, diff);
+        v.row7s(out, in[0], in[1], in[2], in[3], in[4], n, stride, 
+		decay, diff);
+        if (!compare(out, ref, v.name, "row7 strided", n, stride))
+          failures++;
+      }
+    }
+
+  return failures;
+}
+
+/************************************************************************ 
+ * main()                                                               *
+ *   Tests every version this processor supports; unsupported ones are  *
+ *   reported and skipped                                               *
+ *                                                                      *
+ * Returns - 0 if all match, 1 otherwise                                *
+ ************************************************************************/
+int main()
+{
+  int failures = 0;
+  for (int i=1; i<Stencil::getNumVersions(); i++)
+  {
+    const Stencil::Version &v = Stencil::getVersion(i);
+    if (!Stencil::isSupported(i))
+    {
+      cout << "stencilTest:  " << v.name << " not supported - skipped" 
+	   << endl;
+      continue;
+    }
+    int f = testVersion(v);
+    cout << "stencilTest:  " << v.name << (f ? " FAILED" : " ok") << endl;
+    failures += f;
+  }
+
+  cout << "stencilTest:  chosen version " << Stencil::getName() << endl;
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,84 @@
+
+/************************************************************************
+ * 									*
+ * Copyright (C) 2004  Christina Warrender				*
+ * 									*
+ * This file is part of CyCells.					*
+ *									*
+ * CyCells is free software; you can redistribute it and/or modify it 	*
+ * under the terms of the GNU General Public License as published by	*
+ * the Free Software Foundation; either version 2 of the License, or	*
+ * (at your option) any later version.					*
+ *									*
+ * CyCells is distributed in the hope that it will be useful,		*
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of	*
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the	*
+ * GNU General Public License for more details.				*
+ *									*
+ * You should have received a copy of the GNU General Public License	*
+ * along with CyCells; if not, write to the Free Software Foundation, 	*
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA	*
+ *									*
+ ************************************************************************/
+/************************************************************************
+ * file stepBuffer.h                                                    *
+ * Declarations for StepBuffer class                                    *
+ * Holds effects of updating one chunk of cells in a synchronous step   *
+ ************************************************************************/
+
+#ifndef STEPBUFFER_H
+#define STEPBUFFER_H
+
+#include <vector>
+#include "simPoint.h"
+
+using namespace std;
+
+class Cell;
+class Molecule;
+
+// During a synchronous update, chunks of the cell list may be handled by
+// different threads at once.  Anything a cell does that other cells (or 
+// the molecular fields) would see - births, claims on other cells, 
+// secretion and uptake - goes into the buffer for its chunk; Cells applies
+// the buffers in chunk order afterwards, so results don't depend on how
+// many threads there were or which one handled which chunk.
+class StepBuffer {
+  public:
+    struct Claim {
+      Cell *eater;
+      Cell *target;
+      int attr;
+      int rank;
+      Claim(Cell *pe, Cell *pt, int a, int r) : 
+	eater(pe), target(pt), attr(a), rank(r) {};
+    };
+
+    struct Deposit {
+      Molecule *field;
+      SimPoint pos;
+      double amount;		// #molecules, as passed to changeConc
+      Deposit(Molecule *pm, const SimPoint &p, double a) : 
+	field(pm), pos(p), amount(a) {};
+    };
+
+    StepBuffer() : rank(0) {};
+
+    int rank;			// cell_list index of cell being updated
+    vector<Cell*> births;
+    vector<Claim> claims;
+    vector<Deposit> deposits;
+
+    void clear() {births.clear(); claims.clear(); deposits.clear();};
+
+    // buffer for the chunk the calling thread is working on; 
+    // null outside a synchronous update
+    static StepBuffer *getCurrent() {return sm_current;};
+    static void setCurrent(StepBuffer *pb) {sm_current = pb;};
+
+  private:
+    static thread_local StepBuffer *sm_current;
+};
+
+#endif
+
@@ -44,9 +44,10 @@ class TallyActions {
 
     // the number returned by register should be used in update calls
     int addName(const string aname);
+    // atomic, since cells may be updated by several threads at once
     void update(int id) {
 	    assert(id>=0); assert(id<=int(m_tallies.size())); 
-	    m_tallies[id]++; };
+	    __sync_fetch_and_add(&m_tallies[id], 1); };
     int getTally(int id) {
 	    assert(id>=0); assert(id<=int(m_tallies.size())); 
 	    return m_tallies[id]; };
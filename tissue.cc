@@ -35,6 +35,7 @@
 #include <unistd.h>
 #include "cells.h"
 #include "molecule.h"
+#include "moleculeBundle.h"
 #include "random.h"
 #include "util.h"
 
@@ -55,7 +56,8 @@ using namespace std;
  * Returns - nothing               					*
  ************************************************************************/
 Tissue::Tissue(void) : description(), m_xrange(0), m_yrange(0), m_zrange(0),
-	m_molres(0), m_cellres(0), cells(0), simtime(0)
+	m_molres(0), m_cellres(0), cells(0), simtime(0),
+	m_bundle(0)
 {
   // idea for seed from Perl book
   pid_t pid = getpid();
@@ -82,6 +84,7 @@ cout << "constructor seed = " << m_seed << endl;
  ************************************************************************/
 Tissue::~Tissue()
 {
+  delete m_bundle;		// gives molecules their storage back
   for(unsigned int i=0; i<mol_types.size(); i++)
     delete mol_types[i].typeptr;
   delete cells;
@@ -97,7 +100,7 @@ Tissue::~Tissue()
  ************************************************************************/
 void Tissue::setGeometry()
 {
-  setGeometry(1000, 1000, 1000, 0, 0);
+  setGeometry(DEFAULT_RANGE, DEFAULT_RANGE, DEFAULT_RANGE, 0, 0);
 }
 
 /************************************************************************ 
@@ -121,12 +124,14 @@ void Tissue::setGeometry(int xrange, int yrange, int zrange,
   m_molres = molgridsize;
   m_cellres = cellgridsize;
 
-  // set up Molecule static values and (re)initialize concentration arrays - 
+  // set up Molecule geometry and (re)initialize concentration arrays - 
   // this will wipe out any existing data (reasonable, since geometry should
   // be set before setting concentrations
-  Molecule::setGeometry(xrange, yrange, zrange, molgridsize);
+  delete m_bundle;
+  m_bundle = 0;
+  m_scratch.clear();
   for (unsigned int i=0; i<mol_types.size(); i++)
-    mol_types[i].typeptr->initialize();
+    setMolGeometry(mol_types[i].typeptr);
 
   // set up Cell values and make sure cell list is empty - same reason
   // as above; any existing cells might be outside new geometry boundaries
@@ -134,6 +139,36 @@ void Tissue::setGeometry(int xrange, int yrange, int zrange,
   cells->setGeometry(m_xrange, m_yrange, m_zrange, cellgridsize);
 }
 
+/************************************************************************
+ * setMolGeometry()                                                     *
+ *   Sets up one molecule type's grid:  its own resolution if it has    *
+ *   one, otherwise the model's.  Its own resolution has to divide each *
+ *   dimension (or be bigger - one grid cell, e.g. z in 2D).            *
+ *                                                                      *
+ * Parameters -                                                         *
+ *   Molecule *pm:		molecule type                           *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Tissue::setMolGeometry(Molecule *pm)
+{
+  int res = pm->getResolution();
+  if (res < 0)
+    res = m_molres;
+  else if (res && ((m_xrange%res && m_xrange>res) || 
+		  (m_yrange%res && m_yrange>res) || 
+		  (m_zrange%res && m_zrange>res)))
+    error("Tissue::setGeometry:  dimensions should be divisible by "
+	  "resolution for molecule", pm->getName());
+
+  pm->setScratchPool(&m_scratch);
+  pm->setGeometry(m_xrange, m_yrange, m_zrange, res);
+  pm->initialize();
+  const Array3D<Molecule::Conc> &conc = pm->getConc();
+  cout << "set " << pm->getName() << " geometry:  " << conc.xsize() << "x" 
+       << conc.ysize() << "x" << conc.zsize() << "=" << conc.size() << endl;
+}
+
 /************************************************************************ 
  * withinBounds()                           				*
  *   Tests whether specified coordinate lies within the model geometry  *
@@ -241,10 +276,87 @@ void Tissue::setMolReset(string name, double interval, Molecule::Conc conc,
     error("Molecule::setMolReset error - can't find molecule type", name);
 }
 
+/************************************************************************
+ * setSyncUpdate()                                                      *
+ *   Switches between asynchronous (default) and synchronous cell       *
+ *   updates.  In synchronous mode molecule changes made by cells are   *
+ *   held back until all cells have been updated.                       *
+ *                                                                      *
+ * Parameters -                                                         *
+ *   bool flag:		true for synchronous                            *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Tissue::setSyncUpdate(bool flag)
+{
+  cells->setSyncUpdate(flag);
+  setBufferChanges(flag);
+}
+
+/************************************************************************
+ * setBufferChanges()                                                   *
+ *   Turns accumulation of secretion/uptake on or off for all molecule  *
+ *   types.  Accumulated changes are applied in Tissue::update, right   *
+ *   after the cell update (and so before the next diffusion step).     *
+ *   Can't be turned off in synchronous mode.                           *
+ *                                                                      *
+ * Parameters -                                                         *
+ *   bool flag:		true to accumulate                              *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Tissue::setBufferChanges(bool flag)
+{
+  if (!flag && cells->isSyncUpdate())
+    error("Tissue::setBufferChanges:  synchronous mode needs buffering");
+
+  for (unsigned int i=0; i<mol_types.size(); i++)
+    mol_types[i].typeptr->setDeferChanges(flag);
+}
+
+/************************************************************************
+ * setBundleMolecules()                                                 *
+ *   Turns interleaved storage of molecule types on or off.  Only       *
+ *   explicit-solver types that diffuse on the model's grid every step  *
+ *   (and aren't refined) are bundled, and only if there are at least   *
+ *   two of them; others are still updated one by one.                  *
+ *                                                                      *
+ * Parameters -                                                         *
+ *   bool flag:		true to bundle                                  *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void Tissue::setBundleMolecules(bool flag)
+{
+  delete m_bundle;
+  m_bundle = 0;
+  if (!flag)
+    return;
+
+  vector<Molecule*> mols;
+  for (unsigned int i=0; i<mol_types.size(); i++)
+  {
+    Molecule *pm = mol_types[i].typeptr;
+    if (pm->getSolver() == Molecule::EXPLICIT && pm->getDiffRate() > 0
+		    && pm->getConc().size() > 1 && !pm->isRefined()
+		    && pm->getGridSize() == m_molres 
+		    && pm->getUpdateInterval() == 1)
+      mols.push_back(pm);
+  }
+
+  if (mols.size() >= 2)
+  {
+    m_bundle = new MoleculeBundle(mols);
+    cout << "bundled " << mols.size() << " molecule types" << endl;
+  }
+}
+
 /************************************************************************
  * update()                                                             *
  *   Updates model for one timestep.  Relies largely on update routines *
- *   for individual components of the model.                            *
+ *   for individual components of the model.  A molecule type with an   *
+ *   update interval is updated every that many steps, for all of them  *
+ *   at once (a reset starts the count over).                           *
  *                                                                      *
  * Parameters -                                                         *
  *   double deltaT:	time for one sim loop (in seconds)              *
@@ -257,19 +369,43 @@ void Tissue::update(double deltaT)
   // right now, this refers to diffuson and decay (or possibly secretion
   // by cells not explicitly modeled - negative decay); may need to 
   // add reactions later
+  vector<bool> skip;		// bundled types just reset
   for (unsigned int i=0; i<mol_types.size(); i++)
-    if (simtime >= mol_types[i].next_reset)
+  {
+    bool reset = (simtime >= mol_types[i].next_reset);
+    if (reset)
     {
       mol_types[i].typeptr->setUniformConc(mol_types[i].reset_value,
 		      mol_types[i].reset_sd);
       mol_types[i].next_reset += mol_types[i].reset_interval;
     }
-    else
-      mol_types[i].typeptr->update(deltaT);
+
+    MolDef &md = mol_types[i];
+    if (md.typeptr->isBundled())
+      skip.push_back(reset);
+    else if (reset)
+      md.pending_steps = 0;
+    else if (++md.pending_steps >= md.typeptr->getUpdateInterval())
+    {
+      md.typeptr->update(md.pending_steps*deltaT);
+      md.pending_steps = 0;
+    }
+  }
+  if (m_bundle)
+    m_bundle->update(deltaT, skip);
+
+  // gradients cells will use this step, where cached
+  for (unsigned int i=0; i<mol_types.size(); i++)
+    mol_types[i].typeptr->updateGradient();
 
   // cell actions
   cells->update(deltaT);
 
+  // molecule changes cells made, if they were held back (buffered or 
+  // synchronous mode)
+  for (unsigned int i=0; i<mol_types.size(); i++)
+    mol_types[i].typeptr->applyChanges();
+
   // adjust sim time
   simtime += deltaT;
 }
@@ -35,6 +35,7 @@
 #include "cellType.h"
 #include "molecule.h"
 #include "array3D.h"
+class MoleculeBundle;
 
 class Tissue {
   public:
@@ -48,6 +49,7 @@ class Tissue {
     // assignment not used
 
     // model definition routines
+    // (molecule types get their grids at setGeometry)
     void addMolType(Molecule *pm) {mol_types.push_back(MolDef(pm));};
     void addCellType(CellType *pct) {cells->addCellType(pct);};
 
@@ -60,6 +62,23 @@ class Tissue {
     void setMolReset(string molname, double interval, Molecule::Conc conc,
 	double sd);
 
+    // synchronous cell updates - all cells see the state at the start of
+    // each step; call after all molecule types have been defined
+    void setSyncUpdate(bool flag);
+
+    // hold back molecule changes made by cells and apply them together 
+    // after the cell update (always on in synchronous mode); call after 
+    // setSyncUpdate
+    void setBufferChanges(bool flag);
+
+    // fixed-point cell positions (see Cells::setLatticePositions)
+    void setLatticePositions(bool flag) {cells->setLatticePositions(flag);};
+
+    // store the concentrations of all explicit-solver molecule types 
+    // (updated every step) interleaved and diffuse them in one sweep (see MoleculeBundle); 
+    // call after initialization - setGeometry undoes it
+    void setBundleMolecules(bool flag);
+
     // running simulation
     void update(double deltaT);		// run sim for one timestep
 
@@ -85,7 +104,7 @@ class Tissue {
     // return molecule concentration for molecule type of index i:
     Molecule::Conc getAvgConc(int i) const 
       {return mol_types[i].typeptr->getAvgConc();};
-    const Array3D<Molecule::Conc>& getConc(int i) const
+    const Array3D<Molecule::Conc>& getConc(int i)
 	{return mol_types[i].typeptr->getConc();};
 
     // determine largest diffusion rate - for sanity checks on spatial vs.
@@ -129,10 +148,11 @@ class Tissue {
       Molecule::Conc reset_value;	// concentration to use
       double reset_sd;			// standard deviation
       double next_reset;		// sim time of next reset
+      int pending_steps;		// steps since last updated
       MolDef(Molecule *mp) : typeptr(mp), 
         reset_interval(numeric_limits<double>::max()), 
 	reset_value(0), reset_sd(0), 
-	next_reset(numeric_limits<double>::max()) {};
+	next_reset(numeric_limits<double>::max()), pending_steps(0) {};
     };
 
     vector<MolDef> mol_types;
@@ -144,6 +164,11 @@ class Tissue {
 
     double simtime;		// elapsed time in sim
 
+    MoleculeBundle *m_bundle;	// bundled molecule types, if any
+    ScratchPool m_scratch;	// spare grids for molecule updates
+
+    void setMolGeometry(Molecule *pm);	// its own resolution, or m_molres
+
     // not used
     Tissue(const Tissue &t);	// copy constructor should not be used
     Tissue operator = (const Tissue &t);    // assignment should not be used	
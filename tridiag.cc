@@ -0,0 +1,224 @@
+
+/************************************************************************
+ * 									*
+ * Copyright (C) 2004  Christina Warrender				*
+ * 									*
+ * This file is part of CyCells.					*
+ *									*
+ * CyCells is free software; you can redistribute it and/or modify it 	*
+ * under the terms of the GNU General Public License as published by	*
+ * the Free Software Foundation; either version 2 of the License, or	*
+ * (at your option) any later version.					*
+ *									*
+ * CyCells is distributed in the hope that it will be useful,		*
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of	*
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the	*
+ * GNU General Public License for more details.				*
+ *									*
+ * You should have received a copy of the GNU General Public License	*
+ * along with CyCells; if not, write to the Free Software Foundation, 	*
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA	*
+ *									*
+ ************************************************************************/
+/************************************************************************
+ * file tridiag.cc                                                      *
+ * Routines for CyclicTridiag class                                     *
+ ************************************************************************/
+
+#include "tridiag.h"
+#include <cassert>
+
+using namespace std;
+
+/************************************************************************ 
+ * ~CyclicTridiag()                                                     *
+ *   Destructor - nothing to do but free the vectors; defined here so   *
+ *   the vectors' destructors aren't inlined into every caller          *
+ *                                                                      *
+ * Parameters                                                           *
+ *                                                                      *
+ * Returns - nothing                                                    *
+************************************************************************/
+CyclicTridiag::~CyclicTridiag()
+{
+}
+
+/************************************************************************ 
+ * setSystem()                                                          *
+ *   Factors the matrix for line length n and coefficient r.            *
+ *   The periodic corner elements are handled with the Sherman-Morrison *
+ *   formula (as in Numerical Recipes' cyclic()):  the remaining        *
+ *   tridiagonal matrix is factored here, and the correction vector z   *
+ *   solved for once, since neither depends on the right-hand side.     *
+ *   Does nothing if n and r haven't changed.                           *
+ *                                                                      *
+ * Parameters                                                           *
+ *   int n:			number of points in a line              *
+ *   double r:			diffusion rate*time step/grid size^2    *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void CyclicTridiag::setSystem(int n, double r)
+{
+  assert(n>0); assert(r>=0);
+  if (n == m_n && r == m_r)
+    return;
+
+  m_n = n; m_r = r;
+  if (n < 3)		// solved directly
+    return;
+
+  double diag = 1 + 2*r;	// diagonal; off-diagonals & corners are -r
+  double gamma = -diag;
+
+  m_cp.resize(n); m_inv.resize(n); m_z.resize(n);
+  for (int i=0; i<n; i++)
+  {
+    double b = diag;
+    if (i == 0)
+      b = diag - gamma;
+    else if (i == n-1)
+      b = diag - r*r/gamma;
+    double denom = (i == 0) ? b : b + r*m_cp[i-1];
+    m_inv[i] = 1/denom;
+    m_cp[i] = -r*m_inv[i];
+  }
+
+  for (int i=0; i<n; i++)
+    m_z[i] = 0;
+  m_z[0] = gamma;
+  m_z[n-1] = -r;
+  thomas(&m_z[0]);
+  m_fact = 1 + m_z[0] - r*m_z[n-1]/gamma;
+}
+
+/************************************************************************ 
+ * solve()                                                              *
+ *   Solves the system set up by setSystem for one contiguous line, in  *
+ *   place.  The exact solution can't be negative for non-negative b;   *
+ *   values are clamped at 0 so rounding error can't make them so.      *
+ *                                                                      *
+ * Parameters                                                           *
+ *   double *b:			right-hand side; replaced by solution   *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void CyclicTridiag::solve(double *b)
+{
+  assert(m_n>0);
+  const int n = m_n;
+
+  if (n < 3)
+  {
+    solveLines(b, 1, 1);
+    return;
+  }
+
+  thomas(b);
+  double gamma = -(1 + 2*m_r);
+  double fact = (b[0] - m_r*b[n-1]/gamma) / m_fact;
+  for (int i=0; i<n; i++)
+  {
+    double value = b[i] - fact*m_z[i];
+    b[i] = (value < 0) ? 0 : value;
+  }
+}
+
+/************************************************************************ 
+ * solveLines()                                                         *
+ *   Solves the system set up by setSystem for several lines at once,   *
+ *   in place.  Each step of the algorithm is done for all lines before *
+ *   going on to the next, so the inner loops run over adjacent memory  *
+ *   even though each line is strided.  Clamped at 0 as in solve().     *
+ *                                                                      *
+ * Parameters                                                           *
+ *   double *b:			first value of first line; replaced by  *
+ *				solution				*
+ *   int stride:		distance between values in a line       *
+ *   int nlines:		number of lines (adjacent in memory)    *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void CyclicTridiag::solveLines(double *b, int stride, int nlines)
+{
+  assert(m_n>0); assert(nlines>0);
+  const int n = m_n;
+  const double r = m_r;
+
+  if (n == 1)
+    return;			// neighbors are the point itself
+  if (n == 2)			// each point is both neighbors of the other
+  {
+    double *b1 = b + stride;
+    for (int m=0; m<nlines; m++)
+    {
+      double sum = b[m] + b1[m];
+      double diff = (b[m] - b1[m]) / (1 + 4*r);
+      b[m] = (sum + diff)/2;
+      b1[m] = (sum - diff)/2;
+    }
+    return;
+  }
+
+  // forward elimination
+  for (int m=0; m<nlines; m++)
+    b[m] *= m_inv[0];
+  for (int i=1; i<n; i++)
+  {
+    double *row = b + i*stride;
+    const double *prev = row - stride;
+    const double inv = m_inv[i];
+    for (int m=0; m<nlines; m++)
+      row[m] = (row[m] + r*prev[m]) * inv;
+  }
+
+  // back substitution
+  for (int i=n-2; i>=0; i--)
+  {
+    double *row = b + i*stride;
+    const double *next = row + stride;
+    const double cp = m_cp[i];
+    for (int m=0; m<nlines; m++)
+      row[m] -= cp*next[m];
+  }
+
+  // periodic correction
+  if (int(m_fix.size()) < nlines)
+    m_fix.resize(nlines);
+  double gamma = -(1 + 2*r);
+  const double *last = b + (n-1)*stride;
+  for (int m=0; m<nlines; m++)
+    m_fix[m] = (b[m] - r*last[m]/gamma) / m_fact;
+  for (int i=0; i<n; i++)
+  {
+    double *row = b + i*stride;
+    const double z = m_z[i];
+    for (int m=0; m<nlines; m++)
+    {
+      double value = row[m] - m_fix[m]*z;
+      row[m] = (value < 0) ? 0 : value;
+    }
+  }
+}
+
+/************************************************************************ 
+ * thomas()                                                             *
+ *   Solves the tridiagonal part of the system (corners left out), in   *
+ *   place, using the factors from setSystem                            *
+ *                                                                      *
+ * Parameters                                                           *
+ *   double *x:			right-hand side; replaced by solution   *
+ *                                                                      *
+ * Returns - nothing                                                    *
+ ************************************************************************/
+void CyclicTridiag::thomas(double *x) const
+{
+  const int n = m_n;
+
+  x[0] *= m_inv[0];
+  for (int i=1; i<n; i++)
+    x[i] = (x[i] + m_r*x[i-1]) * m_inv[i];
+  for (int i=n-2; i>=0; i--)
+    x[i] -= m_cp[i]*x[i+1];
+}
+
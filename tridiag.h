@@ -0,0 +1,73 @@
+
+/************************************************************************
+ * 									*
+ * Copyright (C) 2004  Christina Warrender				*
+ * 									*
+ * This file is part of CyCells.					*
+ *									*
+ * CyCells is free software; you can redistribute it and/or modify it 	*
+ * under the terms of the GNU General Public License as published by	*
+ * the Free Software Foundation; either version 2 of the License, or	*
+ * (at your option) any later version.					*
+ *									*
+ * CyCells is distributed in the hope that it will be useful,		*
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of	*
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the	*
+ * GNU General Public License for more details.				*
+ *									*
+ * You should have received a copy of the GNU General Public License	*
+ * along with CyCells; if not, write to the Free Software Foundation, 	*
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA	*
+ *									*
+ ************************************************************************/
+/************************************************************************
+ * file tridiag.h                                                       *
+ * Declarations for CyclicTridiag class                                 *
+ * Solver for the periodic tridiagonal systems of implicit diffusion    *
+ ***********************************************************************/
+
+#ifndef TRIDIAG_H
+#define TRIDIAG_H
+
+#include <vector>
+
+using namespace std;
+
+// Solves (1+2r)u[i] - r u[i-1] - r u[i+1] = b[i], i = 0..n-1, with the 
+// neighbors wrapping around (u[-1] is u[n-1], u[n] is u[0]) - one line 
+// of a backward-Euler diffusion step on a periodic grid.  The matrix 
+// depends only on n and r, so the factorization is done once in 
+// setSystem and reused for every line.
+class CyclicTridiag {
+  public:
+    //--------------------------- CREATORS --------------------------------- 
+    CyclicTridiag() : m_n(0), m_r(-1), m_fact(0) {};
+    // use default copy constructor
+    ~CyclicTridiag();
+
+    //------------------------- MANIPULATORS -------------------------------
+    // set line length and r (diffusion rate * time step / grid size^2)
+    void setSystem(int n, double r);
+
+    // replace b (n contiguous values) by the solution u
+    void solve(double *b);
+
+    // solve nlines systems at once:  value i of line m is b[i*stride+m],
+    // so consecutive lines are adjacent in memory (lines along x or y)
+    void solveLines(double *b, int stride, int nlines);
+
+  private:
+    int m_n;
+    double m_r;
+    double m_fact;		// Sherman-Morrison correction denominator
+
+    vector<double> m_cp;	// modified superdiagonal (Thomas algorithm)
+    vector<double> m_inv;	// 1/modified diagonal
+    vector<double> m_z;		// solution for the correction vector
+    vector<double> m_fix;	// correction factor for each line
+
+    void thomas(double *x) const;	// solve the non-periodic part
+};
+
+#endif
+